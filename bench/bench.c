@@ -0,0 +1,510 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "../src/instance.h"
+#include "../src/instance_binary.h"
+#include "../src/davis.h"
+#include "../src/lookup.h"
+#include "../src/segment_evaluation.h"
+#include "../src/generator.h"
+#include "../src/individual.h"
+#include "../src/pareto.h"
+
+/*
+ * Default number of repetitions of each benchmark.
+ */
+#define DEFAULT_REPETITIONS 5
+
+/*
+ * Default number of segments of the synthetic instance.
+ */
+#define DEFAULT_SEGMENTS 1000
+
+/*
+ * Default distance stride of the coarse tables.
+ */
+#define DEFAULT_SCREENING_STRIDE 4
+
+/*
+ * Random individuals in the population evaluation benchmarks.
+ */
+#define BENCH_POPULATION 64
+
+/*
+ * Random points in the non-dominated sorting benchmark: twice a large population.
+ */
+#define BENCH_PARETO_POINTS 40000
+
+/*
+ * Number of operations timed in each repetition of the micro-benchmarks.
+ */
+#define MICRO_OPS 1000000
+
+/**
+ * Command line options.
+ */
+typedef struct BenchOptions {
+    size_t          segments;       // Segments of the synthetic instance
+    size_t          repetitions;    // Repetitions of each benchmark
+    unsigned int    seed;           // Seed for the synthetic instance and inputs
+    TrainType       train_type;     // Train of the synthetic instance
+    size_t          stride;         // Distance stride of the coarse tables
+    const char*     json_file;      // If not NULL, benchmark the json readers on this file
+    const char*     binary_file;    // If not NULL, benchmark the binary reader on this file
+    bool            json_output;    // Print one json object per benchmark instead of text
+} BenchOptions;
+
+/**
+ * Everything a benchmark may need.
+ */
+typedef struct BenchContext {
+    const BenchOptions* options;
+    Instance*           instance;
+    Lookup*             lookup;
+    Lookup*             coarse_lookup;
+    EvaluationInput*    inputs;     // Valid evaluation inputs
+    size_t*             cells;      // Random (segment, speed, distance) triples, flattened
+    Individual**        population; // BENCH_POPULATION random individuals
+    IndividualObjectives* points;   // BENCH_PARETO_POINTS random objectives
+    size_t              ops;        // Operations per repetition
+} BenchContext;
+
+/*
+ * Results are accumulated here, so that the compiler cannot optimise the work away.
+ */
+static volatile float sink;
+
+/*
+ * implementation-method
+ */
+static double seconds_since(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (double) (now.tv_sec - start->tv_sec) + 1e-9 * (double) (now.tv_nsec - start->tv_nsec);
+}
+
+/*
+ * implementation-method
+ *
+ * Runs a benchmark the requested number of times, and reports the time per operation.
+ */
+static void run_benchmark(const char* name, void (*benchmark)(BenchContext*), BenchContext* ctx) {
+    double sum = 0;
+    double sum_sq = 0;
+    size_t repetitions = ctx->options->repetitions;
+
+    for(size_t r = 0; r < repetitions; r++) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        benchmark(ctx);
+
+        double ns_per_op = 1e9 * seconds_since(&start) / ctx->ops;
+
+        sum += ns_per_op;
+        sum_sq += ns_per_op * ns_per_op;
+    }
+
+    double mean = sum / repetitions;
+    double stddev = sqrt(fmax(0, sum_sq / repetitions - mean * mean));
+
+    if(ctx->options->json_output) {
+        printf("{\"benchmark\": \"%s\", \"segments\": %zu, \"ops\": %zu, \"repetitions\": %zu, "
+               "\"ns_per_op\": %.3f, \"ns_per_op_stddev\": %.3f, \"ops_per_s\": %.1f}\n",
+            name, ctx->instance->num_segments, ctx->ops, repetitions, mean, stddev, 1e9 / mean);
+    } else {
+        printf("%-40s %10.1f ns/op (+/- %6.1f) %14.0f ops/s\n", name, mean, stddev, 1e9 / mean);
+    }
+}
+
+/*
+ * Benchmarks.
+ */
+static void bench_resistance(BenchContext* ctx) {
+    float total = 0;
+
+    for(size_t i = 0; i < ctx->ops; i++) {
+        const Segment* seg = &ctx->instance->segments[ctx->cells[3 * i]];
+        total += resistance(&ctx->instance->train, seg, ctx->cells[3 * i + 1] * SPEED_STEP);
+    }
+
+    sink = total;
+}
+
+static void bench_lookup_accessors(BenchContext* ctx) {
+    float total = 0;
+
+    for(size_t i = 0; i < ctx->ops; i++) {
+        size_t* cell = &ctx->cells[3 * i];
+        total += get_max_acceleration_time(ctx->lookup, cell[0], cell[1], cell[2]);
+        total += get_coasting_speed(ctx->lookup, cell[0], cell[1], cell[2]);
+        total += get_max_braking_position(ctx->lookup, cell[0], cell[1], cell[2]);
+    }
+
+    sink = total;
+}
+
+/*
+ * Target-speed queries, answered by scanning the speed rows or by the reach tables. The target
+ * speed index is derived from the random distance of each cell.
+ */
+static size_t reach_target(const BenchContext* ctx, const size_t* cell) {
+    size_t speeds = get_speed_index(ctx->instance->segments[cell[0]].speed_limit) + 1;
+    return (cell[1] + cell[2]) % speeds;
+}
+
+static void bench_reach_linear_scan(BenchContext* ctx) {
+    size_t total = 0;
+
+    for(size_t i = 0; i < ctx->ops; i++) {
+        size_t* cell = &ctx->cells[3 * i];
+        size_t steps = get_distance_steps(&ctx->instance->segments[cell[0]]);
+        float target = reach_target(ctx, cell) * SPEED_STEP;
+        size_t k = 0, h = 0;
+
+        while(k <= steps && get_max_acceleration_speed(ctx->lookup, cell[0], cell[1], k) < target) { k++; }
+        while(h <= steps && get_max_braking_speed(ctx->lookup, cell[0], cell[1], h) > target) { h++; }
+
+        total += k + h;
+    }
+
+    sink = (float) total;
+}
+
+static void bench_reach_table(BenchContext* ctx) {
+    size_t total = 0;
+
+    for(size_t i = 0; i < ctx->ops; i++) {
+        size_t* cell = &ctx->cells[3 * i];
+        size_t target = reach_target(ctx, cell);
+
+        total += get_max_acceleration_reach(ctx->lookup, cell[0], cell[1], target);
+        total += get_max_braking_reach(ctx->lookup, cell[0], cell[1], target);
+    }
+
+    sink = (float) total;
+}
+
+static void bench_run_on_segment(BenchContext* ctx) {
+    float total = 0;
+
+    for(size_t i = 0; i < ctx->ops; i++) {
+        SegmentRun run = run_on_segment(ctx->instance, ctx->lookup, &ctx->inputs[i]);
+        total += run.end_times[MAX_BRAKING];
+    }
+
+    sink = total;
+}
+
+static void bench_run_on_segment_coarse(BenchContext* ctx) {
+    float total = 0;
+
+    for(size_t i = 0; i < ctx->ops; i++) {
+        SegmentRun run = run_on_segment(ctx->instance, ctx->coarse_lookup, &ctx->inputs[i]);
+        total += run.end_times[MAX_BRAKING];
+    }
+
+    sink = total;
+}
+
+static void bench_cost_of_segment(BenchContext* ctx) {
+    float total = 0;
+
+    for(size_t i = 0; i < ctx->ops; i++) {
+        total += cost_of_segment(ctx->instance, ctx->lookup, &ctx->inputs[i]);
+    }
+
+    sink = total;
+}
+
+static void bench_evaluate_individuals(BenchContext* ctx) {
+    float total = 0;
+
+    for(size_t p = 0; p < BENCH_POPULATION; p++) {
+        total += evaluate_individual(ctx->instance, ctx->lookup, ctx->population[p]);
+    }
+
+    sink = total;
+}
+
+static void bench_evaluate_population(BenchContext* ctx) {
+    evaluate_population(ctx->instance, ctx->lookup, ctx->population, NULL, BENCH_POPULATION);
+    sink = ctx->population[0]->cost;
+}
+
+static void bench_non_dominated_sort(BenchContext* ctx) {
+    static size_t ranks[BENCH_PARETO_POINTS];
+    static double crowding[BENCH_PARETO_POINTS];
+
+    sink = (float) non_dominated_sort(ctx->points, BENCH_PARETO_POINTS, ranks, crowding, NULL);
+}
+
+static void bench_generate_max_acceleration(BenchContext* ctx) {
+    generate_lookup_table_for_driving_style(ctx->instance, ctx->lookup, &ctx->lookup->max_acceleration, ctx->instance->train.max_acceleration);
+}
+
+static void bench_generate_coasting(BenchContext* ctx) {
+    generate_lookup_table_for_driving_style(ctx->instance, ctx->lookup, &ctx->lookup->coasting, 0);
+}
+
+static void bench_generate_max_braking(BenchContext* ctx) {
+    generate_lookup_table_for_driving_style(ctx->instance, ctx->lookup, &ctx->lookup->max_braking, - ctx->instance->train.max_braking);
+}
+
+static void bench_generate_lookup_tables(BenchContext* ctx) {
+    Lookup l = generate_lookup_tables(ctx->instance, NULL);
+    free_lookup_tables(&l);
+}
+
+static void bench_generate_coarse_lookup_tables(BenchContext* ctx) {
+    Lookup l = generate_coarse_lookup_tables(ctx->instance, ctx->options->stride, NULL);
+    free_lookup_tables(&l);
+}
+
+static void bench_read_instance(BenchContext* ctx) {
+    Instance instance = read_instance(ctx->options->json_file, NULL);
+    free_instance(&instance);
+}
+
+static void bench_read_instance_streaming(BenchContext* ctx) {
+    Instance instance = read_instance_streaming(ctx->options->json_file, NULL);
+    free_instance(&instance);
+}
+
+static void bench_read_instance_binary(BenchContext* ctx) {
+    Instance instance = read_instance_binary(ctx->options->binary_file, NULL);
+    free_instance(&instance);
+}
+
+/*
+ * implementation-method
+ */
+static void exit_on_error(const TegaError* error) {
+    if(error->status != TEGA_OK) {
+        fprintf(stderr, "%s\n", error->message);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * implementation-method
+ *
+ * Counts the segments of an instance file, which is the unit of work of the readers. This
+ * also checks that the file can be read, before it is read many times.
+ */
+static size_t count_segments(Instance (*reader)(const char *const, TegaError*), const char* filename) {
+    TegaError error = no_error();
+    Instance instance = reader(filename, &error);
+    size_t n = instance.num_segments;
+
+    exit_on_error(&error);
+
+    free_instance(&instance);
+    return n;
+}
+
+/*
+ * implementation-method
+ */
+static BenchOptions parse_options(int argc, char** argv) {
+    BenchOptions options = {
+        .segments = DEFAULT_SEGMENTS,
+        .repetitions = DEFAULT_REPETITIONS,
+        .seed = 1u,
+        .train_type = SNCF_TGV,
+        .stride = DEFAULT_SCREENING_STRIDE,
+        .json_file = NULL,
+        .binary_file = NULL,
+        .json_output = false
+    };
+
+    for(int i = 1; i < argc; i++) {
+        bool has_value = (i + 1 < argc);
+
+        if(strcmp(argv[i], "--segments") == 0 && has_value) {
+            options.segments = (size_t) strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--repetitions") == 0 && has_value) {
+            options.repetitions = (size_t) strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--seed") == 0 && has_value) {
+            options.seed = (unsigned int) strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--train") == 0 && has_value) {
+            options.train_type = (TrainType) strtol(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--screening-stride") == 0 && has_value) {
+            options.stride = (size_t) strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--instance") == 0 && has_value) {
+            options.json_file = argv[++i];
+        } else if(strcmp(argv[i], "--binary") == 0 && has_value) {
+            options.binary_file = argv[++i];
+        } else if(strcmp(argv[i], "--json") == 0) {
+            options.json_output = true;
+        } else {
+            fprintf(stderr, "Usage: %s [--segments N] [--repetitions N] [--seed N] [--train 10|11|20|21] [--screening-stride N] [--instance file.json] [--binary file.bin] [--json]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if(options.segments < 2 || options.repetitions == 0 || options.stride == 0) {
+        fprintf(stderr, "There must be at least 2 segments, 1 repetition, and a positive screening stride\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return options;
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options = parse_options(argc, argv);
+    GeneratorParams params = default_generator_params(options.segments, options.seed);
+    params.train_type = options.train_type;
+
+    TegaError error = no_error();
+    Instance instance = generate_instance(&params, &error);
+    exit_on_error(&error);
+
+    Lookup lookup = generate_lookup_tables(&instance, &error);
+    exit_on_error(&error);
+
+    // Only for the reach benchmarks: the optimiser does not use them
+    add_reach_tables(&instance, &lookup, &error);
+    exit_on_error(&error);
+
+    Lookup coarse_lookup = generate_coarse_lookup_tables(&instance, options.stride, &error);
+    exit_on_error(&error);
+    unsigned int seed = options.seed;
+
+    // Random table cells inside each segment's extents, and random valid evaluation inputs
+    size_t* cells = malloc(3 * MICRO_OPS * sizeof(*cells));
+    EvaluationInput* inputs = malloc(MICRO_OPS * sizeof(*inputs));
+
+    if(cells == NULL || inputs == NULL) {
+        fprintf(stderr, "Could not allocate memory for the benchmark inputs\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for(size_t i = 0; i < MICRO_OPS; i++) {
+        size_t segment = (size_t) rand_r(&seed) % instance.num_segments;
+        size_t steps = get_distance_steps(&instance.segments[segment]);
+        size_t speeds = get_speed_index(instance.segments[segment].speed_limit) + 1;
+        size_t x[3] = {rand_r(&seed) % (steps + 1), rand_r(&seed) % (steps + 1), rand_r(&seed) % (steps + 1)};
+
+        if(x[0] > x[1]) { size_t t = x[0]; x[0] = x[1]; x[1] = t; }
+        if(x[1] > x[2]) { size_t t = x[1]; x[1] = x[2]; x[2] = t; }
+        if(x[0] > x[1]) { size_t t = x[0]; x[0] = x[1]; x[1] = t; }
+
+        cells[3 * i] = segment;
+        cells[3 * i + 1] = (size_t) rand_r(&seed) % speeds;
+        cells[3 * i + 2] = (size_t) rand_r(&seed) % (steps + 1);
+
+        inputs[i] = (EvaluationInput) {
+            .segment_id = segment,
+            .x1 = x[0],
+            .x2 = x[1],
+            .x3 = x[2],
+            .e_speed = cells[3 * i + 1] * SPEED_STEP,
+            .e_time = 0
+        };
+    }
+
+    Individual individuals[BENCH_POPULATION];
+    Individual* population[BENCH_POPULATION];
+
+    for(size_t p = 0; p < BENCH_POPULATION; p++) {
+        individuals[p] = new_individual(&instance, &error);
+        exit_on_error(&error);
+
+        for(size_t i = 0; i < instance.num_segments; i++) {
+            randomise_segment(&instance, &individuals[p], i, &seed);
+        }
+
+        population[p] = &individuals[p];
+    }
+
+    // Correlated objectives, as in a population, so that there are many fronts
+    IndividualObjectives* points = malloc(BENCH_PARETO_POINTS * sizeof(*points));
+
+    if(points == NULL) {
+        fprintf(stderr, "Could not allocate memory for the benchmark inputs\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for(size_t i = 0; i < BENCH_PARETO_POINTS; i++) {
+        double energy = (double) rand_r(&seed) / RAND_MAX;
+        points[i] = (IndividualObjectives) {.energy = energy, .deviation = 1 - energy + (double) rand_r(&seed) / RAND_MAX};
+    }
+
+    BenchContext ctx = {
+        .options = &options,
+        .instance = &instance,
+        .lookup = &lookup,
+        .coarse_lookup = &coarse_lookup,
+        .inputs = inputs,
+        .cells = cells,
+        .population = population,
+        .points = points,
+        .ops = MICRO_OPS
+    };
+
+    if(!options.json_output) {
+        LookupFillReport report = lookup_fill_report(&instance, &lookup, &error);
+        exit_on_error(&error);
+
+        print_lookup_fill_report(&report, 3);
+        free_lookup_fill_report(&report);
+    }
+
+    run_benchmark("resistance", bench_resistance, &ctx);
+    run_benchmark("lookup_accessors (3 reads)", bench_lookup_accessors, &ctx);
+    run_benchmark("reach/linear_scan (2 queries)", bench_reach_linear_scan, &ctx);
+    run_benchmark("reach/table (2 queries)", bench_reach_table, &ctx);
+    run_benchmark("run_on_segment", bench_run_on_segment, &ctx);
+    run_benchmark("run_on_segment/coarse", bench_run_on_segment_coarse, &ctx);
+    run_benchmark("cost_of_segment", bench_cost_of_segment, &ctx);
+
+    // Evaluations are measured per simulated segment
+    ctx.ops = BENCH_POPULATION * instance.num_segments;
+    run_benchmark("evaluate_individual (individual-major)", bench_evaluate_individuals, &ctx);
+    run_benchmark("evaluate_population (segment-major)", bench_evaluate_population, &ctx);
+
+    // Sorting is measured per point
+    ctx.ops = BENCH_PARETO_POINTS;
+    run_benchmark("non_dominated_sort", bench_non_dominated_sort, &ctx);
+
+    // Table generation is measured per segment
+    ctx.ops = instance.num_segments;
+    run_benchmark("generate_table/max_acceleration", bench_generate_max_acceleration, &ctx);
+    run_benchmark("generate_table/coasting", bench_generate_coasting, &ctx);
+    run_benchmark("generate_table/max_braking", bench_generate_max_braking, &ctx);
+    run_benchmark("generate_lookup_tables", bench_generate_lookup_tables, &ctx);
+    run_benchmark("generate_coarse_lookup_tables", bench_generate_coarse_lookup_tables, &ctx);
+
+    // Readers are measured per segment of the file
+    if(options.json_file != NULL) {
+        ctx.ops = count_segments(read_instance_streaming, options.json_file);
+        run_benchmark("read_instance", bench_read_instance, &ctx);
+        run_benchmark("read_instance_streaming", bench_read_instance_streaming, &ctx);
+    }
+
+    if(options.binary_file != NULL) {
+        ctx.ops = count_segments(read_instance_binary, options.binary_file);
+        run_benchmark("read_instance_binary", bench_read_instance_binary, &ctx);
+    }
+
+    for(size_t p = 0; p < BENCH_POPULATION; p++) {
+        free_individual(&individuals[p]);
+    }
+
+    free(points);
+    free(cells);
+    free(inputs);
+    free_lookup_tables(&coarse_lookup);
+    free_lookup_tables(&lookup);
+    free_instance(&instance);
+
+    return 0;
+}
@@ -0,0 +1,84 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#include "arena.h"
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+/*
+ * implementation-method
+ */
+static size_t round_up(size_t sz, size_t alignment) {
+    return (sz + alignment - 1) / alignment * alignment;
+}
+
+/*
+ * api-method
+ */
+bool init_arena(Arena* arena, size_t capacity, bool huge_pages, TegaError* error) {
+    *arena = (Arena) {.base = NULL, .capacity = 0, .used = 0, .huge_pages = false};
+
+    // mmap does not accept empty mappings
+    if(capacity == 0) { capacity = ARENA_ALIGNMENT; }
+
+    void* base = MAP_FAILED;
+
+    if(huge_pages) {
+        capacity = round_up(capacity, ARENA_HUGE_PAGE_SZ);
+
+#ifdef MAP_HUGETLB
+        base = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        arena->huge_pages = base != MAP_FAILED;
+#endif
+    }
+
+    if(base == MAP_FAILED) {
+        base = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if(base == MAP_FAILED) {
+            return set_error(error, TEGA_ERROR_OUT_OF_MEMORY, "Could not map %zu bytes: %s", capacity, strerror(errno));
+        }
+
+#ifdef MADV_HUGEPAGE
+        // Only a hint: transparent huge pages may be disabled
+        if(huge_pages) { madvise(base, capacity, MADV_HUGEPAGE); }
+#endif
+    }
+
+    arena->base = base;
+    arena->capacity = capacity;
+
+    return true;
+}
+
+/*
+ * api-method
+ */
+void* arena_alloc(Arena* arena, size_t sz) {
+    size_t block_sz = arena_block_size(sz);
+
+    if(arena->base == NULL || block_sz > arena->capacity - arena->used) { return NULL; }
+
+    void* block = arena->base + arena->used;
+    arena->used += block_sz;
+
+    return block;
+}
+
+/*
+ * api-method
+ */
+size_t arena_block_size(size_t sz) {
+    return round_up(sz > 0 ? sz : 1, ARENA_ALIGNMENT);
+}
+
+/*
+ * api-method
+ */
+void free_arena(Arena* arena) {
+    if(arena->base != NULL) { munmap(arena->base, arena->capacity); }
+
+    *arena = (Arena) {.base = NULL, .capacity = 0, .used = 0, .huge_pages = false};
+}
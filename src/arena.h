@@ -0,0 +1,62 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#ifndef TEGA_ARENA_H
+#define TEGA_ARENA_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "error.h"
+
+// Alignment of the blocks given by arena_alloc [bytes]: a cache line
+#define ARENA_ALIGNMENT 64
+
+// Size of a huge page on x86-64 and arm64 [bytes]
+#define ARENA_HUGE_PAGE_SZ ((size_t) 2 << 20)
+
+/**
+ * A region of memory mapped at once, from which blocks are handed out in order and released
+ * all together. The pages are not touched when the region is mapped: each page is placed
+ * (and, on NUMA machines, placed on the node of the thread) when it is first written.
+ */
+typedef struct Arena {
+    char*   base;           // Start of the region
+    size_t  capacity;       // Size of the region [bytes]
+    size_t  used;           // Bytes handed out so far, including alignment padding
+    bool    huge_pages;     // Whether the region is backed by reserved huge pages (MAP_HUGETLB)
+} Arena;
+
+/**
+ * Maps a region. With huge_pages, reserved huge pages are tried first; if none are available,
+ * the kernel is asked to back the region with transparent huge pages instead.
+ * @param arena         The arena to initialise
+ * @param capacity      Size of the region [bytes]
+ * @param huge_pages    Whether to use huge pages
+ * @param error         Filled if the region cannot be mapped (can be NULL)
+ * @return              False on error
+ */
+bool init_arena(Arena* arena, size_t capacity, bool huge_pages, TegaError* error);
+
+/**
+ * Gives a block of ARENA_ALIGNMENT-aligned memory. Its content is zero until written.
+ * @param arena     The arena
+ * @param sz        Size of the block [bytes]
+ * @return          The block, or NULL if the arena is full
+ */
+void* arena_alloc(Arena* arena, size_t sz);
+
+/**
+ * Memory needed by an arena to hold blocks of the given size, with their alignment padding.
+ * @param sz        Size of a block [bytes]
+ * @return          Size to add to the capacity [bytes]
+ */
+size_t arena_block_size(size_t sz);
+
+/**
+ * Unmaps the region, releasing all the blocks at once.
+ * @param arena     The arena
+ */
+void free_arena(Arena* arena);
+
+#endif //TEGA_ARENA_H
@@ -99,13 +99,31 @@ inline static float davis_resistance(const Train* t, float speed) {
 /*
  * api-method
  */
-float resistance(const Train* train, const Segment* segment, float speed) {
-    assert(speed >= 0);
+TrackResistance track_resistance(const Segment* segment) {
     assert(segment->curve >= 0);
 
+    return (TrackResistance) {
+        .curve = (segment->curve < STRAIGHT_TRACK_RADIUS_EPS) ? 0 : (- CURVE_RESISTANCE_CONSTANT / segment->curve),
+        .gravity = GRAVITATIONAL_ACCELERATION * sinf(segment->slope)
+    };
+}
+
+/*
+ * api-method
+ */
+float resistance_on_track(const Train* train, const TrackResistance* track, float speed) {
+    assert(speed >= 0);
+
     float davis_r = - davis_resistance(train, speed);
-    float curve_r = (segment->curve < STRAIGHT_TRACK_RADIUS_EPS) ? 0 : (- CURVE_RESISTANCE_CONSTANT / segment->curve);
-    float gravity_r = GRAVITATIONAL_ACCELERATION * sinf(segment->slope);
 
-    return davis_r + curve_r + gravity_r;
+    return davis_r + track->curve + track->gravity;
+}
+
+/*
+ * api-method
+ */
+float resistance(const Train* train, const Segment* segment, float speed) {
+    TrackResistance track = track_resistance(segment);
+
+    return resistance_on_track(train, &track, speed);
 }
\ No newline at end of file
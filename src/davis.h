@@ -131,6 +131,33 @@
  */
 #define CURVE_RESISTANCE_CONSTANT       8
 
+/**
+ * The terms of the resistance that only depend on the track. They can be computed once per
+ * segment, and shared by all the trains running on it.
+ */
+typedef struct TrackResistance {
+    float curve;    // Track curvature resistance [m/s^2]
+    float gravity;  // Gravity resistance [m/s^2]
+} TrackResistance;
+
+/**
+ * Calculates the terms of the resistance due to a segment's curve and slope.
+ *
+ * @param s         The segment
+ * @return          The curve (<= 0) and gravity terms [m/s^2]
+ */
+TrackResistance track_resistance(const Segment* segment);
+
+/**
+ * Calculates the total resistance, like resistance, with the track terms already computed.
+ *
+ * @param t         The train
+ * @param track     The track terms of the segment where it's moving
+ * @param speed     The current train speed [m/s]
+ * @return          The resistance (acceleration if >= 0, or deceleration if < 0) [m/s^2]
+ */
+float resistance_on_track(const Train* train, const TrackResistance* track, float speed);
+
 /**
  * Calculates the total resistance opposing or favouring a train's motion.
  * It takes into account:
@@ -0,0 +1,52 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#include "error.h"
+#include <stdio.h>
+#include <stdarg.h>
+
+/*
+ * api-method
+ */
+TegaError no_error(void) {
+    return (TegaError) {.status = TEGA_OK, .message = ""};
+}
+
+/*
+ * api-method
+ */
+bool set_error(TegaError* error, TegaStatus status, const char* format, ...) {
+    if(error != NULL) {
+        va_list args;
+
+        va_start(args, format);
+        error->status = status;
+        vsnprintf(error->message, sizeof(error->message), format, args);
+        va_end(args);
+    }
+
+    return false;
+}
+
+/*
+ * api-method
+ */
+const char* status_description(TegaStatus status) {
+    switch(status) {
+        case TEGA_OK:
+            return "no error";
+        case TEGA_ERROR_IO:
+            return "input/output error";
+        case TEGA_ERROR_PARSE:
+            return "malformed file";
+        case TEGA_ERROR_INVALID_INSTANCE:
+            return "invalid instance";
+        case TEGA_ERROR_INVALID_ARGUMENT:
+            return "invalid argument";
+        case TEGA_ERROR_OUT_OF_MEMORY:
+            return "out of memory";
+        default:
+            return "unknown error";
+    }
+}
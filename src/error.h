@@ -0,0 +1,58 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#ifndef TEGA_ERROR_H
+#define TEGA_ERROR_H
+
+#include <stdbool.h>
+
+// Maximum length of an error message, terminator included
+#define ERROR_MESSAGE_SZ 256
+
+/**
+ * Outcome of an operation which can fail.
+ */
+typedef enum TegaStatus {
+    TEGA_OK = 0,
+    TEGA_ERROR_IO,                  // A file cannot be opened, read, mapped, or written
+    TEGA_ERROR_PARSE,               // A file is not well formed
+    TEGA_ERROR_INVALID_INSTANCE,    // Values out of range, inconsistent counts, unknown train type
+    TEGA_ERROR_INVALID_ARGUMENT,    // A parameter or argument is not acceptable
+    TEGA_ERROR_OUT_OF_MEMORY        // An allocation failed
+} TegaStatus;
+
+/**
+ * Error reported by the library. Functions which can fail take a pointer to one of these as
+ * their last argument (which can be NULL), and leave it untouched if they succeed: initialise
+ * it with no_error() and check its status afterwards. Nothing is printed, and the process is
+ * never terminated.
+ */
+typedef struct TegaError {
+    TegaStatus  status;
+    char        message[ERROR_MESSAGE_SZ];
+} TegaError;
+
+/**
+ * Gives an error with status TEGA_OK.
+ * @return  The error
+ */
+TegaError no_error(void);
+
+/**
+ * Fills an error, if it is not NULL, with a status and a printf-style message.
+ * @param error     The error
+ * @param status    The status
+ * @param format    The message format, followed by its arguments
+ * @return          Always false, so that a function can return set_error(...)
+ */
+bool set_error(TegaError* error, TegaStatus status, const char* format, ...) __attribute__((format(printf, 3, 4)));
+
+/**
+ * Gives a short description of a status.
+ * @param status    The status
+ * @return          The description
+ */
+const char* status_description(TegaStatus status);
+
+#endif //TEGA_ERROR_H
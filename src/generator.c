@@ -0,0 +1,197 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#include "generator.h"
+#include "lookup.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+/*
+ * implementation-method
+ *
+ * Draws a value uniformly from the range.
+ */
+static float uniform(const GeneratorRange* range, unsigned int* seed) {
+    return range->min + (range->max - range->min) * ((float) rand_r(seed) / (float) RAND_MAX);
+}
+
+/*
+ * implementation-method
+ *
+ * Draws an integer uniformly from the range (both ends included).
+ */
+static size_t uniform_count(const GeneratorRange* range, unsigned int* seed) {
+    size_t min = (size_t) ceilf(range->min);
+    size_t max = (size_t) floorf(range->max);
+
+    if(max <= min) { return min; }
+    return min + (size_t) rand_r(seed) % (max - min + 1);
+}
+
+/*
+ * implementation-method
+ *
+ * Draws a speed limit, which is a positive multiple of SPEED_STEP.
+ */
+static float draw_speed_limit(const GeneratorParams* params, unsigned int* seed) {
+    float limit = SPEED_STEP * roundf(uniform(&params->speed_limit, seed) / SPEED_STEP);
+    return fmaxf(limit, SPEED_STEP);
+}
+
+/*
+ * api-method
+ */
+GeneratorParams default_generator_params(size_t num_segments, unsigned int seed) {
+    return (GeneratorParams) {
+        .num_segments = num_segments,
+        .train_type = SNCF_TGV,
+        .seed = seed,
+        .segment_length = {.min = 200, .max = 3000},
+        .slope = {.min = -0.005f, .max = 0.005f},
+        .straight_probability = 0.6f,
+        .curve = {.min = 2000, .max = 10000},
+        .speed_limit = {.min = 25, .max = 85},
+        .speed_limit_change_probability = 0.2f,
+        .station_spacing = {.min = 20, .max = 80},
+        .stop_time = {.min = 60, .max = 300},
+        .schedule_speed_fraction = 0.75f
+    };
+}
+
+/*
+ * api-method
+ */
+Train default_train(TrainType type) {
+    switch(type) {
+        case SNCF_TGV:
+            return (Train) {.type = type, .num_coaches = 7, .mass = 415000, .mass_per_axle = 29642.86f, .max_acceleration = 1.0f, .max_braking = 0.35f, .length = 200};
+        case SNCF_NORMAL:
+            return (Train) {.type = type, .num_coaches = 10, .mass = 450000, .mass_per_axle = 11250, .max_acceleration = 0.5f, .max_braking = 0.6f, .length = 270};
+        case DB_ICE:
+            return (Train) {.type = type, .num_coaches = 8, .mass = 409000, .mass_per_axle = 12781.25f, .max_acceleration = 0.9f, .max_braking = 0.5f, .length = 200};
+        case DB_NORMAL:
+            return (Train) {.type = type, .num_coaches = 7, .mass = 400000, .mass_per_axle = 12500, .max_acceleration = 0.4f, .max_braking = 0.5f, .length = 220};
+        default:
+            return (Train) {.type = type, .num_coaches = 0, .mass = 0, .mass_per_axle = 0, .max_acceleration = 0, .max_braking = 0, .length = 0};
+    }
+}
+
+/*
+ * implementation-method
+ *
+ * Checks that the parameters give a valid instance. Comparisons are written so that NaNs fail.
+ */
+static bool check_params(const GeneratorParams* params, TegaError* error) {
+    if(train_type_name(params->train_type) == NULL) {
+        return set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "Unknown train type: %d", (int) params->train_type);
+    }
+
+    if(params->num_segments < 2) {
+        return set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "An instance needs at least 2 segments (the stations at its ends)");
+    }
+
+    if(!(params->schedule_speed_fraction > 0)) {
+        return set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "The schedule speed fraction must be positive");
+    }
+
+    if(!(params->segment_length.min > 0) || !(params->segment_length.min <= params->segment_length.max)) {
+        return set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "Segment lengths must be positive");
+    }
+
+    if(!(params->speed_limit.max > 0) || !(params->speed_limit.min <= params->speed_limit.max)) {
+        return set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "Speed limits must be positive");
+    }
+
+    if(!(params->curve.min >= 0) || !(params->curve.min <= params->curve.max)) {
+        return set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "Curve radii must be non-negative");
+    }
+
+    if(!(params->stop_time.min >= 0) || !(params->stop_time.min <= params->stop_time.max) || !(params->station_spacing.min <= params->station_spacing.max)) {
+        return set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "Stop times must be non-negative, and ranges must have min <= max");
+    }
+
+    return true;
+}
+
+/*
+ * api-method
+ */
+Instance generate_instance(const GeneratorParams* params, TegaError* error) {
+    if(!check_params(params, error)) {
+        return (Instance) {.segments = NULL, .num_segments = 0};
+    }
+
+    Segment* segments = malloc(params->num_segments * sizeof(*segments));
+
+    if(segments == NULL) {
+        set_error(error, TEGA_ERROR_OUT_OF_MEMORY, "Could not allocate memory for the segments");
+        return (Instance) {.segments = NULL, .num_segments = 0};
+    }
+
+    unsigned int seed = params->seed;
+    size_t last = params->num_segments - 1;
+    size_t next_station = 0;
+    float current_x = 0;
+    float running_time = 0;     // Scheduled running time since the last departure
+    float departure_time = 0;   // Scheduled departure from the last station
+    float speed_limit = 0;
+
+    for(size_t i = 0; i < params->num_segments; i++) {
+        if(i == next_station || i == last) {
+            float arrival_time = ceilf(departure_time + running_time);
+            float stop_time = (i == 0 || i == last) ? 0 : roundf(uniform(&params->stop_time, &seed));
+
+            segments[i] = (Segment) {
+                .id = (uint_fast32_t) i,
+                .arrival_time = arrival_time,
+                .stop_time = stop_time,
+                .length = 0,
+                .slope = 0,
+                .curve = 0,
+                .speed_limit = 0,
+                .start_x = current_x,
+                .end_x = current_x,
+                .is_station = true,
+                .has_arrival_time = true
+            };
+
+            departure_time = arrival_time + stop_time;
+            running_time = 0;
+            speed_limit = 0;
+            next_station = i + 1 + uniform_count(&params->station_spacing, &seed);
+
+            // Never leave a section without segments at the end of the route
+            if(next_station >= last) { next_station = last; }
+
+            continue;
+        }
+
+        if(speed_limit == 0 || (float) rand_r(&seed) / (float) RAND_MAX < params->speed_limit_change_probability) {
+            speed_limit = draw_speed_limit(params, &seed);
+        }
+
+        float length = fmaxf(DISTANCE_STEP, DISTANCE_STEP * roundf(uniform(&params->segment_length, &seed) / DISTANCE_STEP));
+        bool straight = (float) rand_r(&seed) / (float) RAND_MAX < params->straight_probability;
+
+        segments[i] = (Segment) {
+            .id = (uint_fast32_t) i,
+            .arrival_time = -1,
+            .stop_time = -1,
+            .length = length,
+            .slope = uniform(&params->slope, &seed),
+            .curve = straight ? 0 : roundf(uniform(&params->curve, &seed)),
+            .speed_limit = speed_limit,
+            .start_x = current_x,
+            .end_x = current_x + length,
+            .is_station = false,
+            .has_arrival_time = false
+        };
+
+        current_x += length;
+        running_time += length / (params->schedule_speed_fraction * speed_limit);
+    }
+
+    return (Instance) {.segments = segments, .train = default_train(params->train_type), .num_segments = params->num_segments, .start_speed = 0, .start_time = 0};
+}
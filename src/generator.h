@@ -0,0 +1,112 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#ifndef TEGA_GENERATOR_H
+#define TEGA_GENERATOR_H
+
+#include <stddef.h>
+#include "instance.h"
+
+/**
+ * Closed interval from which a value is drawn uniformly.
+ */
+typedef struct GeneratorRange {
+    float min;
+    float max;
+} GeneratorRange;
+
+/**
+ * Parameters of the synthetic instance generator.
+ */
+typedef struct GeneratorParams {
+    /**
+     * Total number of segments, stations included (at least 2: the route starts and
+     * ends at a station).
+     */
+    size_t num_segments;
+
+    /**
+     * Type of the train; its other characteristics are taken from default_train.
+     */
+    TrainType train_type;
+
+    /**
+     * Seed of the random number generator: the same parameters always give the same instance.
+     */
+    unsigned int seed;
+
+    /**
+     * Length of the non-station segments [m], rounded to a multiple of DISTANCE_STEP.
+     */
+    GeneratorRange segment_length;
+
+    /**
+     * Slope of the non-station segments [rad].
+     */
+    GeneratorRange slope;
+
+    /**
+     * Probability that a non-station segment is straight.
+     */
+    float straight_probability;
+
+    /**
+     * Curve radius of the curved segments [m].
+     */
+    GeneratorRange curve;
+
+    /**
+     * Speed limit [m/s], rounded to a multiple of SPEED_STEP.
+     */
+    GeneratorRange speed_limit;
+
+    /**
+     * Probability that the speed limit changes from one segment to the next, within the
+     * same section between two stations. The first segment after a station always draws a
+     * new limit.
+     */
+    float speed_limit_change_probability;
+
+    /**
+     * Number of non-station segments between two consecutive stations.
+     */
+    GeneratorRange station_spacing;
+
+    /**
+     * Stop time at the intermediate stations [s], rounded to the second.
+     */
+    GeneratorRange stop_time;
+
+    /**
+     * The scheduled arrival at a station assumes the train travels at this fraction of the
+     * speed limit, which leaves time to accelerate and brake.
+     */
+    float schedule_speed_fraction;
+} GeneratorParams;
+
+/**
+ * Gives parameters for a high-speed line, with a station every 20 to 80 segments.
+ * @param num_segments  Number of segments
+ * @param seed          Seed of the random number generator
+ * @return              The default parameters
+ */
+GeneratorParams default_generator_params(size_t num_segments, unsigned int seed);
+
+/**
+ * Gives a typical train of the given type.
+ * @param type  The train type
+ * @return      The train, with all characteristics at 0 if the type is unknown
+ */
+Train default_train(TrainType type);
+
+/**
+ * Generates a random instance. The first and the last segment are stations, and every
+ * station has an arrival time.
+ * @param params    The generator parameters
+ * @param error     Filled if the parameters are invalid (can be NULL)
+ * @return          The new instance (to be freed with free_instance), or one without segments on error
+ */
+Instance generate_instance(const GeneratorParams* params, TegaError* error);
+
+#endif //TEGA_GENERATOR_H
@@ -0,0 +1,501 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#include "genetic.h"
+#include "metrics.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <time.h>
+#include <math.h>
+
+/*
+ * implementation-method
+ */
+static int compare_individuals(const void* a, const void* b) {
+    double ca = ((const Individual*) a)->cost;
+    double cb = ((const Individual*) b)->cost;
+
+    return (ca > cb) - (ca < cb);
+}
+
+/*
+ * A child of the generation being bred.
+ */
+typedef struct BredChild {
+    size_t              child;          // Index in the offspring
+    size_t              first_changed;  // First segment differing from the first parent
+    const Individual*   parent;         // First parent
+    double              coarse_cost;    // Cost on the coarse tables, when screening
+} BredChild;
+
+/*
+ * Buffers to breed and evaluate a generation, with one entry per individual.
+ */
+typedef struct GenerationBuffers {
+    BredChild*      children;       // The children being bred
+    Individual**    batch;          // Individuals evaluated together (see evaluate_population)
+    size_t*         batch_from;     // First segment to simulate for each of them
+} GenerationBuffers;
+
+/*
+ * implementation-method
+ *
+ * By coarse cost, then by index, so that ties are promoted in a deterministic order.
+ */
+static int compare_screened_children(const void* a, const void* b) {
+    const BredChild* ca = a;
+    const BredChild* cb = b;
+
+    if(ca->coarse_cost != cb->coarse_cost) { return (ca->coarse_cost > cb->coarse_cost) - (ca->coarse_cost < cb->coarse_cost); }
+
+    return (ca->child > cb->child) - (ca->child < cb->child);
+}
+
+/*
+ * implementation-method
+ *
+ * Tournament selection: the population must be sorted by cost, so that the winner is the one
+ * with the smallest index.
+ */
+static const Individual* select_parent(const Individual* population, const GeneticParams* params, unsigned int* seed) {
+    size_t best = params->population_size;
+
+    for(size_t i = 0; i < params->tournament_size; i++) {
+        size_t candidate = (size_t) rand_r(seed) % params->population_size;
+        if(candidate < best) { best = candidate; }
+    }
+
+    return &population[best];
+}
+
+/*
+ * implementation-method
+ *
+ * Selects two parents and breeds a child from them (see breed_individual). Returns the first
+ * segment to simulate.
+ */
+static size_t breed_child(const Instance* instance, const Individual* population, Individual* child, const GeneticParams* params, const Individual** first_parent, unsigned int* seed) {
+    const Individual* p1 = select_parent(population, params, seed);
+    const Individual* p2 = select_parent(population, params, seed);
+
+    *first_parent = p1;
+
+    return breed_individual(instance, p1, p2, child, params->mutation_probability, seed);
+}
+
+/*
+ * implementation-method
+ *
+ * Breeds the children offspring[first], ..., offspring[pop_n - 1], without evaluating them.
+ * Each child has its own seed, so that they do not depend on the number of threads.
+ * Returns the number of children.
+ */
+static size_t breed_children(const Instance* instance, const Individual* population, Individual* offspring, size_t first, const GeneticParams* params, unsigned int generation_seed, BredChild* children) {
+    size_t children_n = params->population_size - first;
+
+    #pragma omp parallel for schedule(static)
+    for(size_t c = 0; c < children_n; c++) {
+        size_t i = first + c;
+        unsigned int child_seed = generation_seed + (unsigned int) i;
+
+        children[c].child = i;
+        children[c].first_changed = breed_child(instance, population, &offspring[i], params, &children[c].parent, &child_seed);
+        children[c].coarse_cost = 0;
+    }
+
+    return children_n;
+}
+
+/*
+ * implementation-method
+ *
+ * Evaluates the bred children children[0], ..., children[n - 1] segment by segment.
+ * Returns the number of segments simulated.
+ */
+static size_t evaluate_children(const Instance* instance, const Lookup* lt, Individual* offspring, const BredChild* children, size_t n, GenerationBuffers* buffers) {
+    for(size_t c = 0; c < n; c++) {
+        buffers->batch[c] = &offspring[children[c].child];
+        buffers->batch_from[c] = children[c].first_changed;
+    }
+
+    return evaluate_population(instance, lt, buffers->batch, buffers->batch_from, n);
+}
+
+/*
+ * implementation-method
+ *
+ * Breeds and evaluates the children offspring[first], ..., offspring[pop_n - 1]. Returns the
+ * number of segments simulated.
+ */
+static size_t generate_children(const Instance* instance, const Lookup* lt, const Individual* population, Individual* offspring, size_t first, const GeneticParams* params, unsigned int generation_seed, GenerationBuffers* buffers) {
+    size_t children = breed_children(instance, population, offspring, first, params, generation_seed, buffers->children);
+
+    return evaluate_children(instance, lt, offspring, buffers->children, children, buffers);
+}
+
+/*
+ * implementation-method
+ *
+ * Breeds the children offspring[first], ..., offspring[pop_n - 1] with screening: they are
+ * evaluated on the coarse tables, the best promotion_ratio of them again on the full tables,
+ * and the others are replaced by their first parent. Returns the number of segments
+ * simulated on the full tables.
+ */
+static size_t generate_screened_children(const Instance* instance, const Lookup* lt, const Individual* population, Individual* offspring, size_t first, const GeneticParams* params, unsigned int generation_seed, GenerationBuffers* buffers, SolverResult* result) {
+    BredChild* screened = buffers->children;
+    size_t children = breed_children(instance, population, offspring, first, params, generation_seed, screened);
+
+    if(children == 0) { return 0; }
+
+    evaluate_children(instance, params->screening_lookup, offspring, screened, children, buffers);
+
+    for(size_t c = 0; c < children; c++) {
+        screened[c].coarse_cost = offspring[screened[c].child].cost;
+    }
+
+    size_t promoted = (size_t) ceilf(params->promotion_ratio * (float) children);
+
+    if(promoted < 1) { promoted = 1; }
+    if(promoted > children) { promoted = children; }
+
+    qsort(screened, children, sizeof(*screened), compare_screened_children);
+
+    size_t evaluations = evaluate_children(instance, lt, offspring, screened, promoted, buffers);
+    double gap = 0;
+
+    for(size_t c = 0; c < promoted; c++) {
+        double cost = offspring[screened[c].child].cost;
+        gap += fabs(cost - screened[c].coarse_cost) / fmax(fabs(cost), 1e-9);
+    }
+
+    #pragma omp parallel for schedule(static)
+    for(size_t c = promoted; c < children; c++) {
+        copy_individual(&offspring[screened[c].child], screened[c].parent);
+    }
+
+    METRICS_COUNT(COUNTER_SCREENED_CHILDREN, children);
+    METRICS_COUNT(COUNTER_PROMOTED_CHILDREN, promoted);
+
+    result->screened += children;
+    result->promoted += promoted;
+    result->fidelity_gap += gap;
+
+    return evaluations;
+}
+
+/*
+ * implementation-method
+ *
+ * Copies the genes of the warm start solution, optionally mutating them.
+ */
+static void seed_from_warm_start(const Instance* instance, Individual* individual, const GeneticParams* params, bool mutate, unsigned int* seed) {
+    assert(params->warm_start->num_segments == individual->num_segments);
+
+    for(size_t i = 0; i < individual->num_segments; i++) {
+        if(mutate && (float) rand_r(seed) / RAND_MAX < params->mutation_probability) {
+            randomise_segment(instance, individual, i, seed);
+        } else {
+            individual->genes[i] = params->warm_start->genes[i];
+        }
+    }
+}
+
+/*
+ * implementation-method
+ */
+static double seconds_since(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (double) (now.tv_sec - start->tv_sec) + 1e-9 * (double) (now.tv_nsec - start->tv_nsec);
+}
+
+/*
+ * implementation-method
+ */
+static bool time_is_up(const GeneticParams* params, const struct timespec* start) {
+    return params->time_limit > 0 && seconds_since(start) >= params->time_limit;
+}
+
+/*
+ * implementation-method
+ */
+static void add_trace_point(SolverResult* result, size_t* capacity, double time, size_t evaluations, double best_cost) {
+    if(result->trace_n == *capacity) {
+        ConvergencePoint* trace = realloc(result->trace, 2 * *capacity * sizeof(*result->trace));
+
+        // Without memory the trace loses detail, but its last point stays up to date
+        if(trace == NULL) {
+            result->trace_n--;
+        } else {
+            result->trace = trace;
+            *capacity *= 2;
+        }
+    }
+
+    result->trace[result->trace_n++] = (ConvergencePoint) {
+        .time = time,
+        .evaluations = evaluations,
+        .best_cost = best_cost
+    };
+}
+
+/*
+ * implementation-method
+ *
+ * Keeps a copy of the best feasible individual of the (sorted) population, if it is cheaper
+ * than the best one found so far. Until a feasible individual is found, the cheapest one is
+ * kept instead.
+ */
+static void update_best(const Instance* instance, const Lookup* lt, const Individual* population, size_t pop_n, SolverResult* result) {
+    for(size_t i = 0; i < pop_n; i++) {
+        const Individual* candidate = &population[i];
+
+        if(result->feasible && candidate->cost >= result->best.cost) { return; }
+
+        if(is_feasible_individual(instance, lt, candidate)) {
+            copy_individual(&result->best, candidate);
+            result->feasible = true;
+            return;
+        }
+
+        if(!result->feasible && candidate->cost < result->best.cost) {
+            copy_individual(&result->best, candidate);
+        }
+    }
+}
+
+/*
+ * implementation-method
+ *
+ * Frees the population and the offspring, which can be partially allocated.
+ */
+static void free_population(Individual* population, Individual* offspring, size_t pop_n) {
+    for(size_t i = 0; i < pop_n; i++) {
+        if(population != NULL) { free_individual(&population[i]); }
+        if(offspring != NULL) { free_individual(&offspring[i]); }
+    }
+
+    free(population);
+    free(offspring);
+}
+
+/*
+ * implementation-method
+ */
+static void free_generation_buffers(GenerationBuffers* buffers) {
+    free(buffers->children); buffers->children = NULL;
+    free(buffers->batch); buffers->batch = NULL;
+    free(buffers->batch_from); buffers->batch_from = NULL;
+}
+
+/*
+ * implementation-method
+ */
+static bool check_params(const Instance* instance, const GeneticParams* params, TegaError* error) {
+    if(params->population_size == 0 || params->tournament_size == 0) {
+        return set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "The population and the tournament size must be positive");
+    }
+
+    if(params->num_elites > params->population_size) {
+        return set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "There are more elites (%zu) than individuals (%zu)", params->num_elites, params->population_size);
+    }
+
+    if(params->screening_lookup != NULL && !(params->promotion_ratio > 0 && params->promotion_ratio <= 1)) {
+        return set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "The promotion ratio must be in (0, 1], not %g", params->promotion_ratio);
+    }
+
+    if(params->warm_start != NULL && params->warm_start->num_segments != instance->num_segments) {
+        return set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "The warm start has %zu segments, but the instance has %zu", params->warm_start->num_segments, instance->num_segments);
+    }
+
+    return true;
+}
+
+/*
+ * api-method
+ */
+GeneticParams default_genetic_params(void) {
+    return (GeneticParams) {
+        .population_size = 100,
+        .num_elites = 5,
+        .tournament_size = 3,
+        .mutation_probability = 0.05f,
+        .num_generations = 200,
+        .time_limit = 0,
+        .stall_generations = 50,
+        .stall_tolerance = 1e-4,
+        .seed = 1u,
+        .warm_start = NULL,
+        .screening_lookup = NULL,
+        .promotion_ratio = 0.25f,
+        .local_search = {
+            .max_simulated_segments = 10000,
+            .max_failed_moves = 100
+        }
+    };
+}
+
+/*
+ * api-method
+ */
+SolverResult run_genetic_algorithm(const Instance* instance, const Lookup* lt, const GeneticParams* params, TegaError* error) {
+    SolverResult result = {
+        .best = {.genes = NULL, .entry_speeds = NULL, .entry_times = NULL, .costs = NULL, .deviations = NULL, .energies = NULL, .violations = NULL, .num_segments = 0},
+        .feasible = false,
+        .generations = 0,
+        .evaluations = 0,
+        .elapsed_time = 0,
+        .screened = 0,
+        .promoted = 0,
+        .fidelity_gap = 0,
+        .trace = NULL,
+        .trace_n = 0
+    };
+
+    if(!check_params(instance, params, error)) { return result; }
+
+    METRICS_TIMER_START(optimisation_start);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    size_t pop_n = params->population_size;
+    Individual* population = calloc(pop_n, sizeof(*population));
+    Individual* offspring = calloc(pop_n, sizeof(*offspring));
+    size_t trace_capacity = 64;
+    bool screening = params->screening_lookup != NULL;
+
+    GenerationBuffers buffers = {
+        .children = malloc(pop_n * sizeof(*buffers.children)),
+        .batch = malloc(pop_n * sizeof(*buffers.batch)),
+        .batch_from = malloc(pop_n * sizeof(*buffers.batch_from))
+    };
+
+    result.trace = malloc(trace_capacity * sizeof(*result.trace));
+    result.best = new_individual(instance, error);
+
+    bool allocated = (population != NULL && offspring != NULL && result.trace != NULL && result.best.entry_speeds != NULL) &&
+                     (buffers.children != NULL && buffers.batch != NULL && buffers.batch_from != NULL);
+
+    for(size_t i = 0; allocated && i < pop_n; i++) {
+        population[i] = new_individual(instance, error);
+        offspring[i] = new_individual(instance, error);
+        allocated = (population[i].entry_speeds != NULL && offspring[i].entry_speeds != NULL);
+    }
+
+    if(!allocated) {
+        free_population(population, offspring, pop_n);
+        free_generation_buffers(&buffers);
+        free_solver_result(&result);
+        set_error(error, TEGA_ERROR_OUT_OF_MEMORY, "Could not allocate memory for the population");
+        return result;
+    }
+
+    unsigned int seed = params->seed;
+
+    for(size_t i = 0; i < pop_n; i++) {
+        // With a warm start, half of the population are mutations of the known solution
+        if(params->warm_start != NULL && i < (pop_n + 1) / 2) {
+            seed_from_warm_start(instance, &population[i], params, i > 0, &seed);
+        } else {
+            for(size_t j = 0; j < instance->num_segments; j++) {
+                randomise_segment(instance, &population[i], j, &seed);
+            }
+        }
+
+        buffers.batch[i] = &population[i];
+    }
+
+    result.evaluations += evaluate_population(instance, lt, buffers.batch, NULL, pop_n);
+
+    qsort(population, pop_n, sizeof(*population), compare_individuals);
+
+    result.best.cost = INFINITY;
+    update_best(instance, lt, population, pop_n, &result);
+    add_trace_point(&result, &trace_capacity, seconds_since(&start), result.evaluations, population[0].cost);
+
+    double stall_reference = population[0].cost;
+    size_t stalled = 0;
+
+    while(result.generations < params->num_generations && !time_is_up(params, &start)) {
+        unsigned int generation_seed = rand_r(&seed);
+        size_t evaluations = 0;
+
+        for(size_t i = 0; i < params->num_elites; i++) {
+            copy_individual(&offspring[i], &population[i]);
+        }
+
+        if(screening) {
+            evaluations += generate_screened_children(instance, lt, population, offspring, params->num_elites, params, generation_seed, &buffers, &result);
+        } else {
+            evaluations += generate_children(instance, lt, population, offspring, params->num_elites, params, generation_seed, &buffers);
+        }
+
+        if(!time_is_up(params, &start)) {
+            evaluations += local_search_elites(instance, lt, offspring, params->num_elites, &params->local_search, generation_seed);
+        }
+
+        Individual* tmp = population; population = offspring; offspring = tmp;
+        qsort(population, pop_n, sizeof(*population), compare_individuals);
+
+        double previous_best = result.trace[result.trace_n - 1].best_cost;
+
+        result.generations++;
+        result.evaluations += evaluations;
+        METRICS_COUNT(COUNTER_GENERATIONS, 1);
+        update_best(instance, lt, population, pop_n, &result);
+
+        if(population[0].cost < previous_best) {
+            add_trace_point(&result, &trace_capacity, seconds_since(&start), result.evaluations, population[0].cost);
+        }
+
+        // Early stop when the best cost has not improved enough for a while
+        if(stall_reference - population[0].cost > params->stall_tolerance * fabs(stall_reference)) {
+            stall_reference = population[0].cost;
+            stalled = 0;
+        } else if(params->stall_generations > 0 && ++stalled >= params->stall_generations) {
+            break;
+        }
+    }
+
+    result.elapsed_time = seconds_since(&start);
+
+    // Summed over the promoted children so far
+    if(result.promoted > 0) { result.fidelity_gap /= (double) result.promoted; }
+
+    free_population(population, offspring, pop_n);
+    free_generation_buffers(&buffers);
+
+    METRICS_TIMER_STOP(TIMER_OPTIMISATION, optimisation_start);
+
+    return result;
+}
+
+/*
+ * api-method
+ */
+void free_solver_result(SolverResult* result) {
+    free_individual(&result->best);
+    free(result->trace); result->trace = NULL;
+    result->trace_n = 0;
+}
+
+/*
+ * api-method
+ */
+void print_convergence_trace(const SolverResult* result) {
+    printf("=== CONVERGENCE (%zu generations, %zu segment evaluations, %.3f s, %s) ===\n",
+        result->generations, result->evaluations, result->elapsed_time, result->feasible ? "feasible" : "infeasible");
+    for(size_t i = 0; i < result->trace_n; i++) {
+        printf("\tTime: %.4f s, evaluations: %zu, best cost: %.2f\n",
+            result->trace[i].time, result->trace[i].evaluations, result->trace[i].best_cost);
+    }
+
+    if(result->screened > 0) {
+        printf("\tScreening: %zu children, %zu promoted (%.1f%%), fidelity gap %.2f%%\n",
+            result->screened, result->promoted, 100.0 * result->promoted / result->screened, 100 * result->fidelity_gap);
+    }
+}
@@ -0,0 +1,114 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#ifndef TEGA_GENETIC_H
+#define TEGA_GENETIC_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "instance.h"
+#include "lookup.h"
+#include "individual.h"
+#include "local_search.h"
+
+/**
+ * Parameters of the genetic algorithm.
+ */
+typedef struct GeneticParams {
+    size_t              population_size;        // Number of individuals
+    size_t              num_elites;             // Best individuals copied unchanged into the next generation
+    size_t              tournament_size;        // Individuals competing to be selected as a parent
+    float               mutation_probability;   // Probability of randomising the genes of each segment
+    size_t              num_generations;        // Maximum number of generations
+    double              time_limit;             // Wall-clock budget in [s] (0 means no limit)
+    size_t              stall_generations;      // Stop after this many generations without improvement (0 means never)
+    double              stall_tolerance;        // Relative improvement of the best cost below which a generation counts as stalled
+    unsigned int        seed;                   // Seed of the random number generator
+    LocalSearchParams   local_search;           // Local search applied to the elites at each generation
+    const Individual*   warm_start;             // If not NULL, a known solution used to seed the population
+    const Lookup*       screening_lookup;       // If not NULL, coarse tables on which children are screened (see generate_coarse_lookup_tables)
+    float               promotion_ratio;        // Fraction of the screened children, the best ones, evaluated on the full tables
+} GeneticParams;
+
+/**
+ * A point of the convergence trace of the algorithm, recorded every time the best cost improves.
+ */
+typedef struct ConvergencePoint {
+    double  time;           // Wall-clock time since the start of the algorithm [s]
+    size_t  evaluations;    // Segment simulations performed so far
+    double  best_cost;      // Best cost found so far
+} ConvergencePoint;
+
+/**
+ * Outcome of a run of the genetic algorithm.
+ */
+typedef struct SolverResult {
+    /**
+     * Best feasible individual found, or the best individual overall if none was feasible.
+     */
+    Individual best;
+
+    /**
+     * Whether best is feasible (see is_feasible_individual).
+     */
+    bool feasible;
+
+    /**
+     * Generations completed, total segment simulations, and wall-clock time [s].
+     */
+    size_t generations;
+    size_t evaluations;
+    double elapsed_time;
+
+    /**
+     * Screening on coarse tables: children screened, children promoted to the full tables,
+     * and mean relative difference between the coarse and the full cost of the promoted ones
+     * (the fidelity gap). Segment simulations on the coarse tables are not in evaluations.
+     */
+    size_t screened;
+    size_t promoted;
+    double fidelity_gap;
+
+    /**
+     * Convergence trace (best cost vs time and evaluations).
+     */
+    ConvergencePoint* trace;
+    size_t trace_n;
+} SolverResult;
+
+/**
+ * Gives a reasonable set of parameters for the genetic algorithm.
+ * @return  The default parameters
+ */
+GeneticParams default_genetic_params(void);
+
+/**
+ * Runs the genetic algorithm until the number of generations is reached, the time limit
+ * expires, or the best cost stalls, whichever comes first. The time limit is checked between
+ * the phases of a generation, so it can be exceeded by at most one phase.
+ *
+ * With screening tables, each generation's children are first evaluated on them; only the
+ * best promotion_ratio of them are evaluated on the full tables, and the others are replaced
+ * by their first parent. The population only ever holds costs from the full tables.
+ * @param instance  The instance
+ * @param lt        The look-up tables
+ * @param params    The parameters of the algorithm
+ * @param error     Filled if the parameters are invalid or there is not enough memory (can be NULL)
+ * @return          The result, to be freed with free_solver_result
+ */
+SolverResult run_genetic_algorithm(const Instance* instance, const Lookup* lt, const GeneticParams* params, TegaError* error);
+
+/**
+ * Frees the memory used by a solver result.
+ * @param result    The result
+ */
+void free_solver_result(SolverResult* result);
+
+/**
+ * Prints the convergence trace of a solver result.
+ * @param result    The result
+ */
+void print_convergence_trace(const SolverResult* result);
+
+#endif //TEGA_GENETIC_H
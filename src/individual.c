@@ -0,0 +1,369 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#include "individual.h"
+#include "segment_evaluation.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <memory.h>
+#include <assert.h>
+#include "eps.h"
+#include "metrics.h"
+
+// Individuals evaluated together by a thread in evaluate_population: enough to reuse each
+// slab several times, few enough for their state to stay in cache as well
+#define EVALUATION_BLOCK_SZ 16
+
+/*
+ * implementation-method
+ *
+ * Runs the train on one segment, starting from the cached entry state, and stores the
+ * cost of the segment and the state at its exit.
+ */
+static void simulate_segment(const Instance* instance, const Lookup* lt, Individual* individual, size_t segment) {
+    const Segment* seg = &instance->segments[segment];
+    const SwitchingPoints* genes = &individual->genes[segment];
+
+    EvaluationInput input = {
+        .segment_id = segment,
+        .x1 = genes->x1,
+        .x2 = genes->x2,
+        .x3 = genes->x3,
+        .e_speed = individual->entry_speeds[segment],
+        .e_time = individual->entry_times[segment]
+    };
+
+    SegmentRun run = run_on_segment(instance, lt, &input);
+    float cost = cost_of_run(instance, &input, &run);
+    float deviation = arrival_deviation_of_run(instance, &input, &run);
+    float energy = energy_of_run(&run);
+    float violation = violation_of_run(instance, &input, &run);
+
+    // After an invalid run we restart the simulation with the train standing still
+    float exit_speed = 0;
+    float exit_time = input.e_time;
+
+    if(is_valid_run(&run)) {
+        exit_speed = run.end_speeds[MAX_BRAKING];
+        exit_time = run.end_times[MAX_BRAKING];
+    }
+
+    if(seg->is_station) { exit_time += seg->stop_time; }
+
+    individual->cost += cost - individual->costs[segment];
+    individual->costs[segment] = cost;
+    individual->deviations[segment] = deviation;
+    individual->energies[segment] = energy;
+    individual->violations[segment] = violation;
+    individual->entry_speeds[segment + 1] = exit_speed;
+    individual->entry_times[segment + 1] = exit_time;
+}
+
+/*
+ * implementation-method
+ *
+ * Sums the cost of all segments, so that rounding errors do not build up.
+ */
+static double total_cost(const Individual* individual) {
+    double cost = 0;
+
+    for(size_t i = 0; i < individual->num_segments; i++) {
+        cost += individual->costs[i];
+    }
+
+    return cost;
+}
+
+/*
+ * api-method
+ */
+Individual new_individual(const Instance* instance, TegaError* error) {
+    size_t n = instance->num_segments;
+
+    Individual individual = {
+        .genes = calloc(n, sizeof(*individual.genes)),
+        .entry_speeds = calloc(n + 1, sizeof(*individual.entry_speeds)),
+        .entry_times = calloc(n + 1, sizeof(*individual.entry_times)),
+        .costs = calloc(n, sizeof(*individual.costs)),
+        .deviations = calloc(n, sizeof(*individual.deviations)),
+        .energies = calloc(n, sizeof(*individual.energies)),
+        .violations = calloc(n, sizeof(*individual.violations)),
+        .cost = 0,
+        .num_segments = n
+    };
+
+    if(individual.entry_speeds == NULL || individual.entry_times == NULL || (n > 0 && (individual.genes == NULL || individual.costs == NULL || individual.deviations == NULL || individual.energies == NULL || individual.violations == NULL))) {
+        free_individual(&individual);
+        set_error(error, TEGA_ERROR_OUT_OF_MEMORY, "Could not allocate memory for an individual");
+    }
+
+    return individual;
+}
+
+/*
+ * api-method
+ */
+void free_individual(Individual* individual) {
+    free(individual->genes); individual->genes = NULL;
+    free(individual->entry_speeds); individual->entry_speeds = NULL;
+    free(individual->entry_times); individual->entry_times = NULL;
+    free(individual->costs); individual->costs = NULL;
+    free(individual->deviations); individual->deviations = NULL;
+    free(individual->energies); individual->energies = NULL;
+    free(individual->violations); individual->violations = NULL;
+}
+
+/*
+ * api-method
+ */
+void copy_individual(Individual* dst, const Individual* src) {
+    assert(dst->num_segments == src->num_segments);
+
+    size_t n = src->num_segments;
+
+    memcpy(dst->genes, src->genes, n * sizeof(*src->genes));
+    memcpy(dst->entry_speeds, src->entry_speeds, (n + 1) * sizeof(*src->entry_speeds));
+    memcpy(dst->entry_times, src->entry_times, (n + 1) * sizeof(*src->entry_times));
+    memcpy(dst->costs, src->costs, n * sizeof(*src->costs));
+    memcpy(dst->deviations, src->deviations, n * sizeof(*src->deviations));
+    memcpy(dst->energies, src->energies, n * sizeof(*src->energies));
+    memcpy(dst->violations, src->violations, n * sizeof(*src->violations));
+    dst->cost = src->cost;
+}
+
+/*
+ * api-method
+ */
+void randomise_segment(const Instance* instance, Individual* individual, size_t segment, unsigned int* seed) {
+    size_t steps = get_distance_steps(&instance->segments[segment]);
+    size_t x[3];
+
+    for(size_t i = 0; i < 3; i++) {
+        x[i] = (size_t) rand_r(seed) % (steps + 1);
+    }
+
+    // Sort the three switching points
+    if(x[0] > x[1]) { size_t t = x[0]; x[0] = x[1]; x[1] = t; }
+    if(x[1] > x[2]) { size_t t = x[1]; x[1] = x[2]; x[2] = t; }
+    if(x[0] > x[1]) { size_t t = x[0]; x[0] = x[1]; x[1] = t; }
+
+    individual->genes[segment] = (SwitchingPoints) {.x1 = x[0], .x2 = x[1], .x3 = x[2]};
+}
+
+/*
+ * api-method
+ */
+size_t breed_individual(const Instance* instance, const Individual* p1, const Individual* p2, Individual* child, float mutation_probability, unsigned int* seed) {
+    size_t n = child->num_segments;
+    size_t cut = (size_t) rand_r(seed) % (n + 1);
+
+    copy_individual(child, p1);
+
+    for(size_t i = cut; i < n; i++) {
+        child->genes[i] = p2->genes[i];
+    }
+
+    size_t first_changed = cut;
+
+    for(size_t i = 0; i < n; i++) {
+        if((float) rand_r(seed) / RAND_MAX < mutation_probability) {
+            randomise_segment(instance, child, i, seed);
+            if(i < first_changed) { first_changed = i; }
+        }
+    }
+
+    return first_changed;
+}
+
+/*
+ * api-method
+ */
+void randomise_individual(const Instance* instance, const Lookup* lt, Individual* individual, unsigned int* seed) {
+    for(size_t i = 0; i < individual->num_segments; i++) {
+        randomise_segment(instance, individual, i, seed);
+    }
+
+    evaluate_individual(instance, lt, individual);
+}
+
+/*
+ * api-method
+ */
+double evaluate_individual_from(const Instance* instance, const Lookup* lt, Individual* individual, size_t from) {
+    assert(from <= individual->num_segments);
+
+    for(size_t i = from; i < individual->num_segments; i++) {
+        simulate_segment(instance, lt, individual, i);
+    }
+
+    individual->cost = total_cost(individual);
+    return individual->cost;
+}
+
+/*
+ * api-method
+ */
+double evaluate_individual(const Instance* instance, const Lookup* lt, Individual* individual) {
+    individual->entry_speeds[0] = instance->start_speed;
+    individual->entry_times[0] = instance->start_time;
+
+    return evaluate_individual_from(instance, lt, individual, 0);
+}
+
+/*
+ * implementation-method
+ *
+ * Segment-major evaluation of individuals[0], ..., individuals[n - 1].
+ */
+static size_t evaluate_block(const Instance* instance, const Lookup* lt, Individual* const* individuals, const size_t* from, size_t n) {
+    size_t first = instance->num_segments;
+    size_t simulated = 0;
+
+    for(size_t p = 0; p < n; p++) {
+        size_t p_from = (from != NULL) ? from[p] : 0;
+
+        assert(p_from <= individuals[p]->num_segments);
+
+        if(p_from == 0) {
+            individuals[p]->entry_speeds[0] = instance->start_speed;
+            individuals[p]->entry_times[0] = instance->start_time;
+        }
+
+        if(p_from < first) { first = p_from; }
+    }
+
+    for(size_t i = first; i < instance->num_segments; i++) {
+        for(size_t p = 0; p < n; p++) {
+            if(from != NULL && from[p] > i) { continue; }
+
+            simulate_segment(instance, lt, individuals[p], i);
+            simulated++;
+        }
+    }
+
+    for(size_t p = 0; p < n; p++) {
+        individuals[p]->cost = total_cost(individuals[p]);
+    }
+
+    return simulated;
+}
+
+/*
+ * api-method
+ */
+size_t evaluate_population(const Instance* instance, const Lookup* lt, Individual* const* individuals, const size_t* from, size_t n) {
+    size_t blocks = (n + EVALUATION_BLOCK_SZ - 1) / EVALUATION_BLOCK_SZ;
+    size_t simulated = 0;
+
+    #pragma omp parallel for schedule(dynamic) reduction(+:simulated)
+    for(size_t b = 0; b < blocks; b++) {
+        size_t first = b * EVALUATION_BLOCK_SZ;
+        size_t block_n = (n - first < EVALUATION_BLOCK_SZ) ? n - first : EVALUATION_BLOCK_SZ;
+
+        simulated += evaluate_block(instance, lt, individuals + first, (from != NULL) ? from + first : NULL, block_n);
+    }
+
+    return simulated;
+}
+
+/*
+ * api-method
+ */
+size_t reevaluate_segment(const Instance* instance, const Lookup* lt, Individual* individual, size_t segment) {
+    assert(segment < individual->num_segments);
+
+    size_t simulated = 0;
+    size_t i = segment;
+    float time_shift = 0;
+
+    // Re-simulate until the train enters a segment in the same table row as before
+    for(; i < individual->num_segments; i++) {
+        size_t old_speed_index = get_speed_index(individual->entry_speeds[i + 1]);
+        float old_exit_time = individual->entry_times[i + 1];
+
+        simulate_segment(instance, lt, individual, i);
+        simulated++;
+
+        if(get_speed_index(individual->entry_speeds[i + 1]) == old_speed_index) {
+            time_shift = individual->entry_times[i + 1] - old_exit_time;
+            i++;
+            break;
+        }
+    }
+
+    if(time_shift == 0) { return simulated; }
+
+    // The rest of the run is the same, but shifted in time
+    for(; i < individual->num_segments; i++) {
+        if(instance->segments[i].has_arrival_time) {
+            simulate_segment(instance, lt, individual, i);
+            simulated++;
+        } else {
+            individual->entry_times[i + 1] += time_shift;
+            METRICS_COUNT(COUNTER_REUSED_SEGMENTS, 1);
+        }
+    }
+
+    return simulated;
+}
+
+/*
+ * api-method
+ */
+IndividualObjectives individual_objectives(const Individual* individual) {
+    IndividualObjectives objectives = {.energy = 0, .deviation = 0, .violation = 0};
+
+    for(size_t i = 0; i < individual->num_segments; i++) {
+        objectives.energy += individual->energies[i];
+        objectives.deviation += individual->deviations[i];
+        objectives.violation += individual->violations[i];
+    }
+
+    return objectives;
+}
+
+/*
+ * api-method
+ */
+bool is_feasible_individual(const Instance* instance, const Lookup* lt, const Individual* individual) {
+    for(size_t i = 0; i < individual->num_segments; i++) {
+        const Segment* seg = &instance->segments[i];
+        const SwitchingPoints* genes = &individual->genes[i];
+
+        EvaluationInput input = {
+            .segment_id = i,
+            .x1 = genes->x1,
+            .x2 = genes->x2,
+            .x3 = genes->x3,
+            .e_speed = individual->entry_speeds[i],
+            .e_time = individual->entry_times[i]
+        };
+
+        SegmentRun run = run_on_segment(instance, lt, &input);
+
+        if(!is_valid_run(&run)) { return false; }
+        if(get_distance_steps(seg) * DISTANCE_STEP - run.end_positions[MAX_BRAKING] > DISTANCE_EPS) { return false; }
+        if(run.end_speeds[CRUISING] > seg->speed_limit) { return false; }
+        if(i + 1 < individual->num_segments && run.end_speeds[MAX_BRAKING] > instance->segments[i + 1].speed_limit) { return false; }
+    }
+
+    return true;
+}
+
+/*
+ * api-method
+ */
+void print_individual(const Individual* individual) {
+    printf("=== INDIVIDUAL (cost: %.2f) ===\n", individual->cost);
+    for(size_t i = 0; i < individual->num_segments; i++) {
+        const SwitchingPoints* genes = &individual->genes[i];
+
+        printf("Segment #%zu: switching points at %.2f m, %.2f m, %.2f m\n",
+            i, genes->x1 * DISTANCE_STEP, genes->x2 * DISTANCE_STEP, genes->x3 * DISTANCE_STEP);
+        printf("\tEntry speed: %.2f m/s, entry time: %.2f s, cost: %.2f\n",
+            individual->entry_speeds[i], individual->entry_times[i], individual->costs[i]);
+    }
+    printf("Final speed: %.2f m/s, final time: %.2f s\n",
+        individual->entry_speeds[individual->num_segments], individual->entry_times[individual->num_segments]);
+}
@@ -0,0 +1,180 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#ifndef TEGA_INDIVIDUAL_H
+#define TEGA_INDIVIDUAL_H
+
+#include <stddef.h>
+#include "instance.h"
+#include "lookup.h"
+
+/**
+ * Switching points of the driving profile on a single segment, as distance indices
+ * (distance = x * DISTANCE_STEP). They always satisfy x1 <= x2 <= x3 <= get_distance_steps().
+ */
+typedef struct SwitchingPoints {
+    size_t x1;  // End of max acceleration
+    size_t x2;  // End of cruising
+    size_t x3;  // End of coasting
+} SwitchingPoints;
+
+/**
+ * A driving profile over the whole route, i.e. an individual of the genetic algorithm.
+ *
+ * Besides the genes, it caches the state of the train at the entrance of each segment and
+ * the cost of each segment, so that after changing the genes of one segment, only that
+ * segment and its downstream effects have to be re-simulated.
+ */
+typedef struct Individual {
+    SwitchingPoints*    genes;          // Switching points for each segment
+    float*              entry_speeds;   // Speed entering each segment (the last entry is the final speed)
+    float*              entry_times;    // Time entering each segment (the last entry is the final time)
+    float*              costs;          // Cost of each segment
+    float*              deviations;     // Deviation from the desired arrival time at the end of each segment [s]
+    float*              energies;       // Traction energy of each segment [J/kg]
+    float*              violations;     // Constraint violation of each segment (see violation_of_run)
+    double              cost;           // Total cost
+    size_t              num_segments;   // Number of segments (genes)
+} Individual;
+
+/**
+ * The two goals the cost of an individual trades off, kept apart: the traction energy and
+ * punctuality; and, apart from both, how far the individual is from being drivable.
+ */
+typedef struct IndividualObjectives {
+    double  energy;     // Total traction energy, without penalties [J/kg]
+    double  deviation;  // Total deviation from the desired arrival times [s]
+    double  violation;  // Total constraint violation, 0 iff every run can be driven
+} IndividualObjectives;
+
+/**
+ * Allocates a new individual, with all switching points at 0.
+ * @param instance  The instance
+ * @param error     Filled if there is not enough memory (can be NULL)
+ * @return          The new individual, which is not evaluated yet (with NULL arrays on error)
+ */
+Individual new_individual(const Instance* instance, TegaError* error);
+
+/**
+ * Frees the memory used by an individual.
+ * @param individual    The individual
+ */
+void free_individual(Individual* individual);
+
+/**
+ * Copies genes and evaluation of an individual into another one of the same size.
+ * @param dst   The destination
+ * @param src   The source
+ */
+void copy_individual(Individual* dst, const Individual* src);
+
+/**
+ * Draws new random switching points for one segment.
+ * @param instance      The instance
+ * @param individual    The individual
+ * @param segment       The segment whose genes are randomised
+ * @param seed          Seed for rand_r
+ */
+void randomise_segment(const Instance* instance, Individual* individual, size_t segment, unsigned int* seed);
+
+/**
+ * One-point crossover on segment boundaries, followed by mutation: the child takes the genes
+ * of the first parent before a random cut and those of the second one after it, then the
+ * genes of each segment are randomised with the given probability. The child is not
+ * evaluated: it holds the evaluation of the first parent, which is still valid before the
+ * returned segment.
+ * @param instance              The instance
+ * @param p1                    The first parent
+ * @param p2                    The second parent
+ * @param child                 The child
+ * @param mutation_probability  Probability of randomising the genes of each segment
+ * @param seed                  Seed for rand_r
+ * @return                      The first segment to simulate (see evaluate_individual_from)
+ */
+size_t breed_individual(const Instance* instance, const Individual* p1, const Individual* p2, Individual* child, float mutation_probability, unsigned int* seed);
+
+/**
+ * Draws new random switching points for every segment, and evaluates the individual.
+ * @param instance      The instance
+ * @param lt            The look-up tables
+ * @param individual    The individual
+ * @param seed          Seed for rand_r
+ */
+void randomise_individual(const Instance* instance, const Lookup* lt, Individual* individual, unsigned int* seed);
+
+/**
+ * Simulates the route from a given segment to the end, updating the cached evaluation.
+ * The segments before the starting one must have already been evaluated.
+ * @param instance      The instance
+ * @param lt            The look-up tables
+ * @param individual    The individual
+ * @param from          The first segment to simulate
+ * @return              The total cost of the individual
+ */
+double evaluate_individual_from(const Instance* instance, const Lookup* lt, Individual* individual, size_t from);
+
+/**
+ * Simulates the whole route, updating the cached evaluation.
+ * @param instance      The instance
+ * @param lt            The look-up tables
+ * @param individual    The individual
+ * @return              The total cost of the individual
+ */
+double evaluate_individual(const Instance* instance, const Lookup* lt, Individual* individual);
+
+/**
+ * Evaluates several individuals segment by segment: segment i is simulated for all of them
+ * before segment i + 1, so that the segment's slab of the look-up tables stays in cache
+ * while the individuals run through it, instead of being fetched once per individual. The
+ * individuals are split in blocks, evaluated in parallel. The results are the same as with
+ * evaluate_individual_from on each individual.
+ * @param instance      The instance
+ * @param lt            The look-up tables
+ * @param individuals   The individuals
+ * @param from          The first segment to simulate for each individual, as in
+ *                      evaluate_individual_from (NULL to simulate all individuals from the start)
+ * @param n             Number of individuals
+ * @return              The number of segments simulated
+ */
+size_t evaluate_population(const Instance* instance, const Lookup* lt, Individual* const* individuals, const size_t* from, size_t n);
+
+/**
+ * Re-evaluates a fully evaluated individual after the genes of a single segment changed.
+ * Only the segment itself and the downstream segments whose entry speed changes are
+ * re-simulated; further downstream, the train runs as before, only shifted in time, and
+ * only segments with an arrival time need their cost updated.
+ * @param instance      The instance
+ * @param lt            The look-up tables
+ * @param individual    The individual
+ * @param segment       The segment whose genes changed
+ * @return              The number of segments re-simulated
+ */
+size_t reevaluate_segment(const Instance* instance, const Lookup* lt, Individual* individual, size_t segment);
+
+/**
+ * Splits the cost of an evaluated individual into its objectives.
+ * @param individual    The individual
+ * @return              The objectives; energy + violation + RUN_TIME_PENALTY * deviation is the
+ *                      cost, up to rounding
+ */
+IndividualObjectives individual_objectives(const Individual* individual);
+
+/**
+ * Tells whether the driving profile of an evaluated individual can actually be driven: every
+ * run is inside the look-up tables, reaches the end of its segment, and respects the speed
+ * limits. Arrival times are not taken into account.
+ * @param instance      The instance
+ * @param lt            The look-up tables
+ * @param individual    The individual
+ * @return              True iff the individual is feasible
+ */
+bool is_feasible_individual(const Instance* instance, const Lookup* lt, const Individual* individual);
+
+/**
+ * Prints the driving profile described by an individual.
+ * @param individual    The individual
+ */
+void print_individual(const Individual* individual);
+
+#endif //TEGA_INDIVIDUAL_H
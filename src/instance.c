@@ -3,22 +3,240 @@
 //
 
 #include "instance.h"
+#include "json_stream.h"
+#include "metrics.h"
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 #include <jansson.h>
 #include <memory.h>
 #include <assert.h>
 #include <inttypes.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * implementation-method
+ *
+ * Maps the name of a train type, as used in the json files, to the type.
+ */
+static bool train_type_from_string(const char* str, size_t str_len, TrainType* type) {
+    const TrainType types[] = {SNCF_TGV, SNCF_NORMAL, DB_ICE, DB_NORMAL};
+
+    for(size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        if(json_stream_equals(str, str_len, train_type_name(types[i]))) {
+            *type = types[i];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * implementation-method
+ *
+ * Builds a segment from the values read in the json file. Stations have no length and
+ * always have an arrival time.
+ */
+static Segment new_segment(uint_fast32_t id, bool station, bool has_arrival_time, float arrival_time, float stop_time, float length, float slope, float curve, float speed_limit, float current_x) {
+    if(station) {
+        return (Segment) {
+            .id = id,
+            .arrival_time = arrival_time,
+            .stop_time = stop_time,
+            .length = 0,
+            .slope = 0,
+            .curve = 0,
+            .speed_limit = 0,
+            .start_x = current_x,
+            .end_x = current_x,
+            .is_station = true,
+            .has_arrival_time = true
+        };
+    } else {
+        return (Segment) {
+            .id = id,
+            .arrival_time = (has_arrival_time ? arrival_time : -1),
+            .stop_time = -1,
+            .length = length,
+            .slope = slope,
+            .curve = curve,
+            .speed_limit = speed_limit,
+            .start_x = current_x,
+            .end_x = current_x + length,
+            .is_station = false,
+            .has_arrival_time = has_arrival_time
+        };
+    }
+}
+
+/*
+ * implementation-method
+ *
+ * Checks the values of a train read from a file.
+ */
+static bool check_train(const Train* train, const char *const filename, TegaError* error) {
+    if(!is_valid_train(train)) {
+        return set_error(error, TEGA_ERROR_INVALID_INSTANCE, "Error reading train from %s: its characteristics must be positive, and the mass per axle less than the mass", filename);
+    }
+
+    return true;
+}
+
+/*
+ * implementation-method
+ */
+static Instance empty_instance(void) {
+    return (Instance) {.segments = NULL, .train = {.type = SNCF_TGV}, .num_segments = 0, .start_speed = 0, .start_time = 0};
+}
+
+/*
+ * implementation-method
+ *
+ * Fails with a parse error if a json value is missing or has the wrong type.
+ */
+static bool check_json(bool has_right_type, const char* field, const char *const filename, TegaError* error) {
+    return has_right_type || set_error(error, TEGA_ERROR_PARSE, "Error reading %s: ``%s'' is missing or has the wrong type", filename, field);
+}
+
+/*
+ * implementation-method
+ *
+ * Reads the train from the json tree.
+ */
+static bool read_train_json(const json_t* train_data, const char *const filename, Train* train, TegaError* error) {
+    if(!check_json(json_is_object(train_data), "train", filename, error)) { return false; }
+
+    const json_t* type_data = json_object_get(train_data, "type");
+    const json_t* num_coaches_data = json_object_get(train_data, "num_coaches");
+    const json_t* mass_data = json_object_get(train_data, "mass");
+    const json_t* mass_per_axle_data = json_object_get(train_data, "mass_per_axle");
+    const json_t* max_acceleration_data = json_object_get(train_data, "max_acceleration");
+    const json_t* max_braking_data = json_object_get(train_data, "max_braking");
+    const json_t* length_data = json_object_get(train_data, "length");
+
+    if(!check_json(json_is_string(type_data), "type", filename, error) ||
+       !check_json(json_is_integer(num_coaches_data), "num_coaches", filename, error) ||
+       !check_json(json_is_number(mass_data), "mass", filename, error) ||
+       !check_json(json_is_number(mass_per_axle_data), "mass_per_axle", filename, error) ||
+       !check_json(json_is_number(max_acceleration_data), "max_acceleration", filename, error) ||
+       !check_json(json_is_number(max_braking_data), "max_braking", filename, error) ||
+       !check_json(json_is_number(length_data), "length", filename, error)) {
+        return false;
+    }
+
+    const char* type_str = json_string_value(type_data);
+    TrainType type;
+
+    if(!train_type_from_string(type_str, strlen(type_str), &type)) {
+        return set_error(error, TEGA_ERROR_INVALID_INSTANCE, "Error reading train type from %s: type %s is not currently supported", filename, type_str);
+    }
+
+    Train read = {
+        .type = type,
+        .num_coaches = (uint_fast32_t) json_integer_value(num_coaches_data),
+        .mass = (float) json_number_value(mass_data),
+        .mass_per_axle = (float) json_number_value(mass_per_axle_data),
+        .max_acceleration = (float) json_number_value(max_acceleration_data),
+        .max_braking = (float) json_number_value(max_braking_data),
+        .length = (float) json_number_value(length_data)
+    };
+
+    memcpy(train, &read, sizeof(read));
+
+    return check_train(train, filename, error);
+}
+
+/*
+ * implementation-method
+ *
+ * Reads the segments from the json array into an array of the right size.
+ */
+static bool read_segments_json(const json_t* segments_ary, const char *const filename, Segment* segments, TegaError* error) {
+    float current_x = 0;
+
+    for(size_t i = 0; i < json_array_size(segments_ary); i++) {
+        const json_t* segment_data = json_array_get(segments_ary, i);
+
+        if(!check_json(json_is_object(segment_data), "segments", filename, error)) { return false; }
+
+        const json_t* id_data = json_object_get(segment_data, "id");
+        const json_t* station_data = json_object_get(segment_data, "station");
+        const json_t* arrival_time_data = json_object_get(segment_data, "arrival_time");
+
+        if(!check_json(json_is_integer(id_data), "id", filename, error) ||
+           !check_json(json_is_boolean(station_data), "station", filename, error) ||
+           !check_json(arrival_time_data == NULL || json_is_number(arrival_time_data), "arrival_time", filename, error)) {
+            return false;
+        }
+
+        uint_fast32_t id = (uint_fast32_t) json_integer_value(id_data);
+        bool station = json_is_true(station_data);
+        bool has_arrival_time = (arrival_time_data != NULL);
+
+        if(station) {
+            const json_t* stop_time_data = json_object_get(segment_data, "stop_time");
+
+            if(!check_json(has_arrival_time, "arrival_time", filename, error) ||
+               !check_json(json_is_number(stop_time_data), "stop_time", filename, error)) {
+                return false;
+            }
+
+            segments[i] = new_segment(
+                id, true, true,
+                (float) json_number_value(arrival_time_data),
+                (float) json_number_value(stop_time_data),
+                0, 0, 0, 0, current_x
+            );
+        } else {
+            const json_t* length_data = json_object_get(segment_data, "length");
+            const json_t* slope_data = json_object_get(segment_data, "slope");
+            const json_t* curve_data = json_object_get(segment_data, "curve");
+            const json_t* speed_limit_data = json_object_get(segment_data, "speed_limit");
+
+            if(!check_json(json_is_number(length_data), "length", filename, error) ||
+               !check_json(json_is_number(slope_data), "slope", filename, error) ||
+               !check_json(json_is_number(curve_data), "curve", filename, error) ||
+               !check_json(json_is_number(speed_limit_data), "speed_limit", filename, error)) {
+                return false;
+            }
+
+            segments[i] = new_segment(
+                id, false, has_arrival_time,
+                (has_arrival_time ? (float) json_number_value(arrival_time_data) : -1),
+                -1,
+                (float) json_number_value(length_data),
+                (float) json_number_value(slope_data),
+                (float) json_number_value(curve_data),
+                (float) json_number_value(speed_limit_data),
+                current_x
+            );
+        }
+
+        if(!check_segment(&segments[i], filename, error)) { return false; }
+
+        current_x = segments[i].end_x;
+    }
+
+    return true;
+}
 
 /*
  * api-method
  */
-Instance read_instance(const char *const filename) {
+Instance read_instance(const char *const filename, TegaError* error) {
+    METRICS_TIMER_START(load_start);
+
     FILE* fd;
     fd = fopen(filename, "r");
 
     if(fd == NULL) {
-        fprintf(stderr, "Cannot read input file: %s\n", filename);
-        exit(EXIT_FAILURE);
+        set_error(error, TEGA_ERROR_IO, "Cannot read input file: %s", filename);
+        return empty_instance();
     }
 
     size_t file_sz;
@@ -33,221 +251,458 @@ Instance read_instance(const char *const filename) {
     file_contents = malloc((file_sz + 1) * sizeof(*file_contents));
 
     if(file_contents == NULL) {
-        fprintf(stderr, "Could not allocate memory to read input file: %s\n", filename);
-        exit(EXIT_FAILURE);
+        fclose(fd);
+        set_error(error, TEGA_ERROR_OUT_OF_MEMORY, "Could not allocate memory to read input file: %s", filename);
+        return empty_instance();
     }
 
     // Read the whole file into a string
     size_t chars_read;
     chars_read = fread(file_contents, sizeof(*file_contents), file_sz, fd);
-    assert(chars_read == file_sz);
+    fclose(fd);
+
+    if(chars_read != file_sz) {
+        free(file_contents);
+        set_error(error, TEGA_ERROR_IO, "Cannot read input file: %s", filename);
+        return empty_instance();
+    }
 
     // Add string null-terminator
     file_contents[file_sz] = '\0';
 
-    fclose(fd);
-
     json_t* root;
-    json_error_t error;
+    json_error_t json_error;
 
     // Parse the json content
-    root = json_loads(file_contents, 0, &error);
+    root = json_loads(file_contents, 0, &json_error);
 
     free(file_contents);
 
     if(root == NULL) {
-        fprintf(stderr, "Error reading json in %s, line %d: %s\n", filename, error.line, error.text);
-        exit(EXIT_FAILURE);
+        set_error(error, TEGA_ERROR_PARSE, "Error reading json in %s, line %d: %s", filename, json_error.line, json_error.text);
+        return empty_instance();
     }
 
-    assert(json_is_object(root));
+    Train train = {.type = SNCF_TGV};
+    const json_t* num_segments_data = json_object_get(root, "num_segments");
+    const json_t* segments_ary = json_object_get(root, "segments");
+    Segment* segments = NULL;
+    size_t num_segments = 0;
 
-    json_t* train_data;
-    train_data = json_object_get(root, "train");
-    assert(json_is_object(train_data));
+    bool ok = check_json(json_is_object(root), "root", filename, error) &&
+              read_train_json(json_object_get(root, "train"), filename, &train, error) &&
+              check_json(json_is_integer(num_segments_data), "num_segments", filename, error) &&
+              check_json(json_is_array(segments_ary), "segments", filename, error);
 
-    json_t* train_type_data;
-    json_t* num_coaches_data;
-    json_t* mass_data;
-    json_t* mass_per_axle_data;
-    json_t* max_acceleration_data;
-    json_t* max_braking_data;
-    json_t* length_data;
-    const char* train_type_str;
-    TrainType train_type;
+    if(ok) {
+        num_segments = json_array_size(segments_ary);
 
-    train_type_data = json_object_get(train_data, "type");
-    assert(json_is_string(train_type_data));
+        if((json_int_t) num_segments != json_integer_value(num_segments_data)) {
+            ok = set_error(error, TEGA_ERROR_INVALID_INSTANCE, "Error reading segments from %s: ``num_segments'' is %lld, but the ``segments'' array contains %zu entries", filename, (long long) json_integer_value(num_segments_data), num_segments);
+        }
+    }
 
-    train_type_str = json_string_value(train_type_data);
+    if(ok) {
+        segments = malloc(num_segments * sizeof(*segments));
 
-    if(strcmp(train_type_str, "SNCF TVG") == 0) {
-        train_type = SNCF_TGV;
-    } else {
-        fprintf(stderr, "Error reading train type from %s: type %s is not currently supported\n", filename, train_type_str);
-        json_decref(root);
-        exit(EXIT_FAILURE);
+        if(segments == NULL && num_segments > 0) {
+            ok = set_error(error, TEGA_ERROR_OUT_OF_MEMORY, "Could not allocate memory for the segments");
+        } else {
+            ok = read_segments_json(segments_ary, filename, segments, error);
+        }
     }
 
-    num_coaches_data = json_object_get(train_data, "num_coaches");
-    assert(json_is_number(num_coaches_data));
+    json_decref(root);
 
-    mass_data = json_object_get(train_data, "mass");
-    assert(json_is_real(mass_data));
+    if(!ok) {
+        free(segments);
+        return empty_instance();
+    }
 
-    mass_per_axle_data = json_object_get(train_data, "mass_per_axle");
-    assert(json_is_real(mass_per_axle_data));
+    METRICS_TIMER_STOP(TIMER_INSTANCE_LOAD, load_start);
 
-    max_acceleration_data = json_object_get(train_data, "max_acceleration");
-    assert(json_is_real(max_acceleration_data));
+    return (Instance) {.segments = segments, .train = train, .num_segments = num_segments, .start_speed = 0, .start_time = 0};
+}
 
-    max_braking_data = json_object_get(train_data, "max_braking");
-    assert(json_is_real(max_braking_data));
+/*
+ * implementation-method
+ *
+ * Reads a number from the stream, or fails the stream.
+ */
+static float stream_number(JsonStream* s) {
+    double value = 0;
+    bool is_integer;
 
-    length_data = json_object_get(train_data, "length");
-    assert(json_is_real(length_data));
+    json_stream_number(s, &value, &is_integer);
+    return (float) value;
+}
+
+/*
+ * implementation-method
+ *
+ * Reads the train object from the stream. On invalid values, it fails the stream and
+ * fills the error.
+ */
+static Train read_train_streaming(JsonStream* s, const char *const filename, TegaError* error) {
+    const char* key;
+    size_t key_len;
+    TrainType type = SNCF_TGV;
+    bool has_type = false;
+    double num_coaches = 0;
+    float mass = 0, mass_per_axle = 0, max_acceleration = 0, max_braking = 0, length = 0;
+    bool is_integer;
+
+    json_stream_object_begin(s);
+
+    while(json_stream_next_key(s, &key, &key_len)) {
+        if(json_stream_equals(key, key_len, "type")) {
+            const char* type_str;
+            size_t type_len;
+
+            if(json_stream_string(s, &type_str, &type_len) && !train_type_from_string(type_str, type_len, &type)) {
+                set_error(error, TEGA_ERROR_INVALID_INSTANCE, "Error reading train type from %s: type %.*s is not currently supported", filename, (int) type_len, type_str);
+                s->error = true;
+            }
+
+            has_type = true;
+        } else if(json_stream_equals(key, key_len, "num_coaches")) {
+            json_stream_number(s, &num_coaches, &is_integer);
+        } else if(json_stream_equals(key, key_len, "mass")) {
+            mass = stream_number(s);
+        } else if(json_stream_equals(key, key_len, "mass_per_axle")) {
+            mass_per_axle = stream_number(s);
+        } else if(json_stream_equals(key, key_len, "max_acceleration")) {
+            max_acceleration = stream_number(s);
+        } else if(json_stream_equals(key, key_len, "max_braking")) {
+            max_braking = stream_number(s);
+        } else if(json_stream_equals(key, key_len, "length")) {
+            length = stream_number(s);
+        } else {
+            json_stream_skip(s);
+        }
+    }
 
     Train train = {
-        .type = train_type,
-        .num_coaches = (uint_fast32_t) json_integer_value(num_coaches_data),
-        .mass = (float) json_real_value(mass_data),
-        .mass_per_axle = (float) json_real_value(mass_per_axle_data),
-        .max_acceleration = (float) json_real_value(max_acceleration_data),
-        .max_braking = (float) json_real_value(max_braking_data),
-        .length = (float) json_real_value(length_data)
+        .type = type,
+        .num_coaches = (uint_fast32_t) num_coaches,
+        .mass = mass,
+        .mass_per_axle = mass_per_axle,
+        .max_acceleration = max_acceleration,
+        .max_braking = max_braking,
+        .length = length
     };
 
-    assert(train.mass > 0);
-    assert(train.mass_per_axle > 0);
-    assert(train.mass_per_axle < train.mass);
-    assert(train.max_acceleration > 0);
-    assert(train.max_braking > 0);
-    assert(train.length > 0);
+    if(s->error) { return train; }
+
+    if(!has_type) {
+        set_error(error, TEGA_ERROR_PARSE, "Error reading %s: ``type'' is missing or has the wrong type", filename);
+        s->error = true;
+    } else if(!check_train(&train, filename, error)) {
+        s->error = true;
+    }
+
+    return train;
+}
 
-    json_t* num_segments_data;
-    uint_fast32_t num_segments;
+/*
+ * implementation-method
+ *
+ * Reads one segment object from the stream. Its fields can come in any order. On invalid
+ * values, it fails the stream and fills the error.
+ */
+static Segment read_segment_streaming(JsonStream* s, float current_x, const char *const filename, TegaError* error) {
+    const char* key;
+    size_t key_len;
+    double id = 0;
+    bool station = false, has_station = false, has_arrival_time = false, is_integer = true;
+    float arrival_time = -1, stop_time = -1, length = 0, slope = 0, curve = 0, speed_limit = 0;
+
+    json_stream_object_begin(s);
+
+    while(json_stream_next_key(s, &key, &key_len)) {
+        if(json_stream_equals(key, key_len, "id")) {
+            json_stream_number(s, &id, &is_integer);
+        } else if(json_stream_equals(key, key_len, "station")) {
+            has_station = json_stream_boolean(s, &station);
+        } else if(json_stream_equals(key, key_len, "arrival_time")) {
+            arrival_time = stream_number(s);
+            has_arrival_time = true;
+        } else if(json_stream_equals(key, key_len, "stop_time")) {
+            stop_time = stream_number(s);
+        } else if(json_stream_equals(key, key_len, "length")) {
+            length = stream_number(s);
+        } else if(json_stream_equals(key, key_len, "slope")) {
+            slope = stream_number(s);
+        } else if(json_stream_equals(key, key_len, "curve")) {
+            curve = stream_number(s);
+        } else if(json_stream_equals(key, key_len, "speed_limit")) {
+            speed_limit = stream_number(s);
+        } else {
+            json_stream_skip(s);
+        }
+    }
+
+    if(s->error) { return (Segment) {.id = 0}; }
 
-    num_segments_data = json_object_get(root, "num_segments");
-    assert(json_is_integer(num_segments_data));
+    if(!is_integer || !has_station || (station && !has_arrival_time)) {
+        set_error(error, TEGA_ERROR_PARSE, "Error reading %s, line %d: a segment needs an integer ``id'', ``station'', and stations an ``arrival_time''", filename, json_stream_line(s));
+        s->error = true;
+        return (Segment) {.id = 0};
+    }
 
-    num_segments = (uint_fast32_t) json_integer_value(num_segments_data);
+    Segment segment = new_segment((uint_fast32_t) id, station, has_arrival_time, arrival_time, stop_time, length, slope, curve, speed_limit, current_x);
 
-    json_t* segments_ary;
+    if(!check_segment(&segment, filename, error)) { s->error = true; }
+
+    return segment;
+}
 
-    segments_ary = json_object_get(root, "segments");
-    assert(json_is_array(segments_ary));
+/*
+ * api-method
+ */
+Instance read_instance_streaming(const char *const filename, TegaError* error) {
+    METRICS_TIMER_START(load_start);
 
-    size_t segments_ary_sz = json_array_size(segments_ary);
+    int fd = open(filename, O_RDONLY);
 
-    if(segments_ary_sz != (size_t) num_segments) {
-        fprintf(stderr, "Error reading segments from %s: ``num_segments'' is %" PRIuFAST32 ", but the ``segments'' array contains %zu entries\n", filename, num_segments, segments_ary_sz);
-        json_decref(root);
-        exit(EXIT_FAILURE);
+    if(fd < 0) {
+        set_error(error, TEGA_ERROR_IO, "Cannot read input file: %s", filename);
+        return empty_instance();
     }
 
-    Segment* segments;
-    segments = malloc(segments_ary_sz * sizeof(*segments));
+    struct stat file_stat;
 
-    if(segments == NULL) {
-        fprintf(stderr, "Could not allocate memory for the segments\n");
-        json_decref(root);
-        exit(EXIT_FAILURE);
+    if(fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+        close(fd);
+        set_error(error, TEGA_ERROR_IO, "Cannot read input file: %s", filename);
+        return empty_instance();
     }
 
-    float current_x = 0;
-    for(size_t i = 0; i < segments_ary_sz; i++) {
-        json_t* segment_data;
-        segment_data = json_array_get(segments_ary, i);
-        assert(json_is_object(segment_data));
+    size_t file_sz = (size_t) file_stat.st_size;
+    const char* file_contents = mmap(NULL, file_sz, PROT_READ, MAP_PRIVATE, fd, 0);
 
-        json_t* id_data;
-        json_t* station_data;
-        json_t* arrival_time_data;
-        uint_fast32_t id;
-        bool station;
+    close(fd);
 
-        id_data = json_object_get(segment_data, "id");
-        assert(json_is_integer(id_data));
+    if(file_contents == MAP_FAILED) {
+        set_error(error, TEGA_ERROR_IO, "Could not map input file: %s", filename);
+        return empty_instance();
+    }
 
-        station_data = json_object_get(segment_data, "station");
-        assert(json_is_boolean(station_data));
+    // We read the file once, front to back
+    madvise((void*) file_contents, file_sz, MADV_SEQUENTIAL);
 
-        arrival_time_data = json_object_get(segment_data, "arrival_time");
+    // Errors of the helpers are kept here, to tell them apart from syntax errors
+    TegaError read_error = no_error();
+    JsonStream s = json_stream(file_contents, file_sz);
+    const char* key;
+    size_t key_len;
 
-        id = (uint_fast32_t) json_number_value(id_data);
-        station = (bool) json_boolean_value(station_data);
+    Train train = {.type = SNCF_TGV};
+    bool has_train = false;
+    bool has_num_segments = false;
+    double num_segments = 0;
+    bool is_integer = true;
 
-        if(station) {
-            assert(json_is_number(arrival_time_data));
-
-            json_t* stop_time_data;
-            stop_time_data = json_object_get(segment_data, "stop_time");
-            assert(json_is_number(stop_time_data));
-
-            segments[i] = (Segment) {
-                .id = id,
-                .arrival_time = (float) json_real_value(arrival_time_data),
-                .stop_time = (float) json_real_value(stop_time_data),
-                .length = 0,
-                .slope = 0,
-                .curve = 0,
-                .speed_limit = 0,
-                .start_x = current_x,
-                .end_x = current_x,
-                .is_station = true,
-                .has_arrival_time = true
-            };
-
-            assert(segments[i].arrival_time >= 0);
-            assert(segments[i].stop_time >= 0);
+    Segment* segments = NULL;
+    size_t segments_n = 0;
+    size_t segments_capacity = 0;
+    float current_x = 0;
+
+    json_stream_object_begin(&s);
+
+    while(json_stream_next_key(&s, &key, &key_len)) {
+        if(json_stream_equals(key, key_len, "train")) {
+            Train read_train = read_train_streaming(&s, filename, &read_error);
+            memcpy(&train, &read_train, sizeof(train));
+            has_train = true;
+        } else if(json_stream_equals(key, key_len, "num_segments")) {
+            has_num_segments = json_stream_number(&s, &num_segments, &is_integer) && is_integer && num_segments >= 0;
+        } else if(json_stream_equals(key, key_len, "segments")) {
+            json_stream_array_begin(&s);
+
+            while(json_stream_next_element(&s)) {
+                if(segments_n == segments_capacity) {
+                    // If we already know how many segments there are, allocate them once
+                    segments_capacity = (has_num_segments && (size_t) num_segments > segments_n) ?
+                        (size_t) num_segments :
+                        (segments_capacity == 0 ? 1024 : 2 * segments_capacity);
+
+                    Segment* resized = realloc(segments, segments_capacity * sizeof(*segments));
+
+                    if(resized == NULL) {
+                        set_error(&read_error, TEGA_ERROR_OUT_OF_MEMORY, "Could not allocate memory for the segments");
+                        s.error = true;
+                        break;
+                    }
+
+                    segments = resized;
+                }
+
+                segments[segments_n] = read_segment_streaming(&s, current_x, filename, &read_error);
+                current_x = segments[segments_n].end_x;
+                segments_n++;
+            }
         } else {
-            bool has_arrival_time = (arrival_time_data != NULL);
-
-            json_t* length_data;
-            json_t* slope_data;
-            json_t* curve_data;
-            json_t* speed_limit_data;
-
-            length_data = json_object_get(segment_data, "length");
-            slope_data = json_object_get(segment_data, "slope");
-            curve_data = json_object_get(segment_data, "curve");
-            speed_limit_data = json_object_get(segment_data, "speed_limit");
-
-            float length = (float) json_real_value(length_data);
-
-            segments[i] = (Segment) {
-                .id = id,
-                .arrival_time = (has_arrival_time ? (float) json_real_value(arrival_time_data) : -1),
-                .stop_time = -1,
-                .length = length,
-                .slope = (float) json_real_value(slope_data),
-                .curve = (float) json_real_value(curve_data),
-                .speed_limit = (float) json_real_value(speed_limit_data),
-                .start_x = current_x,
-                .end_x = current_x + length,
-                .is_station = false,
-                .has_arrival_time = has_arrival_time
-            };
-
-            assert(segments[i].length > 0);
-            assert(segments[i].curve >= 0);
-            assert(segments[i].speed_limit > 0);
-            assert(!segments[i].has_arrival_time || segments[i].arrival_time >= 0);
-
-            current_x += length;
+            json_stream_skip(&s);
         }
     }
 
-    json_decref(root);
+    if(s.error && read_error.status == TEGA_OK) {
+        set_error(&read_error, TEGA_ERROR_PARSE, "Error reading json in %s, line %d", filename, json_stream_line(&s));
+    }
+
+    munmap((void*) file_contents, file_sz);
+
+    if(read_error.status == TEGA_OK && !has_train) {
+        set_error(&read_error, TEGA_ERROR_PARSE, "Error reading train from %s: missing ``train''", filename);
+    }
+
+    if(read_error.status == TEGA_OK && (!has_num_segments || (size_t) num_segments != segments_n)) {
+        set_error(&read_error, TEGA_ERROR_INVALID_INSTANCE, "Error reading segments from %s: ``num_segments'' is %zu, but the ``segments'' array contains %zu entries", filename, (size_t) num_segments, segments_n);
+    }
+
+    if(read_error.status != TEGA_OK) {
+        if(error != NULL) { *error = read_error; }
+        free(segments);
+        return empty_instance();
+    }
+
+    METRICS_TIMER_STOP(TIMER_INSTANCE_LOAD, load_start);
+
+    return (Instance) {.segments = segments, .train = train, .num_segments = segments_n, .start_speed = 0, .start_time = 0};
+}
+
+/*
+ * implementation-method
+ *
+ * Formats a float so that it reads back as the same float, and as a json real rather than
+ * an integer (older versions of read_instance required reals for the train's data).
+ */
+static const char* json_real(char* buffer, size_t buffer_sz, float value) {
+    int n = 0;
+
+    // Shortest representation which reads back exactly (9 digits always suffice)
+    for(int digits = 6; digits <= 9; digits++) {
+        n = snprintf(buffer, buffer_sz, "%.*g", digits, value);
+        if(strtof(buffer, NULL) == value) { break; }
+    }
+
+    if(n > 0 && (size_t) n + 2 < buffer_sz && strpbrk(buffer, ".eEn") == NULL) {
+        strcat(buffer, ".0");
+    }
+
+    return buffer;
+}
+
+/*
+ * api-method
+ */
+bool write_instance(const Instance* instance, const char *const filename, TegaError* error) {
+    const char* type_name = train_type_name(instance->train.type);
+
+    if(type_name == NULL) {
+        return set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "Cannot write output file %s: unknown train type %d", filename, (int) instance->train.type);
+    }
+
+    FILE* fd = fopen(filename, "w");
+
+    if(fd == NULL) {
+        return set_error(error, TEGA_ERROR_IO, "Cannot write output file: %s", filename);
+    }
+
+    const Train* t = &instance->train;
+    char b[5][32];
+
+    fprintf(fd, "{\n  \"train\": {\n");
+    fprintf(fd, "    \"type\": \"%s\",\n", type_name);
+    fprintf(fd, "    \"num_coaches\": %" PRIuFAST32 ",\n", t->num_coaches);
+    fprintf(fd, "    \"mass\": %s,\n    \"mass_per_axle\": %s,\n    \"max_acceleration\": %s,\n    \"max_braking\": %s,\n    \"length\": %s\n  },\n",
+        json_real(b[0], 32, t->mass), json_real(b[1], 32, t->mass_per_axle), json_real(b[2], 32, t->max_acceleration),
+        json_real(b[3], 32, t->max_braking), json_real(b[4], 32, t->length));
+    fprintf(fd, "  \"num_segments\": %zu,\n  \"segments\": [", instance->num_segments);
+
+    for(size_t i = 0; i < instance->num_segments; i++) {
+        const Segment* seg = &instance->segments[i];
 
-    return (Instance) {.segments = segments, .train = train, .num_segments = num_segments};
+        fprintf(fd, "%s\n    {\"id\": %" PRIuFAST32 ", \"station\": %s", (i == 0 ? "" : ","), seg->id, (seg->is_station ? "true" : "false"));
+
+        if(seg->is_station) {
+            fprintf(fd, ", \"arrival_time\": %s, \"stop_time\": %s}",
+                json_real(b[0], 32, seg->arrival_time), json_real(b[1], 32, seg->stop_time));
+            continue;
+        }
+
+        fprintf(fd, ", \"length\": %s, \"slope\": %s, \"curve\": %s, \"speed_limit\": %s",
+            json_real(b[0], 32, seg->length), json_real(b[1], 32, seg->slope),
+            json_real(b[2], 32, seg->curve), json_real(b[3], 32, seg->speed_limit));
+
+        if(seg->has_arrival_time) {
+            fprintf(fd, ", \"arrival_time\": %s", json_real(b[0], 32, seg->arrival_time));
+        }
+
+        fprintf(fd, "}");
+    }
+
+    fprintf(fd, "\n  ]\n}\n");
+
+    bool ok = !ferror(fd);
+
+    if(fclose(fd) != 0 || !ok) {
+        return set_error(error, TEGA_ERROR_IO, "Error writing output file: %s", filename);
+    }
+
+    return true;
+}
+
+/*
+ * api-method
+ */
+size_t replace_segment(Instance* instance, const Segment* segment, TegaError* error) {
+    Segment* segments = (Segment*) instance->segments;
+    size_t index = instance->num_segments;
+
+    // Ids are progressive, so they usually correspond to the index
+    if(segment->id < instance->num_segments && segments[segment->id].id == segment->id) {
+        index = segment->id;
+    } else {
+        for(size_t i = 0; i < instance->num_segments; i++) {
+            if(segments[i].id == segment->id) { index = i; break; }
+        }
+    }
+
+    if(index == instance->num_segments) {
+        set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "Cannot replace segment #%" PRIuFAST32 ": no such segment", segment->id);
+        return index;
+    }
+
+    float length_change = segment->length - segments[index].length;
+
+    segments[index] = *segment;
+    segments[index].start_x = (index == 0) ? 0 : segments[index - 1].end_x;
+    segments[index].end_x = segments[index].start_x + segments[index].length;
+
+    if(length_change != 0) {
+        for(size_t i = index + 1; i < instance->num_segments; i++) {
+            segments[i].start_x = segments[i - 1].end_x;
+            segments[i].end_x = segments[i].start_x + segments[i].length;
+        }
+    }
+
+    return index;
 }
 
 /*
  * api-method
  */
 void free_instance(Instance* instance) {
-    free((Segment*) instance->segments);
+    if(instance->mapping != NULL) {
+        munmap((void*) instance->mapping, instance->mapping_sz);
+        instance->mapping = NULL;
+        instance->mapping_sz = 0;
+    } else {
+        free((Segment*) instance->segments);
+    }
+
     instance->segments = NULL;
 }
 
@@ -8,6 +8,7 @@
 #include <stddef.h>
 #include "segment.h"
 #include "train.h"
+#include "error.h"
 
 /**
  * Represents a complete instance, with a series of segments and a train.
@@ -16,17 +17,51 @@ typedef struct Instance {
     const Segment*    segments;       // List of segments
     const Train       train;          // Train
     const size_t      num_segments;   // Number of segments in the instance
+    const float       start_speed;    // Speed of the train at the beginning of the first segment
+    const float       start_time;     // Clock at the beginning of the first segment
+    const void*       mapping;        // If not NULL, segments point into this memory-mapped file
+    size_t            mapping_sz;     // Size of the mapping
 } Instance;
 
 /**
  * Creates a new instance, reading from a json file.
  * @param filename  The json file name
- * @return          The newly created instance
+ * @param error     Filled if the file cannot be read or is not a valid instance (can be NULL)
+ * @return          The newly created instance, or one without segments on error
  */
-Instance read_instance(const char *const filename);
+Instance read_instance(const char *const filename, TegaError* error);
 
 /**
- * Frees memory for an instance.
+ * Creates a new instance, reading from a json file like read_instance. The file is
+ * memory-mapped and parsed in a single pass, writing segments directly into the instance,
+ * without building a json tree in memory. This is the reader to use for very large routes.
+ * @param filename  The json file name
+ * @param error     Filled if the file cannot be read or is not a valid instance (can be NULL)
+ * @return          The newly created instance, or one without segments on error
+ */
+Instance read_instance_streaming(const char *const filename, TegaError* error);
+
+/**
+ * Writes an instance to a json file, in the format read by read_instance.
+ * @param instance  The instance
+ * @param filename  The json file name
+ * @param error     Filled if the file cannot be written (can be NULL)
+ * @return          True if the file was written successfully
+ */
+bool write_instance(const Instance* instance, const char *const filename, TegaError* error);
+
+/**
+ * Replaces the segment with the same id as the given one, and updates the coordinates of
+ * the segments that follow it.
+ * @param instance  The instance
+ * @param segment   The new segment
+ * @param error     Filled if there is no segment with that id (can be NULL)
+ * @return          The index of the replaced segment, or num_segments on error
+ */
+size_t replace_segment(Instance* instance, const Segment* segment, TegaError* error);
+
+/**
+ * Frees memory for an instance (or unmaps it, if it was loaded from a binary file).
  * @param inst  The instance to be deleted
  */
 void free_instance(Instance* instance);
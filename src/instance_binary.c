@@ -0,0 +1,212 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#include "instance_binary.h"
+#include "metrics.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <memory.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Number of segments written at a time
+#define WRITE_BUFFER_SEGMENTS 4096
+
+/*
+ * api-method
+ */
+bool write_instance_binary(const Instance* instance, const char *const filename, TegaError* error) {
+    FILE* fd = fopen(filename, "wb");
+
+    if(fd == NULL) {
+        return set_error(error, TEGA_ERROR_IO, "Cannot write output file: %s", filename);
+    }
+
+    InstanceBinaryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INSTANCE_BINARY_MAGIC, sizeof(header.magic));
+    header.version = INSTANCE_BINARY_VERSION;
+    header.byte_order = INSTANCE_BINARY_BYTE_ORDER;
+    header.segment_size = sizeof(Segment);
+    header.train_type = (uint32_t) instance->train.type;
+    header.num_coaches = (uint32_t) instance->train.num_coaches;
+    header.mass = instance->train.mass;
+    header.mass_per_axle = instance->train.mass_per_axle;
+    header.max_acceleration = instance->train.max_acceleration;
+    header.max_braking = instance->train.max_braking;
+    header.length = instance->train.length;
+    header.num_segments = instance->num_segments;
+    header.segments_offset = ((sizeof(header) + INSTANCE_BINARY_ALIGNMENT - 1) / INSTANCE_BINARY_ALIGNMENT) * INSTANCE_BINARY_ALIGNMENT;
+
+    char padding[INSTANCE_BINARY_ALIGNMENT] = {0};
+    bool ok = fwrite(&header, sizeof(header), 1, fd) == 1 &&
+              fwrite(padding, 1, header.segments_offset - sizeof(header), fd) == header.segments_offset - sizeof(header);
+
+    // Segments are copied field by field into a zeroed buffer, so that padding bytes are 0
+    // and the same instance always gives the same file
+    Segment* buffer = calloc(WRITE_BUFFER_SEGMENTS, sizeof(*buffer));
+
+    if(buffer == NULL) {
+        fclose(fd);
+        return set_error(error, TEGA_ERROR_OUT_OF_MEMORY, "Could not allocate memory to write output file: %s", filename);
+    }
+
+    for(size_t i = 0; ok && i < instance->num_segments; i += WRITE_BUFFER_SEGMENTS) {
+        size_t n = instance->num_segments - i;
+        if(n > WRITE_BUFFER_SEGMENTS) { n = WRITE_BUFFER_SEGMENTS; }
+
+        for(size_t j = 0; j < n; j++) {
+            const Segment* src = &instance->segments[i + j];
+            Segment* dst = &buffer[j];
+
+            memset(dst, 0, sizeof(*dst));
+            dst->id = src->id;
+            dst->arrival_time = src->arrival_time;
+            dst->stop_time = src->stop_time;
+            dst->length = src->length;
+            dst->slope = src->slope;
+            dst->curve = src->curve;
+            dst->speed_limit = src->speed_limit;
+            dst->start_x = src->start_x;
+            dst->end_x = src->end_x;
+            dst->is_station = src->is_station;
+            dst->has_arrival_time = src->has_arrival_time;
+        }
+
+        ok = fwrite(buffer, sizeof(*buffer), n, fd) == n;
+    }
+
+    free(buffer);
+    ok = (fclose(fd) == 0) && ok;
+
+    if(!ok) {
+        return set_error(error, TEGA_ERROR_IO, "Error writing output file: %s", filename);
+    }
+
+    return true;
+}
+
+/*
+ * implementation-method
+ *
+ * Checks that the header describes a file which can be used on this platform.
+ */
+static bool check_header(const InstanceBinaryHeader* header, size_t file_sz, const char *const filename, TegaError* error) {
+    if(memcmp(header->magic, INSTANCE_BINARY_MAGIC, sizeof(header->magic)) != 0) {
+        return set_error(error, TEGA_ERROR_PARSE, "Error reading %s: not a binary instance file", filename);
+    }
+
+    if(header->version != INSTANCE_BINARY_VERSION) {
+        return set_error(error, TEGA_ERROR_PARSE, "Error reading %s: version %u is not supported (expected %u)", filename, header->version, INSTANCE_BINARY_VERSION);
+    }
+
+    if(header->byte_order != INSTANCE_BINARY_BYTE_ORDER || header->segment_size != sizeof(Segment)) {
+        return set_error(error, TEGA_ERROR_PARSE, "Error reading %s: the file was written on a platform with a different data layout", filename);
+    }
+
+    if(header->segments_offset % INSTANCE_BINARY_ALIGNMENT != 0 ||
+       header->segments_offset > file_sz ||
+       header->num_segments > (file_sz - header->segments_offset) / sizeof(Segment)) {
+        return set_error(error, TEGA_ERROR_PARSE, "Error reading %s: the file is truncated or corrupted", filename);
+    }
+
+    if(train_type_name((TrainType) header->train_type) == NULL) {
+        return set_error(error, TEGA_ERROR_INVALID_INSTANCE, "Error reading %s: unknown train type %u", filename, header->train_type);
+    }
+
+    return true;
+}
+
+/*
+ * implementation-method
+ *
+ * Checks the values of the train and of the segments, as the json readers do: the file
+ * may have been corrupted or edited since it was written.
+ */
+static bool check_contents(const Train* train, const Segment* segments, size_t num_segments, const char *const filename, TegaError* error) {
+    if(!is_valid_train(train)) {
+        return set_error(error, TEGA_ERROR_INVALID_INSTANCE, "Error reading train from %s: its characteristics must be positive, and the mass per axle less than the mass", filename);
+    }
+
+    for(size_t i = 0; i < num_segments; i++) {
+        if(!check_segment(&segments[i], filename, error)) { return false; }
+    }
+
+    return true;
+}
+
+/*
+ * api-method
+ */
+Instance read_instance_binary(const char *const filename, TegaError* error) {
+    METRICS_TIMER_START(load_start);
+
+    int fd = open(filename, O_RDONLY);
+
+    if(fd < 0) {
+        set_error(error, TEGA_ERROR_IO, "Cannot read input file: %s", filename);
+        return (Instance) {.segments = NULL, .num_segments = 0};
+    }
+
+    struct stat file_stat;
+
+    if(fstat(fd, &file_stat) != 0 || (size_t) file_stat.st_size < sizeof(InstanceBinaryHeader)) {
+        close(fd);
+        set_error(error, TEGA_ERROR_PARSE, "Error reading %s: not a binary instance file", filename);
+        return (Instance) {.segments = NULL, .num_segments = 0};
+    }
+
+    size_t file_sz = (size_t) file_stat.st_size;
+
+    // Private writable mapping: pages are shared with the page cache until someone changes
+    // a segment (e.g. with replace_segment), in which case only that page is copied
+    void* mapping = mmap(NULL, file_sz, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if(mapping == MAP_FAILED) {
+        set_error(error, TEGA_ERROR_IO, "Could not map input file: %s", filename);
+        return (Instance) {.segments = NULL, .num_segments = 0};
+    }
+
+    const InstanceBinaryHeader* header = mapping;
+
+    if(!check_header(header, file_sz, filename, error)) {
+        munmap(mapping, file_sz);
+        return (Instance) {.segments = NULL, .num_segments = 0};
+    }
+
+    madvise(mapping, file_sz, MADV_WILLNEED);
+
+    Train train = {
+        .type = (TrainType) header->train_type,
+        .num_coaches = header->num_coaches,
+        .mass = header->mass,
+        .mass_per_axle = header->mass_per_axle,
+        .max_acceleration = header->max_acceleration,
+        .max_braking = header->max_braking,
+        .length = header->length
+    };
+
+    const Segment* segments = (const Segment*) ((const char*) mapping + header->segments_offset);
+
+    if(!check_contents(&train, segments, header->num_segments, filename, error)) {
+        munmap(mapping, file_sz);
+        return (Instance) {.segments = NULL, .num_segments = 0};
+    }
+
+    METRICS_TIMER_STOP(TIMER_INSTANCE_LOAD, load_start);
+
+    return (Instance) {
+        .segments = segments,
+        .train = train,
+        .num_segments = header->num_segments,
+        .start_speed = 0,
+        .start_time = 0,
+        .mapping = mapping,
+        .mapping_sz = file_sz
+    };
+}
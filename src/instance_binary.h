@@ -0,0 +1,73 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#ifndef TEGA_INSTANCE_BINARY_H
+#define TEGA_INSTANCE_BINARY_H
+
+#include <stdint.h>
+#include "instance.h"
+
+/*
+ * Binary instance format.
+ *
+ * The file starts with an InstanceBinaryHeader, followed (at offset segments_offset) by the
+ * segments, stored exactly as the Segment structs in memory. The loader can therefore map
+ * the file and use the segments in place, without parsing or copying them.
+ *
+ * Since the segments are stored in the native layout, a file can only be loaded on a
+ * platform with the same endianness and the same Segment layout as the one that wrote it:
+ * the header records both, and the loader rejects incompatible files.
+ */
+#define INSTANCE_BINARY_MAGIC       "TEGAINST"
+#define INSTANCE_BINARY_VERSION     1
+
+/*
+ * Alignment of the segment array within the file [bytes].
+ */
+#define INSTANCE_BINARY_ALIGNMENT   64
+
+/*
+ * Written as a native integer, to detect files with a different byte order.
+ */
+#define INSTANCE_BINARY_BYTE_ORDER  0x01020304u
+
+/**
+ * Header of a binary instance file.
+ */
+typedef struct InstanceBinaryHeader {
+    char        magic[8];           // INSTANCE_BINARY_MAGIC, without the null terminator
+    uint32_t    version;            // INSTANCE_BINARY_VERSION
+    uint32_t    byte_order;         // INSTANCE_BINARY_BYTE_ORDER
+    uint32_t    segment_size;       // sizeof(Segment)
+    uint32_t    train_type;         // Train fields
+    uint32_t    num_coaches;
+    float       mass;
+    float       mass_per_axle;
+    float       max_acceleration;
+    float       max_braking;
+    float       length;
+    uint64_t    num_segments;       // Number of segments
+    uint64_t    segments_offset;    // Offset of the first segment from the beginning of the file
+} InstanceBinaryHeader;
+
+/**
+ * Writes an instance in the binary format.
+ * @param instance  The instance
+ * @param filename  The output file name
+ * @param error     Filled if the file cannot be written (can be NULL)
+ * @return          True on success
+ */
+bool write_instance_binary(const Instance* instance, const char *const filename, TegaError* error);
+
+/**
+ * Creates a new instance from a binary file. The file is memory-mapped and the segments of
+ * the instance point directly into the mapping, which is released by free_instance. The train
+ * and the segments are checked as the json readers check them (see check_segment).
+ * @param filename  The binary file name
+ * @param error     Filled if the file cannot be read, was written on another platform, or holds invalid values (can be NULL)
+ * @return          The newly created instance, or one without segments on error
+ */
+Instance read_instance_binary(const char *const filename, TegaError* error);
+
+#endif //TEGA_INSTANCE_BINARY_H
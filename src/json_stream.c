@@ -0,0 +1,241 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#include "json_stream.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Longest number literal we accept
+#define JSON_STREAM_MAX_NUMBER_LEN 64
+
+// Deepest nesting of objects and arrays json_stream_skip accepts, so that it cannot exhaust the stack
+#define JSON_STREAM_MAX_DEPTH 64
+
+/*
+ * implementation-method
+ */
+static void skip_whitespace(JsonStream* s) {
+    while(s->p < s->end && (*s->p == ' ' || *s->p == '\n' || *s->p == '\r' || *s->p == '\t')) {
+        s->p++;
+    }
+}
+
+/*
+ * implementation-method
+ *
+ * Skips whitespace and returns the next character, or 0 at the end of the buffer.
+ */
+static char peek(JsonStream* s) {
+    skip_whitespace(s);
+    return (s->p < s->end) ? *s->p : '\0';
+}
+
+/*
+ * implementation-method
+ */
+static bool fail(JsonStream* s) {
+    s->error = true;
+    return false;
+}
+
+/*
+ * implementation-method
+ */
+static bool expect(JsonStream* s, char c) {
+    if(s->error || peek(s) != c) { return fail(s); }
+    s->p++;
+    return true;
+}
+
+/*
+ * implementation-method
+ */
+static bool expect_literal(JsonStream* s, const char* literal) {
+    size_t len = strlen(literal);
+
+    if((size_t) (s->end - s->p) < len || memcmp(s->p, literal, len) != 0) { return fail(s); }
+    s->p += len;
+    return true;
+}
+
+/*
+ * api-method
+ */
+JsonStream json_stream(const char* buffer, size_t length) {
+    return (JsonStream) {.begin = buffer, .p = buffer, .end = buffer + length, .error = false};
+}
+
+/*
+ * api-method
+ */
+bool json_stream_object_begin(JsonStream* s) {
+    return expect(s, '{');
+}
+
+/*
+ * api-method
+ */
+bool json_stream_next_key(JsonStream* s, const char** key, size_t* key_len) {
+    if(s->error) { return false; }
+
+    char c = peek(s);
+
+    if(c == '}') { s->p++; return false; }
+
+    // All keys but the first are preceded by a comma
+    if(c == ',') { s->p++; }
+
+    if(!json_stream_string(s, key, key_len)) { return false; }
+    return expect(s, ':');
+}
+
+/*
+ * api-method
+ */
+bool json_stream_array_begin(JsonStream* s) {
+    return expect(s, '[');
+}
+
+/*
+ * api-method
+ */
+bool json_stream_next_element(JsonStream* s) {
+    if(s->error) { return false; }
+
+    char c = peek(s);
+
+    if(c == ']') { s->p++; return false; }
+    if(c == ',') { s->p++; }
+
+    return peek(s) != '\0' || fail(s);
+}
+
+/*
+ * api-method
+ */
+bool json_stream_string(JsonStream* s, const char** str, size_t* str_len) {
+    if(!expect(s, '"')) { return false; }
+
+    const char* start = s->p;
+
+    while(s->p < s->end && *s->p != '"') {
+        if(*s->p == '\\') { s->p++; }
+        s->p++;
+    }
+
+    if(s->p >= s->end) { return fail(s); }
+
+    *str = start;
+    *str_len = (size_t) (s->p - start);
+    s->p++;
+
+    return true;
+}
+
+/*
+ * api-method
+ */
+bool json_stream_number(JsonStream* s, double* value, bool* is_integer) {
+    if(s->error) { return false; }
+
+    char c = peek(s);
+
+    if(c != '-' && (c < '0' || c > '9')) { return fail(s); }
+
+    // Copy the literal, as the buffer is not null-terminated
+    char literal[JSON_STREAM_MAX_NUMBER_LEN + 1];
+    size_t len = 0;
+
+    *is_integer = true;
+
+    while(s->p < s->end && strchr("+-0123456789.eE", *s->p) != NULL) {
+        if(len == JSON_STREAM_MAX_NUMBER_LEN) { return fail(s); }
+        if(*s->p == '.' || *s->p == 'e' || *s->p == 'E') { *is_integer = false; }
+        literal[len++] = *s->p++;
+    }
+
+    literal[len] = '\0';
+
+    char* literal_end;
+    *value = strtod(literal, &literal_end);
+
+    return (literal_end == literal + len) || fail(s);
+}
+
+/*
+ * api-method
+ */
+bool json_stream_boolean(JsonStream* s, bool* value) {
+    if(s->error) { return false; }
+
+    char c = peek(s);
+
+    if(c == 't') { *value = true; return expect_literal(s, "true"); }
+    if(c == 'f') { *value = false; return expect_literal(s, "false"); }
+
+    return fail(s);
+}
+
+/*
+ * implementation-method
+ *
+ * Skips the next value, which is nested in depth objects or arrays.
+ */
+static bool skip_value(JsonStream* s, size_t depth) {
+    if(s->error) { return false; }
+
+    const char* str;
+    size_t len;
+    double number;
+    bool flag;
+
+    switch(peek(s)) {
+        case '{':
+            if(depth >= JSON_STREAM_MAX_DEPTH) { return fail(s); }
+            json_stream_object_begin(s);
+            while(json_stream_next_key(s, &str, &len)) { skip_value(s, depth + 1); }
+            return !s->error;
+        case '[':
+            if(depth >= JSON_STREAM_MAX_DEPTH) { return fail(s); }
+            json_stream_array_begin(s);
+            while(json_stream_next_element(s)) { skip_value(s, depth + 1); }
+            return !s->error;
+        case '"':
+            return json_stream_string(s, &str, &len);
+        case 't':
+        case 'f':
+            return json_stream_boolean(s, &flag);
+        case 'n':
+            return expect_literal(s, "null");
+        default:
+            return json_stream_number(s, &number, &flag);
+    }
+}
+
+/*
+ * api-method
+ */
+bool json_stream_skip(JsonStream* s) {
+    return skip_value(s, 0);
+}
+
+/*
+ * api-method
+ */
+bool json_stream_equals(const char* str, size_t str_len, const char* expected) {
+    return strlen(expected) == str_len && memcmp(str, expected, str_len) == 0;
+}
+
+/*
+ * api-method
+ */
+int json_stream_line(const JsonStream* s) {
+    int line = 1;
+
+    for(const char* c = s->begin; c < s->p && c < s->end; c++) {
+        if(*c == '\n') { line++; }
+    }
+
+    return line;
+}
@@ -0,0 +1,66 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#ifndef TEGA_JSON_STREAM_H
+#define TEGA_JSON_STREAM_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * Minimal pull parser for json documents held in memory (e.g. a memory-mapped file).
+ * It never builds a tree: the caller walks the document value by value, and strings are
+ * returned as slices of the original buffer, without unescaping.
+ * It rejects malformed values, but is lenient about separators (e.g. a missing comma).
+ */
+typedef struct JsonStream {
+    const char* begin;  // Beginning of the buffer
+    const char* p;      // Current position
+    const char* end;    // End of the buffer
+    bool        error;  // Set when the document is malformed; all further calls fail
+} JsonStream;
+
+/**
+ * Starts parsing a buffer.
+ * @param buffer    The json document (not necessarily null-terminated)
+ * @param length    Its length
+ * @return          The parser
+ */
+JsonStream json_stream(const char* buffer, size_t length);
+
+/*
+ * Objects and arrays.
+ * json_stream_next_key reads the next key of an object, returning false (and consuming the
+ * closing brace) when there are no more; json_stream_next_element does the same for arrays.
+ */
+bool json_stream_object_begin(JsonStream* s);
+bool json_stream_next_key(JsonStream* s, const char** key, size_t* key_len);
+bool json_stream_array_begin(JsonStream* s);
+bool json_stream_next_element(JsonStream* s);
+
+/*
+ * Scalar values. They return false if the next value has a different type.
+ * json_stream_number also tells whether the number was written as an integer.
+ */
+bool json_stream_string(JsonStream* s, const char** str, size_t* str_len);
+bool json_stream_number(JsonStream* s, double* value, bool* is_integer);
+bool json_stream_boolean(JsonStream* s, bool* value);
+
+/**
+ * Skips the next value, whatever its type. Values with objects or arrays nested more than
+ * 64 levels deep are rejected as malformed.
+ */
+bool json_stream_skip(JsonStream* s);
+
+/**
+ * Tells whether a slice returned by the parser is equal to a (null-terminated) string.
+ */
+bool json_stream_equals(const char* str, size_t str_len, const char* expected);
+
+/**
+ * Line of the current position, for error messages.
+ */
+int json_stream_line(const JsonStream* s);
+
+#endif //TEGA_JSON_STREAM_H
@@ -0,0 +1,89 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#include "local_search.h"
+#include "metrics.h"
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+
+/*
+ * implementation-method
+ *
+ * Moves one switching point by one step, if the result keeps x1 <= x2 <= x3 <= steps.
+ * Returns false if the move is not possible.
+ */
+static bool move_switching_point(SwitchingPoints* sp, size_t steps, size_t which, bool forward) {
+    size_t* x[3] = {&sp->x1, &sp->x2, &sp->x3};
+    size_t lower = (which == 0) ? 0 : *x[which - 1];
+    size_t upper = (which == 2) ? steps : *x[which + 1];
+
+    if(forward) {
+        if(*x[which] >= upper) { return false; }
+        (*x[which])++;
+    } else {
+        if(*x[which] <= lower) { return false; }
+        (*x[which])--;
+    }
+
+    return true;
+}
+
+/*
+ * api-method
+ */
+size_t local_search(const Instance* instance, const Lookup* lt, Individual* individual, const LocalSearchParams* params, unsigned int* seed) {
+    assert(individual->num_segments == instance->num_segments);
+
+    size_t simulated = 0;
+    size_t failed = 0;
+
+    if(individual->num_segments == 0) { return 0; }
+
+    while(simulated < params->max_simulated_segments && failed < params->max_failed_moves) {
+        size_t segment = (size_t) rand_r(seed) % individual->num_segments;
+        size_t steps = get_distance_steps(&instance->segments[segment]);
+
+        // Stations and very short segments have no switching points to move
+        if(steps == 0) { failed++; continue; }
+
+        size_t which = (size_t) rand_r(seed) % 3;
+        bool forward = rand_r(seed) % 2;
+        SwitchingPoints old = individual->genes[segment];
+
+        if(!move_switching_point(&individual->genes[segment], steps, which, forward)) { failed++; continue; }
+
+        double old_cost = individual->cost;
+        simulated += reevaluate_segment(instance, lt, individual, segment);
+
+        if(individual->cost < old_cost) {
+            failed = 0;
+        } else {
+            individual->genes[segment] = old;
+            simulated += reevaluate_segment(instance, lt, individual, segment);
+            failed++;
+        }
+    }
+
+    return simulated;
+}
+
+/*
+ * api-method
+ */
+size_t local_search_elites(const Instance* instance, const Lookup* lt, Individual* elites, size_t num_elites, const LocalSearchParams* params, unsigned int seed) {
+    size_t simulated = 0;
+
+    METRICS_TIMER_START(local_search_start);
+
+    #pragma omp parallel for schedule(dynamic) reduction(+:simulated)
+    for(size_t i = 0; i < num_elites; i++) {
+        unsigned int individual_seed = seed + (unsigned int) i;
+        simulated += local_search(instance, lt, &elites[i], params, &individual_seed);
+    }
+
+    METRICS_TIMER_STOP(TIMER_LOCAL_SEARCH, local_search_start);
+
+    return simulated;
+}
@@ -0,0 +1,54 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#ifndef TEGA_LOCAL_SEARCH_H
+#define TEGA_LOCAL_SEARCH_H
+
+#include <stddef.h>
+#include "instance.h"
+#include "lookup.h"
+#include "individual.h"
+
+/**
+ * Parameters of the hill-climbing local search used to polish elite individuals.
+ */
+typedef struct LocalSearchParams {
+    /**
+     * Maximum number of segment simulations (calls to run_on_segment) spent on each
+     * individual. This keeps the local search from dominating the wall time of a generation.
+     */
+    size_t max_simulated_segments;
+
+    /**
+     * The search stops early after this many consecutive moves that do not improve.
+     */
+    size_t max_failed_moves;
+} LocalSearchParams;
+
+/**
+ * Improves an individual by moving one switching point of one segment by one distance step
+ * at a time, keeping the move if it reduces the cost. Only the touched segment and its
+ * downstream effects are re-simulated.
+ * @param instance      The instance
+ * @param lt            The look-up tables
+ * @param individual    The (evaluated) individual to improve
+ * @param params        Local search parameters
+ * @param seed          Seed for rand_r
+ * @return              The number of segment simulations spent
+ */
+size_t local_search(const Instance* instance, const Lookup* lt, Individual* individual, const LocalSearchParams* params, unsigned int* seed);
+
+/**
+ * Applies the local search to a set of elite individuals, in parallel.
+ * @param instance      The instance
+ * @param lt            The look-up tables
+ * @param elites        The (evaluated) individuals to improve
+ * @param num_elites    Number of individuals
+ * @param params        Local search parameters
+ * @param seed          Base seed: each individual uses its own stream derived from it
+ * @return              The total number of segment simulations spent
+ */
+size_t local_search_elites(const Instance* instance, const Lookup* lt, Individual* elites, size_t num_elites, const LocalSearchParams* params, unsigned int seed);
+
+#endif //TEGA_LOCAL_SEARCH_H
@@ -6,18 +6,41 @@
 #include <stdio.h>
 #include <math.h>
 #include <assert.h>
+#include <memory.h>
 #include "lookup.h"
 #include "davis.h"
 #include "eps.h"
+#include "metrics.h"
+
+/*
+ * implementation-method
+ *
+ * Reads a distance between two cells of a coarse table, interpolating linearly. If one of the
+ * two cells is not available, neither is the distance.
+ */
+static float coarse_table_element(const Lookup* l, const float* row, size_t distance) {
+    // The stride is a power of 2
+    unsigned int shift = (unsigned int) __builtin_ctzl(l->distance_stride);
+    size_t k = distance >> shift;
+    size_t remainder = distance & (l->distance_stride - 1);
+
+    if(remainder == 0) { return row[k]; }
+    if(k + 1 >= l->lengths_n || row[k] < 0 || row[k + 1] < 0) { return -1.0f; }
+
+    float fraction = (float) remainder / (float) l->distance_stride;
+
+    return row[k] + fraction * (row[k + 1] - row[k]);
+}
 
 /*
  * implementation-method
  */
 static float lookup_table_element(const Lookup* l, const float* table, size_t segment, size_t speed, size_t distance) {
-    return *(   table +
-                segment * l->speeds_n * l->lengths_n +
-                speed * l->lengths_n +
-                distance);
+    const float* row = table + segment * l->speeds_n * l->lengths_n + speed * l->lengths_n;
+
+    if(l->distance_stride > 1) { return coarse_table_element(l, row, distance); }
+
+    return row[distance];
 }
 
 /*
@@ -41,42 +64,280 @@ static void free_lookup_tables_for_driving_stlye(LookupForDrivingStyle* lt) {
 
 /*
  * implementation-method
+ *
+ * Sets cells from, ..., to - 1 of a table to -1 (not available).
  */
-static LookupForDrivingStyle empty_lookup_table_for_driving_style(size_t segments_n, size_t speeds_n, size_t lengths_n) {
-    LookupForDrivingStyle lt;
+static void reset_cells_for_driving_style(LookupForDrivingStyle* lt, size_t from, size_t to) {
+    for(size_t i = from; i < to; i++) {
+        lt->speed[i] = -1.0f;
+        lt->time[i] = -1.0f;
+        lt->position[i] = -1.0f;
+    }
+}
 
-    lt.speed = malloc(segments_n * speeds_n * lengths_n * sizeof(*lt.speed));
-    lt.time = malloc(segments_n * speeds_n * lengths_n * sizeof(*lt.time));
-    lt.position = malloc(segments_n * speeds_n * lengths_n * sizeof(*lt.position));
+/*
+ * implementation-method
+ *
+ * Gives uninitialised memory for a table, from the arena if there is one.
+ */
+static float* allocate_table(size_t cells, Arena* arena) {
+    return arena != NULL ? arena_alloc(arena, cells * sizeof(float)) : malloc(cells * sizeof(float));
+}
 
-    if(lt.speed == NULL || lt.time == NULL || lt.position == NULL) {
-        printf("Could not allocate memory for look-up tables\n");
-        exit(EXIT_FAILURE);
+/*
+ * implementation-method
+ */
+static uint32_t* allocate_reach_table(size_t cells) {
+    return malloc(cells * sizeof(uint32_t));
+}
+
+/*
+ * implementation-method
+ *
+ * Allocates a table without initialising it. Returns false, leaving nothing allocated, if
+ * there is not enough memory.
+ */
+static bool allocate_lookup_table_for_driving_style(LookupForDrivingStyle* lt, size_t cells, Arena* arena) {
+    lt->speed = allocate_table(cells, arena);
+    lt->time = allocate_table(cells, arena);
+    lt->position = allocate_table(cells, arena);
+
+    if(cells > 0 && (lt->speed == NULL || lt->time == NULL || lt->position == NULL)) {
+        if(arena == NULL) { free_lookup_tables_for_driving_stlye(lt); }
+        memset(lt, 0, sizeof(*lt));
+        return false;
     }
 
-    for(size_t i = 0; i < segments_n * speeds_n * lengths_n; i++) {
-        lt.speed[i] = -1.0f;
-        lt.time[i] = -1.0f;
-        lt.position[i] = -1.0f;
+    return true;
+}
+
+/*
+ * implementation-method
+ *
+ * Allocates a table with all cells at -1. Returns false, leaving nothing allocated, if there
+ * is not enough memory.
+ */
+static bool empty_lookup_table_for_driving_style(LookupForDrivingStyle* lt, size_t segments_n, size_t speeds_n, size_t lengths_n) {
+    size_t slab_sz = speeds_n * lengths_n;
+
+    if(!allocate_lookup_table_for_driving_style(lt, segments_n * slab_sz, NULL)) { return false; }
+
+    #pragma omp parallel for schedule(static)
+    for(size_t i = 0; i < segments_n; i++) {
+        reset_cells_for_driving_style(lt, i * slab_sz, (i + 1) * slab_sz);
     }
 
-    return lt;
+    return true;
 }
 
 /*
  * implementation-method
+ *
+ * Sets all entries of a segment's slab to -1 (not available).
  */
-static void generate_lookup_table_for_acceleration(const Instance* instance, Lookup* l, LookupForDrivingStyle* lt, float train_acceleration) {
-    for(size_t i = 0; i < instance->num_segments; i++) {
+static void reset_segment_for_driving_style(Lookup* l, LookupForDrivingStyle* lt, size_t segment) {
+    size_t slab_sz = l->speeds_n * l->lengths_n;
+
+    reset_cells_for_driving_style(lt, segment * slab_sz, (segment + 1) * slab_sz);
+}
+
+/*
+ * implementation-method
+ *
+ * Copies the content of a table into a new, larger one, slab by slab. The original table is
+ * left untouched, so that nothing changes if a later allocation fails.
+ */
+static bool resize_lookup_table_for_driving_style(const LookupForDrivingStyle* lt, LookupForDrivingStyle* resized, size_t segments_n, size_t old_speeds_n, size_t old_lengths_n, size_t speeds_n, size_t lengths_n) {
+    if(!empty_lookup_table_for_driving_style(resized, segments_n, speeds_n, lengths_n)) {
+        return false;
+    }
+
+    for(size_t i = 0; i < segments_n; i++) {
+        for(size_t j = 0; j < old_speeds_n; j++) {
+            size_t from = i * old_speeds_n * old_lengths_n + j * old_lengths_n;
+            size_t to = i * speeds_n * lengths_n + j * lengths_n;
+
+            memcpy(resized->speed + to, lt->speed + from, old_lengths_n * sizeof(*lt->speed));
+            memcpy(resized->time + to, lt->time + from, old_lengths_n * sizeof(*lt->time));
+            memcpy(resized->position + to, lt->position + from, old_lengths_n * sizeof(*lt->position));
+        }
+    }
+
+    return true;
+}
+
+/*
+ * implementation-method
+ *
+ * The track terms of the resistance on a segment, computed beforehand if tracks is not NULL.
+ */
+static TrackResistance segment_track(const Instance* instance, const TrackResistance* tracks, size_t segment) {
+    return (tracks != NULL) ? tracks[segment] : track_resistance(&instance->segments[segment]);
+}
+
+/*
+ * implementation-method
+ *
+ * Fills the cruising energy table for segments first_segment, ..., last_segment - 1.
+ */
+static void generate_cruising_energy_table(const Instance* instance, Lookup* l, const TrackResistance* tracks, size_t first_segment, size_t last_segment) {
+    #pragma omp parallel for schedule(static) if(last_segment - first_segment > 1)
+    for(size_t i = first_segment; i < last_segment; i++) {
+        TrackResistance track = segment_track(instance, tracks, i);
+
+        for(size_t j = 0; j < l->speeds_n; j++) {
+            l->cruising_energy[i * l->speeds_n + j] = - resistance_on_track(&instance->train, &track, j * SPEED_STEP);
+        }
+    }
+}
+
+/*
+ * implementation-method
+ *
+ * Fills the reach tables for segments first_segment, ..., last_segment - 1, from the final
+ * speed tables. Each row is read once: as the distance grows, every target speed the row
+ * reaches for the first time gets that distance. Targets are reached in increasing order
+ * when accelerating, and in decreasing order when braking, even where the speed does not
+ * change monotonically (e.g. accelerating on a steep climb).
+ */
+static void generate_reach_tables(Lookup* l, size_t first_segment, size_t last_segment) {
+    size_t slab_sz = l->speeds_n * l->lengths_n;
+
+    #pragma omp parallel for schedule(static) if(last_segment - first_segment > 1)
+    for(size_t i = first_segment; i < last_segment; i++) {
+        for(size_t j = 0; j < l->speeds_n; j++) {
+            const float* accelerating = l->max_acceleration.speed + i * slab_sz + j * l->lengths_n;
+            const float* braking = l->max_braking.speed + i * slab_sz + j * l->lengths_n;
+            uint32_t* acceleration_reach = l->acceleration_reach + (i * l->speeds_n + j) * l->speeds_n;
+            uint32_t* braking_reach = l->braking_reach + (i * l->speeds_n + j) * l->speeds_n;
+            size_t up = 0, down = l->speeds_n;
+
+            for(size_t k = 0; k < l->lengths_n; k++) {
+                if(accelerating[k] >= 0) {
+                    while(up < l->speeds_n && up * SPEED_STEP <= accelerating[k]) { acceleration_reach[up++] = (uint32_t) k; }
+                }
+
+                if(braking[k] >= 0) {
+                    while(down > 0 && (down - 1) * SPEED_STEP >= braking[k]) { braking_reach[--down] = (uint32_t) k; }
+                }
+            }
+
+            for(size_t h = up; h < l->speeds_n; h++) { acceleration_reach[h] = UNREACHED_DISTANCE; }
+            for(size_t h = 0; h < down; h++) { braking_reach[h] = UNREACHED_DISTANCE; }
+        }
+    }
+}
+
+/*
+ * implementation-method
+ *
+ * Moves the train forward until target_position, with the resistance frozen at its value at
+ * the current speed. If the train stops before, the motion ends where it stops.
+ * Returns false if the train would go backwards.
+ */
+static bool advance_motion(const Train* train, const TrackResistance* track, float train_acceleration, float target_position, Motion* m) {
+    float acc = train_acceleration + resistance_on_track(train, track, m->speed);
+    float final_time;
+    float final_speed;
+    float final_position;
+    float distance_to_run = target_position - m->position;
+
+    if(acc > ACCELERATION_EPS) {
+        // Uniformly accelerated linear motion
+
+        float running_time = (sqrtf(powf(m->speed, 2) + 2 * acc * distance_to_run) - m->speed) / acc;
+        final_time = m->time + running_time;
+        final_speed = m->speed + acc * running_time;
+        final_position = m->position + distance_to_run; // Move for the whole length requested
+
+        assert(running_time >= 0);
+        assert(final_position > target_position - DISTANCE_EPS);
+    } else if(acc > - ACCELERATION_EPS) {
+        // Uniform linear motion
+
+        if(m->speed > SPEED_EPS) {
+            // Moving forward with uniform linear motion (constant velocity)
+            final_time = m->time + distance_to_run / m->speed;
+            final_speed = m->speed;
+            final_position = m->position + distance_to_run; // Move for the whole length requested
+
+            assert(final_position > target_position - DISTANCE_EPS);
+        } else if(m->speed > -SPEED_EPS) {
+            // Standing still: impossible to run the length required
+            final_time = m->time;
+            final_speed = m->speed;
+            final_position = m->position;
+        } else {
+            // Going backwards: we really don't want this to happen!
+            return false;
+        }
+    } else {
+        // Uniformly decelerated motion
+
+        float running_length = - powf(m->speed, 2) / (2 * acc);
+
+        if(running_length >= distance_to_run) {
+            // The train will not stop before it runs all the length distance_to_run
+
+            float running_time = (sqrtf(powf(m->speed, 2) + 2 * acc * distance_to_run) - m->speed) / acc;
+            final_time = m->time + running_time;
+            final_speed = m->speed + acc * running_time;
+            final_position = m->position + distance_to_run;
+
+            assert(running_time >= 0);
+            assert(final_speed >= 0);
+            assert(final_position > target_position - DISTANCE_EPS);
+        } else {
+            // The train will stop before being able to run all the length distance_to_run
+
+            final_time = m->time - m->speed / acc;
+            final_speed = 0;
+            final_position = m->position - powf(m->speed, 2) / (2 * acc);
+
+            assert(final_time >= m->time);
+            assert(final_position >= m->position);
+            assert(final_position < target_position);
+        }
+    }
+
+    // Traction energy: the train's (specific) force times the distance actually run
+    if(train_acceleration > 0) { m->energy += train_acceleration * (final_position - m->position); }
+
+    m->speed = final_speed;
+    m->time = final_time;
+    m->position = final_position;
+
+    return true;
+}
+
+/*
+ * implementation-method
+ *
+ * Fills the slabs of segments first_segment, ..., last_segment - 1, cells the segment does not
+ * reach included (at -1).
+ * Segments are independent, and each slab is written entirely by one thread: on freshly
+ * allocated tables, this is where the pages are first touched, so they are faulted in
+ * parallel (and on NUMA machines, spread over the nodes of the generating threads).
+ */
+static void generate_lookup_table_for_acceleration(const Instance* instance, Lookup* l, LookupForDrivingStyle* lt, float train_acceleration, const TrackResistance* tracks, size_t first_segment, size_t last_segment) {
+    size_t stride = l->distance_stride;
+
+    #pragma omp parallel for schedule(static) if(last_segment - first_segment > 1)
+    for(size_t i = first_segment; i < last_segment; i++) {
         size_t j = 0;
+        TrackResistance track = segment_track(instance, tracks, i);
+
+        // Coarse tables keep one cell every stride steps of the same integration, and their last
+        // cell can lie past the end of the segment, so that any distance on it is between two cells
+        size_t last_step = (get_distance_steps(&instance->segments[i]) + stride - 1) / stride * stride;
+
+        reset_segment_for_driving_style(l, lt, i);
 
         while(j * SPEED_STEP <= instance->segments[i].speed_limit) {
-            float cur_speed = j * SPEED_STEP;
-            float cur_time = 0;
-            float cur_position = 0;
+            Motion m = {.time = 0, .speed = j * SPEED_STEP, .position = 0, .energy = 0};
 
             // When distance = 0, everything is 0
-            set_lookup_table_element(l, lt->speed, i, j, 0, cur_speed);
+            set_lookup_table_element(l, lt->speed, i, j, 0, m.speed);
             set_lookup_table_element(l, lt->time, i, j, 0, 0);
             set_lookup_table_element(l, lt->position, i, j, 0, 0);
 
@@ -85,107 +346,25 @@ static void generate_lookup_table_for_acceleration(const Instance* instance, Loo
 
             size_t k = 1;
 
-            while(k * DISTANCE_STEP <= instance->segments[i].length) {
-                float acc = train_acceleration + resistance(&instance->train, &instance->segments[i], cur_speed);
-                float final_time;
-                float final_speed;
-                float final_position;
-                float distance_to_run = k * DISTANCE_STEP - cur_position;
-
-                if(acc > ACCELERATION_EPS) {
-                    // Uniformly accelerated linear motion
-
-                    float running_time = (sqrtf(powf(cur_speed, 2) + 2 * acc * distance_to_run) - cur_speed) / (2 * acc);
-                    final_time = cur_time + running_time;
-                    final_speed = cur_speed + acc * running_time;
-                    final_position = cur_position + distance_to_run; // Move for the whole length requested
-
-                    // printf("Uniformly accelerated linear motion\n");
-                    // printf("i: %zu, j: %zu, k: %zu\n", i, j, k);
-                    // printf("Cur time: %.2f, cur speed: %.2f, cur position: %.2f\n", cur_time, cur_speed, cur_position);
-                    // printf("Fin time: %.2f, fin speed: %.2f, fin position: %.2f\n", final_time, final_speed, final_position);
-                    // printf("Train acc: %.2f, Total acc: %.2f\n", train_acceleration, acc);
-                    assert(running_time >= 0);
-                    assert(final_position > cur_position + distance_to_run - DISTANCE_EPS);
-                    assert(final_position > k * DISTANCE_STEP - DISTANCE_EPS);
-                } else if(acc > - ACCELERATION_EPS) {
-                    // Uniform linear motion
-
-                    if(cur_speed > SPEED_EPS) {
-                        // Moving forward with uniform linear motion (constant velocity)
-                        final_time = cur_time + distance_to_run / cur_speed;
-                        final_speed = cur_speed;
-                        final_position = cur_position + distance_to_run; // Move for the whole length requested
-
-                        // printf("Uniform linear motion\n");
-                        // printf("i: %zu, j: %zu, k: %zu\n", i, j, k);
-                        // printf("Cur time: %.2f, cur speed: %.2f, cur position: %.2f\n", cur_time, cur_speed, cur_position);
-                        // printf("Fin time: %.2f, fin speed: %.2f, fin position: %.2f\n", final_time, final_speed, final_position);
-                        // printf("Train acc: %.2f, Total acc: %.2f\n", train_acceleration, acc);
-                        assert(final_position > cur_position + distance_to_run - DISTANCE_EPS);
-                        assert(final_position > k * DISTANCE_STEP - DISTANCE_EPS);
-                    } else if(cur_speed > -SPEED_EPS) {
-                        // Standing still: impossible to run the length required
-                        final_time = cur_time;
-                        final_speed = cur_speed;
-                        final_position = cur_position;
-                    } else {
-                        // Going backwards: we really don't want this to happen!
-                        set_lookup_table_element(l, lt->speed, i, j, k, -1.0f);
-                        set_lookup_table_element(l, lt->time, i, j, k, -1.0f);
-                        set_lookup_table_element(l, lt->position, i, j, k, -1.0f);
-
-                        k++; continue;
-                    }
-                } else {
-                    // Uniformly decelerated motion
-
-                    float running_length = - powf(cur_speed, 2) / (2 * acc);
-
-                    if(running_length >= DISTANCE_STEP) {
-                        // The train will not stop before it runs all the length distance_to_run
-
-                        float running_time = (sqrtf(powf(cur_speed, 2) + 2 * acc * distance_to_run) - cur_speed) / (2 * acc);
-                        final_time = cur_time + running_time;
-                        final_speed = cur_speed + acc * running_time;
-                        final_position = cur_position + distance_to_run;
-
-                        // printf("Uniformly decelerated linear motion (full distance)\n");
-                        // printf("i: %zu, j: %zu, k: %zu\n", i, j, k);
-                        // printf("Cur time: %.2f, cur speed: %.2f, cur position: %.2f\n", cur_time, cur_speed, cur_position);
-                        // printf("Fin time: %.2f, fin speed: %.2f, fin position: %.2f\n", final_time, final_speed, final_position);
-                        // printf("Train acc: %.2f, Total acc: %.2f\n", train_acceleration, acc);
-                        assert(running_time >= 0);
-                        assert(final_speed >= 0);
-                        assert(final_position > cur_position + distance_to_run - DISTANCE_EPS);
-                        assert(final_position > k * DISTANCE_STEP - DISTANCE_EPS);
-                    } else {
-                        // The train will stop before being able to run all the length distance_to_run
-
-                        final_time = cur_time - cur_speed / acc;
-                        final_speed = 0;
-                        final_position = cur_position - powf(cur_speed, 2) / (2 * acc);
-
-                        // printf("Uniformly decelerated linear motion (early stop)\n");
-                        // printf("i: %zu, j: %zu, k: %zu\n", i, j, k);
-                        // printf("Cur time: %.2f, cur speed: %.2f, cur position: %.2f\n", cur_time, cur_speed, cur_position);
-                        // printf("Fin time: %.2f, fin speed: %.2f, fin position: %.2f\n", final_time, final_speed, final_position);
-                        // printf("Train acc: %.2f, Total acc: %.2f\n", train_acceleration, acc);
-                        assert(final_time >= cur_time);
-                        assert(final_position >= cur_position);
-                        assert(final_position < cur_position + distance_to_run);
-                        assert(final_position < cur_position + DISTANCE_STEP);
-                    }
+            while(stride > 1 ? k <= last_step : k * DISTANCE_STEP <= instance->segments[i].length) {
+                bool valid = advance_motion(&instance->train, &track, train_acceleration, k * DISTANCE_STEP, &m);
+                size_t cell = k / stride;
+
+                if(k % stride != 0) {
+                    k++; continue;
                 }
 
-                // Updated current values
-                cur_speed = final_speed;
-                cur_time = final_time;
-                cur_position = final_position;
+                if(!valid) {
+                    set_lookup_table_element(l, lt->speed, i, j, cell, -1.0f);
+                    set_lookup_table_element(l, lt->time, i, j, cell, -1.0f);
+                    set_lookup_table_element(l, lt->position, i, j, cell, -1.0f);
+
+                    k++; continue;
+                }
 
-                set_lookup_table_element(l, lt->speed, i, j, k, cur_speed);
-                set_lookup_table_element(l, lt->time, i, j, k, cur_time);
-                set_lookup_table_element(l, lt->position, i, j, k, cur_position);
+                set_lookup_table_element(l, lt->speed, i, j, cell, m.speed);
+                set_lookup_table_element(l, lt->time, i, j, cell, m.time);
+                set_lookup_table_element(l, lt->position, i, j, cell, m.position);
 
                 k++;
             }
@@ -195,60 +374,464 @@ static void generate_lookup_table_for_acceleration(const Instance* instance, Loo
     }
 }
 
+/*
+ * api-method
+ */
+bool integrate_motion(const Train* train, const Segment* segment, float train_acceleration, float entry_speed, float distance, float step, Motion* motion) {
+    assert(step > 0);
+
+    TrackResistance track = track_resistance(segment);
+
+    *motion = (Motion) {.time = 0, .speed = entry_speed, .position = 0, .energy = 0};
+
+    for(size_t k = 1; k * step <= distance + DISTANCE_EPS; k++) {
+        if(!advance_motion(train, &track, train_acceleration, k * step, motion)) { return false; }
+    }
+
+    return true;
+}
+
 /*
  * api-method
  */
 void free_lookup_tables(Lookup* lookup) {
+    // Reach tables are never in an arena (see add_reach_tables)
+    free(lookup->acceleration_reach); lookup->acceleration_reach = NULL;
+    free(lookup->braking_reach); lookup->braking_reach = NULL;
+
+    if(lookup->in_arena) {
+        memset(lookup, 0, sizeof(*lookup));
+        return;
+    }
+
     free_lookup_tables_for_driving_stlye(&lookup->max_acceleration);
     free_lookup_tables_for_driving_stlye(&lookup->coasting);
     free_lookup_tables_for_driving_stlye(&lookup->max_braking);
+    free(lookup->cruising_energy); lookup->cruising_energy = NULL;
 }
 
 /*
- * api-method
+ * implementation-method
+ *
+ * Gives the dimensions of the tables for an instance, and the segments that set them.
  */
-Lookup generate_lookup_tables(const Instance* instance) {
-    Lookup l;
-
+static void table_dimensions(const Instance* instance, size_t* speeds_n, size_t* lengths_n, size_t* fastest, size_t* longest) {
     float max_speed = 0;
     float max_length = 0;
 
+    *fastest = 0;
+    *longest = 0;
+
     for(size_t i = 0; i < instance->num_segments; i++) {
-        if(instance->segments[i].speed_limit > max_speed) { max_speed = instance->segments[i].speed_limit; }
-        if(instance->segments[i].length > max_length) { max_length = instance->segments[i].length; }
+        if(instance->segments[i].speed_limit > max_speed) { max_speed = instance->segments[i].speed_limit; *fastest = i; }
+        if(instance->segments[i].length > max_length) { max_length = instance->segments[i].length; *longest = i; }
     }
 
-    size_t speeds_n = (size_t) (max_speed / SPEED_STEP + 1);
-    size_t lengths_n = (size_t) (max_length / DISTANCE_STEP + 1);
+    *speeds_n = (size_t) (max_speed / SPEED_STEP + 1);
+    *lengths_n = (size_t) (max_length / DISTANCE_STEP + 1);
+}
+
+/*
+ * implementation-method
+ *
+ * Number of cells of a coarse table row covering lengths_n distances.
+ */
+static size_t coarse_lengths_n(size_t lengths_n, size_t stride) {
+    return (lengths_n - 1 + stride - 1) / stride + 1;
+}
+
+/*
+ * implementation-method
+ *
+ * Memory taken by tables of the given dimensions, with or without reach tables.
+ */
+static LookupMemory memory_for_dimensions(size_t segments_n, size_t speeds_n, size_t lengths_n, bool with_reach) {
+    size_t slab_bytes = segments_n * speeds_n * lengths_n * sizeof(float);
+    LookupMemory memory = {
+        .speeds_n = speeds_n,
+        .lengths_n = lengths_n,
+        .max_acceleration_bytes = 3 * slab_bytes,
+        .coasting_bytes = 3 * slab_bytes,
+        .max_braking_bytes = 3 * slab_bytes,
+        .cruising_energy_bytes = segments_n * speeds_n * sizeof(float),
+        .reach_bytes = with_reach ? 2 * segments_n * speeds_n * speeds_n * sizeof(uint32_t) : 0
+    };
+
+    memory.total_bytes = memory.max_acceleration_bytes + memory.coasting_bytes + memory.max_braking_bytes + memory.cruising_energy_bytes + memory.reach_bytes;
+
+    return memory;
+}
+
+/*
+ * api-method
+ */
+LookupMemory estimate_lookup_memory(const Instance* instance) {
+    size_t speeds_n, lengths_n, fastest, longest;
+
+    table_dimensions(instance, &speeds_n, &lengths_n, &fastest, &longest);
+
+    return memory_for_dimensions(instance->num_segments, speeds_n, lengths_n, false);
+}
+
+/*
+ * implementation-method
+ *
+ * Allocates the tables, from the arena if there is one, and fills them. The tables are not
+ * initialised beforehand, since generating a slab writes all of its cells.
+ */
+static Lookup generate_lookup_tables_with_allocator(const Instance* instance, size_t distance_stride, const TrackResistance* tracks, Arena* arena, TegaError* error) {
+    Lookup l;
+
+    memset(&l, 0, sizeof(l));
+
+    size_t speeds_n, lengths_n, fastest, longest;
+    size_t cells;
+
+    table_dimensions(instance, &speeds_n, &lengths_n, &fastest, &longest);
+    lengths_n = coarse_lengths_n(lengths_n, distance_stride);
+    cells = instance->num_segments * speeds_n * lengths_n;
 
     l.speeds_n = speeds_n;
     l.lengths_n = lengths_n;
-    l.max_acceleration = empty_lookup_table_for_driving_style(instance->num_segments, speeds_n, lengths_n);
-    l.coasting = empty_lookup_table_for_driving_style(instance->num_segments, speeds_n, lengths_n);
-    l.max_braking = empty_lookup_table_for_driving_style(instance->num_segments, speeds_n, lengths_n);
+    l.distance_stride = distance_stride;
+    l.cruising_energy = allocate_table(instance->num_segments * speeds_n, arena);
+    l.in_arena = arena != NULL;
+
+    if(!allocate_lookup_table_for_driving_style(&l.max_acceleration, cells, arena) ||
+       !allocate_lookup_table_for_driving_style(&l.coasting, cells, arena) ||
+       !allocate_lookup_table_for_driving_style(&l.max_braking, cells, arena) ||
+       (l.cruising_energy == NULL && instance->num_segments > 0)) {
+        free_lookup_tables(&l);
+        memset(&l, 0, sizeof(l));
+        set_error(error, TEGA_ERROR_OUT_OF_MEMORY, "Could not allocate memory for look-up tables (%zu speeds, %zu lengths)", speeds_n, lengths_n);
+        return l;
+    }
 
+    METRICS_TIMER_START(style_start);
     generate_lookup_table_for_acceleration(
         instance,
         &l,
         &l.max_acceleration,
-        instance->train.max_acceleration
+        instance->train.max_acceleration,
+        tracks,
+        0,
+        instance->num_segments
     );
+    METRICS_TIMER_STOP(TIMER_TABLE_MAX_ACCELERATION, style_start);
+
+    METRICS_TIMER_START(coasting_start);
     generate_lookup_table_for_acceleration(
         instance,
         &l,
         &l.coasting,
-        0
+        0,
+        tracks,
+        0,
+        instance->num_segments
     );
+    METRICS_TIMER_STOP(TIMER_TABLE_COASTING, coasting_start);
+
+    METRICS_TIMER_START(braking_start);
     generate_lookup_table_for_acceleration(
         instance,
         &l,
         &l.max_braking,
-        - instance->train.max_braking
+        - instance->train.max_braking,
+        tracks,
+        0,
+        instance->num_segments
     );
+    METRICS_TIMER_STOP(TIMER_TABLE_MAX_BRAKING, braking_start);
+
+    METRICS_TIMER_START(cruising_start);
+    generate_cruising_energy_table(instance, &l, tracks, 0, instance->num_segments);
+    METRICS_TIMER_STOP(TIMER_TABLE_CRUISING_ENERGY, cruising_start);
 
     return l;
 }
 
+/*
+ * api-method
+ */
+Lookup generate_lookup_tables(const Instance* instance, TegaError* error) {
+    return generate_lookup_tables_with_allocator(instance, 1, NULL, NULL, error);
+}
+
+/*
+ * api-method
+ */
+Lookup generate_lookup_tables_in_arena(const Instance* instance, Arena* arena, TegaError* error) {
+    return generate_lookup_tables_with_allocator(instance, 1, NULL, arena, error);
+}
+
+/*
+ * api-method
+ */
+Lookup generate_lookup_tables_on_track(const Instance* instance, const TrackResistance* tracks, TegaError* error) {
+    return generate_lookup_tables_with_allocator(instance, 1, tracks, NULL, error);
+}
+
+/*
+ * api-method
+ */
+bool add_reach_tables(const Instance* instance, Lookup* l, TegaError* error) {
+    if(l->acceleration_reach != NULL) { return true; }
+
+    if(l->distance_stride != 1) {
+        return set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "Reach tables need full tables, not tables with a distance stride of %zu", l->distance_stride);
+    }
+
+    size_t reach_cells = instance->num_segments * l->speeds_n * l->speeds_n;
+
+    if(reach_cells == 0) { return true; }
+
+    l->acceleration_reach = allocate_reach_table(reach_cells);
+    l->braking_reach = allocate_reach_table(reach_cells);
+
+    if(l->acceleration_reach == NULL || l->braking_reach == NULL) {
+        free(l->acceleration_reach); l->acceleration_reach = NULL;
+        free(l->braking_reach); l->braking_reach = NULL;
+
+        return set_error(error, TEGA_ERROR_OUT_OF_MEMORY, "Could not allocate memory for the reach tables (%zu speeds)", l->speeds_n);
+    }
+
+    METRICS_TIMER_START(reach_start);
+    generate_reach_tables(l, 0, instance->num_segments);
+    METRICS_TIMER_STOP(TIMER_TABLE_REACH, reach_start);
+
+    return true;
+}
+
+/*
+ * api-method
+ */
+Lookup generate_coarse_lookup_tables(const Instance* instance, size_t distance_stride, TegaError* error) {
+    if(distance_stride == 0 || (distance_stride & (distance_stride - 1)) != 0) {
+        Lookup l;
+        memset(&l, 0, sizeof(l));
+        set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "The distance stride of coarse tables must be a power of 2, not %zu", distance_stride);
+        return l;
+    }
+
+    return generate_lookup_tables_with_allocator(instance, distance_stride, NULL, NULL, error);
+}
+
+/*
+ * api-method
+ */
+void generate_lookup_table_for_driving_style(const Instance* instance, Lookup* l, LookupForDrivingStyle* lt, float train_acceleration) {
+    generate_lookup_table_for_acceleration(instance, l, lt, train_acceleration, NULL, 0, instance->num_segments);
+}
+
+/*
+ * api-method
+ */
+bool update_lookup_tables(Instance* instance, Lookup* l, const Segment* changed, size_t num_changed, TegaError* error) {
+    size_t speeds_n = l->speeds_n;
+    size_t lengths_n = l->lengths_n;
+
+    for(size_t c = 0; c < num_changed; c++) {
+        size_t segment_speeds_n = (size_t) (changed[c].speed_limit / SPEED_STEP + 1);
+        size_t segment_lengths_n = coarse_lengths_n((size_t) (changed[c].length / DISTANCE_STEP + 1), l->distance_stride);
+
+        if(segment_speeds_n > speeds_n) { speeds_n = segment_speeds_n; }
+        if(segment_lengths_n > lengths_n) { lengths_n = segment_lengths_n; }
+    }
+
+    // Tables never shrink, so that the slabs of unchanged segments stay valid
+    if(speeds_n > l->speeds_n || lengths_n > l->lengths_n) {
+        LookupForDrivingStyle* styles[3] = {&l->max_acceleration, &l->coasting, &l->max_braking};
+        LookupForDrivingStyle resized[3];
+        size_t resized_n = 0;
+        float* cruising_energy = malloc(instance->num_segments * speeds_n * sizeof(*cruising_energy));
+        bool with_reach = (l->acceleration_reach != NULL);
+        uint32_t* acceleration_reach = with_reach ? allocate_reach_table(instance->num_segments * speeds_n * speeds_n) : NULL;
+        uint32_t* braking_reach = with_reach ? allocate_reach_table(instance->num_segments * speeds_n * speeds_n) : NULL;
+
+        while(cruising_energy != NULL && (!with_reach || (acceleration_reach != NULL && braking_reach != NULL)) && resized_n < 3 &&
+              resize_lookup_table_for_driving_style(styles[resized_n], &resized[resized_n], instance->num_segments, l->speeds_n, l->lengths_n, speeds_n, lengths_n)) {
+            resized_n++;
+        }
+
+        // If an allocation fails, the tables are left as they were
+        if(resized_n < 3) {
+            for(size_t s = 0; s < resized_n; s++) { free_lookup_tables_for_driving_stlye(&resized[s]); }
+            free(cruising_energy);
+            free(acceleration_reach);
+            free(braking_reach);
+
+            return set_error(error, TEGA_ERROR_OUT_OF_MEMORY, "Could not allocate memory for look-up tables (%zu speeds, %zu lengths)", speeds_n, lengths_n);
+        }
+
+        // Tables in an arena are released with it
+        for(size_t s = 0; s < 3; s++) {
+            if(!l->in_arena) { free_lookup_tables_for_driving_stlye(styles[s]); }
+            *styles[s] = resized[s];
+        }
+
+        if(!l->in_arena) { free(l->cruising_energy); }
+
+        free(l->acceleration_reach);
+        free(l->braking_reach);
+
+        l->in_arena = false;
+
+        l->cruising_energy = cruising_energy;
+        l->acceleration_reach = acceleration_reach;
+        l->braking_reach = braking_reach;
+        l->speeds_n = speeds_n;
+        l->lengths_n = lengths_n;
+
+        // The cruising and reach tables are cheap: rebuild them with the new row length
+        generate_cruising_energy_table(instance, l, NULL, 0, instance->num_segments);
+        if(with_reach) { generate_reach_tables(l, 0, instance->num_segments); }
+    }
+
+    for(size_t c = 0; c < num_changed; c++) {
+        size_t i = replace_segment(instance, &changed[c], error);
+
+        if(i == instance->num_segments) { return false; }
+
+        generate_lookup_table_for_acceleration(instance, l, &l->max_acceleration, instance->train.max_acceleration, NULL, i, i + 1);
+        generate_lookup_table_for_acceleration(instance, l, &l->coasting, 0, NULL, i, i + 1);
+        generate_lookup_table_for_acceleration(instance, l, &l->max_braking, - instance->train.max_braking, NULL, i, i + 1);
+        generate_cruising_energy_table(instance, l, NULL, i, i + 1);
+        if(l->acceleration_reach != NULL) { generate_reach_tables(l, i, i + 1); }
+    }
+
+    return true;
+}
+
+/*
+ * api-method
+ */
+Lookup lookup_view(const Lookup* l, size_t first_segment) {
+    size_t offset = first_segment * l->speeds_n * l->lengths_n;
+    Lookup view = *l;
+
+    view.max_acceleration.time += offset;
+    view.max_acceleration.speed += offset;
+    view.max_acceleration.position += offset;
+    view.coasting.time += offset;
+    view.coasting.speed += offset;
+    view.coasting.position += offset;
+    view.max_braking.time += offset;
+    view.max_braking.speed += offset;
+    view.max_braking.position += offset;
+    view.cruising_energy += first_segment * l->speeds_n;
+
+    if(l->acceleration_reach != NULL) {
+        view.acceleration_reach += first_segment * l->speeds_n * l->speeds_n;
+        view.braking_reach += first_segment * l->speeds_n * l->speeds_n;
+    }
+
+    return view;
+}
+
+/*
+ * implementation-method
+ *
+ * Counts the cells of a segment's slab which are not available.
+ */
+static size_t unavailable_cells(const Lookup* l, const LookupForDrivingStyle* lt, size_t segment) {
+    size_t slab_sz = l->speeds_n * l->lengths_n;
+    size_t count = 0;
+
+    for(size_t i = segment * slab_sz; i < (segment + 1) * slab_sz; i++) {
+        if(lt->time[i] < 0) { count++; }
+    }
+
+    return count;
+}
+
+/*
+ * implementation-method
+ */
+static int compare_segment_fill(const void* a, const void* b) {
+    size_t wa = ((const SegmentFill*) a)->wasted_bytes;
+    size_t wb = ((const SegmentFill*) b)->wasted_bytes;
+
+    return (wa < wb) - (wa > wb);
+}
+
+/*
+ * api-method
+ */
+LookupFillReport lookup_fill_report(const Instance* instance, const Lookup* l, TegaError* error) {
+    size_t speeds_n, lengths_n;
+    LookupFillReport report = {
+        .memory = memory_for_dimensions(instance->num_segments, l->speeds_n, l->lengths_n, l->acceleration_reach != NULL),
+        .segments = malloc(instance->num_segments * sizeof(*report.segments)),
+        .num_segments = instance->num_segments,
+        .unavailable_ratio = 0,
+        .wasted_bytes = 0
+    };
+
+    if(report.segments == NULL) {
+        set_error(error, TEGA_ERROR_OUT_OF_MEMORY, "Could not allocate memory for the fill report");
+        report.num_segments = 0;
+        return report;
+    }
+
+    table_dimensions(instance, &speeds_n, &lengths_n, &report.fastest_segment, &report.longest_segment);
+
+    size_t slab_sz = l->speeds_n * l->lengths_n;
+    size_t total_unavailable = 0;
+
+    #pragma omp parallel for reduction(+:total_unavailable)
+    for(size_t i = 0; i < instance->num_segments; i++) {
+        size_t ma = unavailable_cells(l, &l->max_acceleration, i);
+        size_t co = unavailable_cells(l, &l->coasting, i);
+        size_t mb = unavailable_cells(l, &l->max_braking, i);
+
+        report.segments[i] = (SegmentFill) {
+            .segment = i,
+            .unavailable_ratio = (float) (ma + co + mb) / (float) (3 * slab_sz),
+            .wasted_bytes = 3 * (ma + co + mb) * sizeof(float)
+        };
+
+        total_unavailable += ma + co + mb;
+    }
+
+    for(size_t i = 0; i < instance->num_segments; i++) {
+        report.wasted_bytes += report.segments[i].wasted_bytes;
+    }
+
+    report.unavailable_ratio = (instance->num_segments == 0) ? 0 : (float) total_unavailable / (float) (3 * slab_sz * instance->num_segments);
+
+    qsort(report.segments, report.num_segments, sizeof(*report.segments), compare_segment_fill);
+
+    return report;
+}
+
+/*
+ * api-method
+ */
+void print_lookup_fill_report(const LookupFillReport* report, size_t num_worst) {
+    const LookupMemory* m = &report->memory;
+
+    printf("=== LOOKUP TABLES (%zu segments x %zu speeds x %zu lengths) ===\n", report->num_segments, m->speeds_n, m->lengths_n);
+    printf("\tMax acceleration: %.2f MB\n", m->max_acceleration_bytes / 1e6);
+    printf("\tCoasting: %.2f MB\n", m->coasting_bytes / 1e6);
+    printf("\tMax braking: %.2f MB\n", m->max_braking_bytes / 1e6);
+    printf("\tCruising energy: %.2f MB\n", m->cruising_energy_bytes / 1e6);
+    printf("\tReach: %.2f MB\n", m->reach_bytes / 1e6);
+    printf("\tTotal: %.2f MB, of which %.2f MB (%.1f%% of the cells) not available\n", m->total_bytes / 1e6, report->wasted_bytes / 1e6, 100 * report->unavailable_ratio);
+    printf("\tSpeeds set by segment %zu, lengths set by segment %zu\n", report->fastest_segment, report->longest_segment);
+
+    for(size_t i = 0; i < num_worst && i < report->num_segments; i++) {
+        const SegmentFill* f = &report->segments[i];
+        printf("\tSegment %zu: %.1f%% not available, %.2f kB\n", f->segment, 100 * f->unavailable_ratio, f->wasted_bytes / 1e3);
+    }
+}
+
+/*
+ * api-method
+ */
+void free_lookup_fill_report(LookupFillReport* report) {
+    free(report->segments); report->segments = NULL;
+}
+
 /*
  * api-methods
  */
@@ -288,6 +871,23 @@ float get_cruising_speed(size_t speed, size_t distance) {
 float get_cruising_position(size_t speed, size_t distance) {
     return DISTANCE_STEP * distance;
 }
+float get_cruising_energy_per_metre(const Lookup* l, size_t segment, size_t speed) {
+    return l->cruising_energy[segment * l->speeds_n + speed];
+}
+size_t get_max_acceleration_reach(const Lookup* l, size_t segment, size_t speed, size_t target_speed) {
+    assert(l->acceleration_reach != NULL && speed < l->speeds_n && target_speed < l->speeds_n);
+    return l->acceleration_reach[(segment * l->speeds_n + speed) * l->speeds_n + target_speed];
+}
+size_t get_max_braking_reach(const Lookup* l, size_t segment, size_t speed, size_t target_speed) {
+    assert(l->braking_reach != NULL && speed < l->speeds_n && target_speed < l->speeds_n);
+    return l->braking_reach[(segment * l->speeds_n + speed) * l->speeds_n + target_speed];
+}
+size_t get_speed_index(float speed) {
+    return (size_t) (speed / SPEED_STEP);
+}
+size_t get_distance_steps(const Segment* segment) {
+    return (size_t) (segment->length / DISTANCE_STEP);
+}
 
 /*
  * api-method
@@ -5,7 +5,10 @@
 #ifndef TEGA_LOOKUP_H
 #define TEGA_LOOKUP_H
 
+#include <stdint.h>
 #include "instance.h"
+#include "arena.h"
+#include "davis.h"
 
 // Discretisation step for speeds [m/s]
 #define SPEED_STEP  5.0f
@@ -13,6 +16,9 @@
 // Discretisation step for distances [m]
 #define DISTANCE_STEP 50.0f
 
+// Distance index given by the reach tables when a speed is never reached on the segment
+#define UNREACHED_DISTANCE UINT32_MAX
+
 /**
  * Lookup table for a particular driving style (max acceleration, coasting, max braking).
  */
@@ -50,6 +56,13 @@ typedef struct Lookup {
      */
     size_t lengths_n;
 
+    /**
+     * Fine distance steps per cell along the third dimension: 1 for the tables used by the
+     * solver, more for coarse tables (see generate_coarse_lookup_tables). The accessors always
+     * take distances in fine steps.
+     */
+    size_t distance_stride;
+
     /**
      * Maximum Acceleration Driving Style.
      *
@@ -65,6 +78,9 @@ typedef struct Lookup {
      * The final position will always correspond to the end of the run (k * DISTANCE_STEP).
      * We assume that when applying maximum acceleration, the train is always able to move
      * forward.
+     *
+     * There is no energy table: the traction energy per unit of mass spent is the train's
+     * maximum acceleration times the final position.
      */
     LookupForDrivingStyle max_acceleration;
 
@@ -104,8 +120,88 @@ typedef struct Lookup {
      * reaches velocity = 0).
      */
     LookupForDrivingStyle max_braking;
+
+    /**
+     * Cruising energy table.
+     *
+     * Given a segment i and a speed v = j * SPEED_STEP, cruising_energy[i][j] gives the traction
+     * energy per metre [J/(kg m)] needed to keep the speed constant, i.e. the opposite of the
+     * resistance. A negative value means that the train would have to brake (and therefore
+     * spends no traction energy) to keep the speed.
+     */
+    float* cruising_energy;
+
+    /**
+     * Reach tables, the inverse of the final speed tables of max acceleration and max braking.
+     * They are NULL unless add_reach_tables builds them, which only full tables allow.
+     *
+     * Given a segment i, an entry speed v = j * SPEED_STEP, and a target speed u = h * SPEED_STEP,
+     * acceleration_reach[i][j][h] gives the least distance index k such that
+     * max_acceleration.speed[i][j][k] >= u: accelerating from v, the train reaches u after
+     * k * DISTANCE_STEP. Likewise, braking_reach[i][j][h] gives the least k such that
+     * max_braking.speed[i][j][k] <= u: braking from v, the train is down to u after
+     * k * DISTANCE_STEP, so it must start braking k steps before the point where the speed
+     * must be u. A cell is UNREACHED_DISTANCE if the segment is too short, or if the row is
+     * not available.
+     */
+    uint32_t* acceleration_reach;
+    uint32_t* braking_reach;
+
+    /**
+     * Set when the tables were placed in an arena by generate_lookup_tables_in_arena: they are
+     * released with the arena, and free_lookup_tables leaves them alone.
+     */
+    bool in_arena;
 } Lookup;
 
+/**
+ * State of the train running on a segment with a fixed driving style, from the start of the run.
+ */
+typedef struct Motion {
+    float time;         // Running time [s]
+    float speed;        // Current speed [m/s]
+    float position;     // Distance run [m]
+    float energy;       // Traction energy spent [J/kg]
+} Motion;
+
+/**
+ * Memory taken by the lookup tables.
+ */
+typedef struct LookupMemory {
+    size_t  speeds_n;               // Second dimension of the tables
+    size_t  lengths_n;              // Third dimension of the tables
+    size_t  max_acceleration_bytes; // Time, speed, and position tables
+    size_t  coasting_bytes;         // Time, speed, and position tables
+    size_t  max_braking_bytes;      // Time, speed, and position tables
+    size_t  cruising_energy_bytes;  // Cruising energy table
+    size_t  reach_bytes;            // Acceleration and braking reach tables, if built
+    size_t  total_bytes;            // All of the above
+} LookupMemory;
+
+/**
+ * How much of a segment's slabs is left at -1 (not available).
+ */
+typedef struct SegmentFill {
+    size_t  segment;                // Segment index
+    float   unavailable_ratio;      // Fraction of the segment's cells at -1, over the three styles
+    size_t  wasted_bytes;           // Memory taken by those cells
+} SegmentFill;
+
+/**
+ * Report on the memory used by built lookup tables, and on how much of it is wasted.
+ * Since all slabs are as large as needed by the longest and by the fastest segment, most of
+ * the waste usually comes from padding the slabs of the other segments.
+ */
+typedef struct LookupFillReport {
+    LookupMemory    memory;             // Memory of the tables
+    SegmentFill*    segments;           // One entry per segment, by decreasing wasted memory
+    size_t          num_segments;       // Number of segments
+    float           unavailable_ratio;  // Fraction of all cells at -1
+    size_t          wasted_bytes;       // Memory taken by those cells
+    size_t          longest_segment;    // Segment setting lengths_n
+    size_t          fastest_segment;    // Segment setting speeds_n
+} LookupFillReport;
+
 /*
  * All the following methods access a specific element of a 3D flattened lookup table.
  * Notice that the values should be >= 0; if a value < 0 is obtained, this will mean that
@@ -128,16 +224,163 @@ float get_max_braking_position(const Lookup* l, size_t segment, size_t speed, si
 float get_cruising_time(size_t speed, size_t distance);
 float get_cruising_speed(size_t speed, size_t distance);
 float get_cruising_position(size_t speed, size_t distance);
+float get_cruising_energy_per_metre(const Lookup* l, size_t segment, size_t speed);
+
+/*
+ * Target-speed queries on the reach tables, which must be built (see add_reach_tables): the
+ * distance index at which max acceleration from a speed index reaches a target speed index,
+ * and at which max braking brings it down to the target, or UNREACHED_DISTANCE.
+ */
+size_t get_max_acceleration_reach(const Lookup* l, size_t segment, size_t speed, size_t target_speed);
+size_t get_max_braking_reach(const Lookup* l, size_t segment, size_t speed, size_t target_speed);
+
+/*
+ * Discretisation helpers: the index of the table row containing a given speed, and the
+ * largest distance index available for a segment.
+ */
+size_t get_speed_index(float speed);
+size_t get_distance_steps(const Segment* segment);
+
+/**
+ * Integrates the motion of the train exactly as the tables do: the distance is run in steps,
+ * and within a step the resistance is frozen at its value at the start of the step. The
+ * tables hold this integration for each entry speed multiple of SPEED_STEP and each
+ * distance multiple of DISTANCE_STEP = step.
+ * @param train                 The train
+ * @param segment               The segment
+ * @param train_acceleration    The acceleration applied by the train
+ * @param entry_speed           The initial speed [m/s]
+ * @param distance              The distance to run [m], rounded down to a multiple of step
+ * @param step                  The integration step [m]
+ * @param motion                The final state; if the train stops, position < distance
+ * @return                      False if the train would go backwards (a -1 cell in the tables)
+ */
+bool integrate_motion(const Train* train, const Segment* segment, float train_acceleration, float entry_speed, float distance, float step, Motion* motion);
+
+/**
+ * Predicts the memory generate_lookup_tables will allocate for an instance, without
+ * allocating anything.
+ * @param instance  The instance
+ * @return          The memory estimate
+ */
+LookupMemory estimate_lookup_memory(const Instance* instance);
 
 /**
  * Initialises the lookup tables
  * @param instance  The instance we are solving
- * @return          The lookup tables
+ * @param error     Filled if there is not enough memory for the tables (can be NULL)
+ * @return          The lookup tables, or empty tables on error
+ */
+Lookup generate_lookup_tables(const Instance* instance, TegaError* error);
+
+/**
+ * Initialises the lookup tables like generate_lookup_tables, but places all of them in an
+ * arena, which must have room for estimate_lookup_memory(instance).total_bytes plus the
+ * alignment of each table (see arena_block_size).
+ * @param instance  The instance we are solving
+ * @param arena     The arena
+ * @param error     Filled if the arena is too small (can be NULL)
+ * @return          The lookup tables, or empty tables on error
+ */
+Lookup generate_lookup_tables_in_arena(const Instance* instance, Arena* arena, TegaError* error);
+
+/**
+ * Initialises the lookup tables like generate_lookup_tables, with the track terms of the
+ * resistance on each segment computed beforehand, so that trains running on the same route
+ * can share them (see run_train_sweep). The result is the same.
+ * @param instance  The instance we are solving
+ * @param tracks    The track terms of each segment (see track_resistance)
+ * @param error     Filled if there is not enough memory for the tables (can be NULL)
+ * @return          The lookup tables, or empty tables on error
+ */
+Lookup generate_lookup_tables_on_track(const Instance* instance, const TrackResistance* tracks, TegaError* error);
+
+/**
+ * Builds the reach tables of full lookup tables, for target-speed queries (see Lookup). They
+ * take 2 * S * V^2 * 4 bytes for S segments and V speeds, and the optimiser does not use
+ * them, so no generate function builds them. They are always allocated on the heap, even for
+ * tables in an arena, and update_lookup_tables keeps them up to date. Nothing is done if
+ * the tables already have them.
+ * @param instance  The instance of the tables
+ * @param l         The lookup tables, which must not be coarse
+ * @param error     Filled if the tables are coarse or there is not enough memory (can be NULL)
+ * @return          True iff the reach tables are available
+ */
+bool add_reach_tables(const Instance* instance, Lookup* l, TegaError* error);
+
+/**
+ * Initialises coarse lookup tables, holding one distance every distance_stride steps, and
+ * so about distance_stride times smaller. They are read with the same accessors and the same
+ * (fine) indices as the full tables: a distance between two cells is interpolated linearly.
+ * They give approximate costs, cheap to compute because the tables stay in cache, for
+ * screening candidate solutions (see GeneticParams). They have no reach tables.
+ * @param instance          The instance we are solving
+ * @param distance_stride   Fine distance steps per cell, a power of 2 (1 gives the full tables)
+ * @param error             Filled if the stride is not a power of 2 or there is not enough memory (can be NULL)
+ * @return                  The lookup tables, or empty tables on error
+ */
+Lookup generate_coarse_lookup_tables(const Instance* instance, size_t distance_stride, TegaError* error);
+
+/**
+ * (Re-)generates the table of one driving style, for all segments. This is what
+ * generate_lookup_tables does for each style; it is exposed to measure styles separately.
+ * @param instance              The instance
+ * @param l                     The lookup tables, already allocated
+ * @param lt                    The table of the driving style, within l
+ * @param train_acceleration    The acceleration applied by the train in this driving style
+ */
+void generate_lookup_table_for_driving_style(const Instance* instance, Lookup* l, LookupForDrivingStyle* lt, float train_acceleration);
+
+/**
+ * Updates the instance with a list of changed segments (e.g. after a temporary speed
+ * restriction) and regenerates only their slabs in the lookup tables. If a changed segment
+ * needs larger tables, they are resized, but the content of the other slabs is kept.
+ * Views obtained with lookup_view are invalidated by a resize, and tables in an arena move
+ * to the heap (they are then freed by free_lookup_tables). If the resize fails, nothing
+ * changes; if a segment id is unknown, the segments before it are still applied.
+ * @param instance      The instance
+ * @param l             The lookup tables
+ * @param changed       The changed segments, identified by their id
+ * @param num_changed   Number of changed segments
+ * @param error         Filled on failure (can be NULL)
+ * @return              True if all the segments were updated
+ */
+bool update_lookup_tables(Instance* instance, Lookup* l, const Segment* changed, size_t num_changed, TegaError* error);
+
+/**
+ * Gives a view of existing lookup tables that starts at a given segment, so that they can be
+ * used with an instance made of the segments from that one onwards. The view shares memory
+ * with the original tables and must not be freed.
+ * @param l             The lookup tables
+ * @param first_segment The segment that becomes segment 0 in the view
+ * @return              The view
+ */
+Lookup lookup_view(const Lookup* l, size_t first_segment);
+
+/**
+ * Measures the memory used by built lookup tables and the fraction of it left at -1.
+ * @param instance  The instance
+ * @param l         The lookup tables
+ * @param error     Filled if there is not enough memory for the report (can be NULL)
+ * @return          The report (to be freed with free_lookup_fill_report)
+ */
+LookupFillReport lookup_fill_report(const Instance* instance, const Lookup* l, TegaError* error);
+
+/**
+ * Prints a fill report, with the segments wasting most memory.
+ * @param report    The report
+ * @param num_worst Number of segments to list
+ */
+void print_lookup_fill_report(const LookupFillReport* report, size_t num_worst);
+
+/**
+ * Frees the memory used by a fill report.
+ * @param report    The report
  */
-Lookup generate_lookup_tables(const Instance* instance);
+void free_lookup_fill_report(LookupFillReport* report);
 
 /**
- * Frees the memory used by the lookup table
+ * Frees the memory used by the lookup table (tables in an arena are only forgotten)
  * @param lookup
  */
 void free_lookup_tables(Lookup* lookup);
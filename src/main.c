@@ -1,17 +1,250 @@
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "instance.h"
 #include "lookup.h"
+#include "genetic.h"
+#include "preprocessing.h"
+#include "metrics.h"
+#include "solution_cache.h"
+#include "pareto.h"
+#include "trace.h"
+#include "profile_writer.h"
 
-int main() {
-    Instance inst = read_instance("../data/test.json");
-    Lookup l = generate_lookup_tables(&inst);
+/**
+ * Command line options.
+ */
+typedef struct TegaOptions {
+    const char*     instance_file;      // The instance
+    bool            pareto;             // Trade energy off against punctuality, with NSGA-II
+    bool            merge;              // Merge runs of equivalent segments (see PreprocessingParams)
+    float           max_segment_length; // Split longer segments, and merge up to this length [m] (0 for no limit of its own)
+    size_t          screening_stride;   // If not 0, screen children on coarse tables with this stride
+    float           promotion_ratio;    // Fraction of the screened children evaluated on the full tables
+    const char*     solution_cache;     // If not NULL, reuse and save solutions in this directory
+    const char*     profile_file;       // If not NULL, the driving profile of the solution is written here
+    ProfileFormat   profile_format;     // Format of the profile
+    const char*     evaluation_trace;   // If not NULL, record every segment evaluation here
+    const char*     metrics_report;     // If not NULL, write the metrics here at exit
+    const char*     metrics_samples;    // If not NULL, sample the metrics here periodically
+    double          metrics_interval;   // Time between two metrics samples [s]
+} TegaOptions;
+
+/*
+ * The library never terminates the process: the executable does, on the first error.
+ */
+static void exit_on_error(const TegaError* error) {
+    if(error->status != TEGA_OK) {
+        fprintf(stderr, "%s\n", error->message);
+        stop_metrics_sampling();
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s [--instance file.json] [--pareto] [--no-merge] [--max-segment-length m] [--screening-stride N] [--promotion-ratio x] [--solution-cache dir] "
+                    "[--profile file] [--profile-format csv|binary] [--evaluation-trace file] [--metrics-report file] "
+                    "[--metrics-samples file] [--metrics-interval s]\n", program);
+    fprintf(stderr, "  --instance          Instance to solve (default ../data/test.json)\n");
+    fprintf(stderr, "  --pareto            Optimise energy and punctuality as separate objectives, and print the Pareto front\n");
+    fprintf(stderr, "  --no-merge          Keep equivalent adjacent segments apart\n");
+    fprintf(stderr, "  --max-segment-length  Split longer segments, and merge segments up to this length [m] (default: the longest segment)\n");
+    fprintf(stderr, "  --screening-stride  Screen children on coarse tables with this distance stride (a power of 2)\n");
+    fprintf(stderr, "  --promotion-ratio   Fraction of the screened children evaluated on the full tables (default 0.25)\n");
+    fprintf(stderr, "  --solution-cache    Reuse solutions from, and save them to, this directory\n");
+    fprintf(stderr, "  --profile           Write the driving profile of the solution (of each one on the Pareto front) to file\n");
+    fprintf(stderr, "  --profile-format    Format of the driving profile (default csv)\n");
+    fprintf(stderr, "  --evaluation-trace  Record every segment evaluation, for tega_replay (needs a build with TEGA_TRACE)\n");
+    fprintf(stderr, "  --metrics-report    Write the metrics to file at exit (needs a build with TEGA_METRICS for the hot paths)\n");
+    fprintf(stderr, "  --metrics-samples   Append the metrics to file every --metrics-interval seconds (default 1)\n");
+    exit(EXIT_FAILURE);
+}
+
+static TegaOptions parse_options(int argc, char** argv) {
+    TegaOptions options = {
+        .instance_file = "../data/test.json",
+        .pareto = false,
+        .merge = default_preprocessing_params().merge,
+        .max_segment_length = default_preprocessing_params().max_segment_length,
+        .screening_stride = 0,
+        .promotion_ratio = default_genetic_params().promotion_ratio,
+        .solution_cache = NULL,
+        .profile_file = NULL,
+        .profile_format = PROFILE_CSV,
+        .evaluation_trace = NULL,
+        .metrics_report = NULL,
+        .metrics_samples = NULL,
+        .metrics_interval = 1.0
+    };
+
+    for(int i = 1; i < argc; i++) {
+        bool has_value = (i + 1 < argc);
+
+        if(strcmp(argv[i], "--instance") == 0 && has_value) {
+            options.instance_file = argv[++i];
+        } else if(strcmp(argv[i], "--pareto") == 0) {
+            options.pareto = true;
+        } else if(strcmp(argv[i], "--no-merge") == 0) {
+            options.merge = false;
+        } else if(strcmp(argv[i], "--max-segment-length") == 0 && has_value) {
+            options.max_segment_length = (float) atof(argv[++i]);
+        } else if(strcmp(argv[i], "--screening-stride") == 0 && has_value) {
+            options.screening_stride = (size_t) strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--promotion-ratio") == 0 && has_value) {
+            options.promotion_ratio = (float) atof(argv[++i]);
+        } else if(strcmp(argv[i], "--solution-cache") == 0 && has_value) {
+            options.solution_cache = argv[++i];
+        } else if(strcmp(argv[i], "--profile") == 0 && has_value) {
+            options.profile_file = argv[++i];
+        } else if(strcmp(argv[i], "--profile-format") == 0 && has_value && strcmp(argv[i + 1], "csv") == 0) {
+            options.profile_format = PROFILE_CSV; i++;
+        } else if(strcmp(argv[i], "--profile-format") == 0 && has_value && strcmp(argv[i + 1], "binary") == 0) {
+            options.profile_format = PROFILE_BINARY; i++;
+        } else if(strcmp(argv[i], "--evaluation-trace") == 0 && has_value) {
+            options.evaluation_trace = argv[++i];
+        } else if(strcmp(argv[i], "--metrics-report") == 0 && has_value) {
+            options.metrics_report = argv[++i];
+        } else if(strcmp(argv[i], "--metrics-samples") == 0 && has_value) {
+            options.metrics_samples = argv[++i];
+        } else if(strcmp(argv[i], "--metrics-interval") == 0 && has_value) {
+            options.metrics_interval = atof(argv[++i]);
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    return options;
+}
+
+/*
+ * Streams the driving profiles of the individuals to the profile file, numbering them from 0.
+ */
+static void write_profiles(const TegaOptions* options, const Instance* instance, const Lookup* lt, const Individual* individuals, size_t n) {
+    TegaError error = no_error();
+    int fd = open(options->profile_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if(fd < 0) {
+        set_error(&error, TEGA_ERROR_IO, "Cannot write the driving profile to %s", options->profile_file);
+        exit_on_error(&error);
+    }
+
+    ProfileWriter writer = new_profile_writer(fd, options->profile_format, 0, &error);
+    exit_on_error(&error);
+
+    for(size_t i = 0; i < n; i++) {
+        write_individual_profile(&writer, instance, lt, &individuals[i], i);
+    }
+
+    bool written = free_profile_writer(&writer);
+
+    if(close(fd) != 0 || !written) {
+        set_error(&error, TEGA_ERROR_IO, "Could not write the driving profile to %s", options->profile_file);
+        exit_on_error(&error);
+    }
+}
+
+int main(int argc, char** argv) {
+    TegaOptions options = parse_options(argc, argv);
+
+    TegaError error = no_error();
+
+    if(options.metrics_report != NULL) {
+        write_metrics_report_at_exit(options.metrics_report, &error);
+        exit_on_error(&error);
+    }
+
+    if(options.metrics_samples != NULL) {
+        start_metrics_sampling(options.metrics_samples, options.metrics_interval, &error);
+        exit_on_error(&error);
+    }
+
+    Instance original = read_instance(options.instance_file, &error);
+    exit_on_error(&error);
+
+    PreprocessingParams preprocessing = default_preprocessing_params();
+    preprocessing.merge = options.merge;
+    preprocessing.max_segment_length = options.max_segment_length;
+    RouteMapping mapping;
+    Instance inst = preprocess_instance(&original, &preprocessing, &mapping, &error);
+    exit_on_error(&error);
+
+    Lookup l = generate_lookup_tables(&inst, &error);
+    exit_on_error(&error);
+
+    // Every segment evaluation of the optimisation is recorded, so that tega_replay can run it again
+    if(options.evaluation_trace != NULL) {
+        start_evaluation_trace(options.evaluation_trace, &inst, &error);
+        exit_on_error(&error);
+    }
 
     // print_instance(&i);
-    print_lookup_tables(&l, &inst);
+    // print_lookup_tables(&l, &inst);
+    // LookupFillReport report = lookup_fill_report(&inst, &l, NULL);
+    // print_lookup_fill_report(&report, 10);
+
+    // In Pareto mode, energy and punctuality are optimised as separate objectives, and the
+    // trade-off between them is printed instead of a single solution
+    if(options.pareto) {
+        ParetoParams pareto_params = default_pareto_params();
+        ParetoResult front = run_nsga2(&inst, &l, &pareto_params, &error);
+        exit_on_error(&error);
+
+        stop_evaluation_trace(&error);
+        exit_on_error(&error);
+
+        print_pareto_front(&front);
+
+        if(options.profile_file != NULL) { write_profiles(&options, &inst, &l, front.front, front.front_n); }
+
+        free_pareto_result(&front);
+        free_lookup_tables(&l);
+        free_instance(&inst);
+        free_route_mapping(&mapping);
+        free_instance(&original);
+        stop_metrics_sampling();
+
+        return 0;
+    }
+
+    Lookup coarse = {.cruising_energy = NULL};
+    GeneticParams params = default_genetic_params();
+
+    // Children are screened on coarse tables, and only the best of them evaluated on the full ones
+    if(options.screening_stride > 0) {
+        coarse = generate_coarse_lookup_tables(&inst, options.screening_stride, &error);
+        exit_on_error(&error);
+
+        params.screening_lookup = &coarse;
+        params.promotion_ratio = options.promotion_ratio;
+    }
+
+    SolverResult result = options.solution_cache != NULL ?
+        run_genetic_algorithm_cached(options.solution_cache, SOLUTION_CACHE_RETURN, &inst, &l, &params, NULL, &error) :
+        run_genetic_algorithm(&inst, &l, &params, &error);
+    exit_on_error(&error);
+
+    stop_evaluation_trace(&error);
+    exit_on_error(&error);
+
+    print_individual(&result.best);
+
+    // Segment ids are those of the preprocessed route
+    if(inst.num_segments != original.num_segments) { print_route_mapping(&mapping); }
+
+    print_convergence_trace(&result);
+
+    if(options.profile_file != NULL) { write_profiles(&options, &inst, &l, &result.best, 1); }
 
+    free_solver_result(&result);
+    free_lookup_tables(&coarse);
     free_lookup_tables(&l);
     free_instance(&inst);
+    free_route_mapping(&mapping);
+    free_instance(&original);
+    stop_metrics_sampling();
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,287 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#include "metrics.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+// Threads beyond this number share the last set of counters
+#define METRICS_MAX_THREADS 256
+
+// Size of a cache line, so that threads never write on the same one
+#define METRICS_CACHE_LINE 64
+
+/**
+ * Counters and timers of a thread.
+ */
+typedef struct MetricsSlot {
+    uint64_t    counters[METRICS_COUNTERS];
+    uint64_t    timer_ns[METRICS_TIMERS];
+    uint64_t    timer_calls[METRICS_TIMERS];
+} __attribute__((aligned(METRICS_CACHE_LINE))) MetricsSlot;
+
+static const char* const timer_names[METRICS_TIMERS] = {
+    "instance_load",
+    "table_max_acceleration",
+    "table_coasting",
+    "table_max_braking",
+    "table_cruising_energy",
+    "table_reach",
+    "optimisation",
+    "local_search"
+};
+
+static const char* const counter_names[METRICS_COUNTERS] = {
+    "segment_evaluations",
+    "invalid_table_hits",
+    "reused_segments",
+    "generations",
+    "screened_children",
+    "promoted_children"
+};
+
+static MetricsSlot slots[METRICS_MAX_THREADS];
+static size_t slots_used = 0;
+static __thread MetricsSlot* thread_slot = NULL;
+
+static FILE* report_fd = NULL;
+static bool report_registered = false;
+
+static struct {
+    pthread_t       thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t  wake;
+    FILE*           fd;
+    double          interval;
+    bool            running;
+} sampler = {.mutex = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER, .running = false};
+
+/*
+ * implementation-method
+ *
+ * Gives the slot of the calling thread, claiming one the first time.
+ */
+static MetricsSlot* get_thread_slot(void) {
+    if(thread_slot == NULL) {
+        size_t index = __atomic_fetch_add(&slots_used, 1, __ATOMIC_RELAXED);
+        thread_slot = &slots[index < METRICS_MAX_THREADS ? index : METRICS_MAX_THREADS - 1];
+    }
+
+    return thread_slot;
+}
+
+/*
+ * implementation-method
+ *
+ * Adds to a value of the calling thread's slot. Slots are private, so a relaxed load and
+ * store are enough, except for the slot shared by the threads in excess.
+ */
+static void slot_add(MetricsSlot* slot, uint64_t* value, uint64_t n) {
+    if(slot == &slots[METRICS_MAX_THREADS - 1]) {
+        __atomic_fetch_add(value, n, __ATOMIC_RELAXED);
+    } else {
+        __atomic_store_n(value, __atomic_load_n(value, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * api-method
+ */
+void metrics_add(MetricsCounter counter, uint64_t n) {
+    MetricsSlot* slot = get_thread_slot();
+    slot_add(slot, &slot->counters[counter], n);
+}
+
+/*
+ * api-method
+ */
+void metrics_add_time(MetricsTimer timer, uint64_t ns) {
+    MetricsSlot* slot = get_thread_slot();
+    slot_add(slot, &slot->timer_ns[timer], ns);
+    slot_add(slot, &slot->timer_calls[timer], 1);
+}
+
+/*
+ * api-method
+ */
+uint64_t metrics_clock(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000ull + (uint64_t) now.tv_nsec;
+}
+
+/*
+ * implementation-method
+ *
+ * Writes the report, preceded by the given fields (which must end with a comma, if any).
+ */
+static void write_report_with(FILE* fd, const char* extra_fields) {
+    size_t used = __atomic_load_n(&slots_used, __ATOMIC_RELAXED);
+    size_t n = (used < METRICS_MAX_THREADS) ? used : METRICS_MAX_THREADS;
+    MetricsSlot total;
+
+    memset(&total, 0, sizeof(total));
+
+    for(size_t s = 0; s < n; s++) {
+        for(size_t c = 0; c < METRICS_COUNTERS; c++) {
+            total.counters[c] += __atomic_load_n(&slots[s].counters[c], __ATOMIC_RELAXED);
+        }
+
+        for(size_t t = 0; t < METRICS_TIMERS; t++) {
+            total.timer_ns[t] += __atomic_load_n(&slots[s].timer_ns[t], __ATOMIC_RELAXED);
+            total.timer_calls[t] += __atomic_load_n(&slots[s].timer_calls[t], __ATOMIC_RELAXED);
+        }
+    }
+
+#ifdef TEGA_METRICS
+    const char* enabled = "true";
+#else
+    const char* enabled = "false";
+#endif
+
+    fprintf(fd, "{%s\"enabled\": %s, \"threads\": %zu, \"timers\": {", extra_fields, enabled, used);
+
+    for(size_t t = 0; t < METRICS_TIMERS; t++) {
+        fprintf(fd, "%s\"%s\": {\"seconds\": %.6f, \"calls\": %llu}", (t == 0 ? "" : ", "), timer_names[t],
+            1e-9 * (double) total.timer_ns[t], (unsigned long long) total.timer_calls[t]);
+    }
+
+    fprintf(fd, "}, \"counters\": {");
+
+    for(size_t c = 0; c < METRICS_COUNTERS; c++) {
+        fprintf(fd, "%s\"%s\": %llu", (c == 0 ? "" : ", "), counter_names[c], (unsigned long long) total.counters[c]);
+    }
+
+    fprintf(fd, "}}\n");
+    fflush(fd);
+}
+
+/*
+ * api-method
+ */
+void write_metrics_report(FILE* fd) {
+    write_report_with(fd, "");
+}
+
+/*
+ * implementation-method
+ */
+static void write_report_file(void) {
+    if(report_fd == NULL) { return; }
+
+    write_metrics_report(report_fd);
+    fclose(report_fd);
+    report_fd = NULL;
+}
+
+/*
+ * api-method
+ */
+bool write_metrics_report_at_exit(const char* filename, TegaError* error) {
+    FILE* fd = fopen(filename, "w");
+
+    if(fd == NULL) {
+        return set_error(error, TEGA_ERROR_IO, "Cannot write metrics report: %s", filename);
+    }
+
+    if(report_fd != NULL) { fclose(report_fd); }
+
+    report_fd = fd;
+
+    if(!report_registered && atexit(write_report_file) != 0) {
+        fclose(report_fd);
+        report_fd = NULL;
+        return set_error(error, TEGA_ERROR_OUT_OF_MEMORY, "Cannot register the metrics report for %s", filename);
+    }
+
+    report_registered = true;
+
+    return true;
+}
+
+/*
+ * implementation-method
+ *
+ * Body of the sampling thread.
+ */
+static void* sample_metrics(void* arg) {
+    uint64_t start = metrics_clock();
+    char fields[64];
+
+    pthread_mutex_lock(&sampler.mutex);
+
+    while(true) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+
+        double wake_at = deadline.tv_nsec * 1e-9 + sampler.interval;
+        deadline.tv_sec += (time_t) wake_at;
+        deadline.tv_nsec = (long) ((wake_at - (double) (time_t) wake_at) * 1e9);
+
+        while(sampler.running) {
+            if(pthread_cond_timedwait(&sampler.wake, &sampler.mutex, &deadline) != 0) { break; }
+        }
+
+        snprintf(fields, sizeof(fields), "\"elapsed\": %.3f, ", 1e-9 * (double) (metrics_clock() - start));
+        write_report_with(sampler.fd, fields);
+
+        if(!sampler.running) { break; }
+    }
+
+    pthread_mutex_unlock(&sampler.mutex);
+
+    return NULL;
+}
+
+/*
+ * api-method
+ */
+bool start_metrics_sampling(const char* filename, double interval, TegaError* error) {
+    if(sampler.running) {
+        return set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "Cannot sample metrics to %s: they are already being sampled", filename);
+    }
+
+    if(!(interval > 0)) {
+        return set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "The metrics sampling interval must be positive, not %g", interval);
+    }
+
+    sampler.fd = fopen(filename, "w");
+
+    if(sampler.fd == NULL) {
+        return set_error(error, TEGA_ERROR_IO, "Cannot write metrics samples: %s", filename);
+    }
+
+    sampler.interval = interval;
+    sampler.running = true;
+
+    if(pthread_create(&sampler.thread, NULL, sample_metrics, NULL) != 0) {
+        sampler.running = false;
+        fclose(sampler.fd);
+        return set_error(error, TEGA_ERROR_OUT_OF_MEMORY, "Cannot start the metrics sampling thread");
+    }
+
+    return true;
+}
+
+/*
+ * api-method
+ */
+void stop_metrics_sampling(void) {
+    pthread_mutex_lock(&sampler.mutex);
+
+    if(!sampler.running) {
+        pthread_mutex_unlock(&sampler.mutex);
+        return;
+    }
+
+    sampler.running = false;
+    pthread_cond_signal(&sampler.wake);
+    pthread_mutex_unlock(&sampler.mutex);
+
+    pthread_join(sampler.thread, NULL);
+    fclose(sampler.fd);
+}
@@ -0,0 +1,111 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#ifndef TEGA_METRICS_H
+#define TEGA_METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "error.h"
+
+/*
+ * The hot paths are instrumented with the METRICS_* macros below, which compile to nothing
+ * unless TEGA_METRICS is defined (cmake -DTEGA_METRICS=ON). They are off by default, since
+ * counting every segment evaluation costs a thread-local lookup and an atomic update on the
+ * hottest path. The functions are always available: without instrumentation, reports only
+ * contain zeros.
+ */
+
+/**
+ * Phases whose wall-clock time is measured.
+ */
+typedef enum MetricsTimer {
+    TIMER_INSTANCE_LOAD = 0,
+    TIMER_TABLE_MAX_ACCELERATION,
+    TIMER_TABLE_COASTING,
+    TIMER_TABLE_MAX_BRAKING,
+    TIMER_TABLE_CRUISING_ENERGY,
+    TIMER_TABLE_REACH,
+    TIMER_OPTIMISATION,
+    TIMER_LOCAL_SEARCH,
+    METRICS_TIMERS
+} MetricsTimer;
+
+/**
+ * Events which are counted.
+ */
+typedef enum MetricsCounter {
+    COUNTER_SEGMENT_EVALUATIONS = 0,    // Calls to run_on_segment
+    COUNTER_INVALID_TABLE_HITS,         // Runs reaching a -1 cell, or a speed outside the tables
+    COUNTER_REUSED_SEGMENTS,            // Segments whose run was reused, rather than simulated again
+    COUNTER_GENERATIONS,                // Generations of the genetic algorithm
+    COUNTER_SCREENED_CHILDREN,          // Children evaluated on coarse tables
+    COUNTER_PROMOTED_CHILDREN,          // Screened children evaluated again on the full tables
+    METRICS_COUNTERS
+} MetricsCounter;
+
+#ifdef TEGA_METRICS
+#define METRICS_COUNT(counter, n)           metrics_add((counter), (n))
+#define METRICS_TIMER_START(var)            uint64_t var = metrics_clock()
+#define METRICS_TIMER_STOP(timer, var)      metrics_add_time((timer), metrics_clock() - (var))
+#else
+#define METRICS_COUNT(counter, n)           ((void) 0)
+#define METRICS_TIMER_START(var)
+#define METRICS_TIMER_STOP(timer, var)      ((void) 0)
+#endif
+
+/**
+ * Adds to a counter of the calling thread. Each thread has its own counters, on their own
+ * cache line, which are only added up when a report is written.
+ * @param counter   The counter
+ * @param n         The amount to add
+ */
+void metrics_add(MetricsCounter counter, uint64_t n);
+
+/**
+ * Adds to the time spent by the calling thread in a phase, and counts one call.
+ * @param timer     The timer
+ * @param ns        The time to add [ns]
+ */
+void metrics_add_time(MetricsTimer timer, uint64_t ns);
+
+/**
+ * Monotonic clock, for METRICS_TIMER_START and METRICS_TIMER_STOP.
+ * @return  The current time [ns]
+ */
+uint64_t metrics_clock(void);
+
+/**
+ * Writes the metrics aggregated over all threads, as a json object on a single line.
+ * @param fd        The output stream
+ */
+void write_metrics_report(FILE* fd);
+
+/**
+ * Writes the metrics report to a file when the program exits. The file is created right
+ * away, so that it is known at once whether it can be written. A later call replaces the file.
+ * @param filename  The output file name
+ * @param error     Filled if the file cannot be created (can be NULL)
+ * @return          True if the report will be written
+ */
+bool write_metrics_report_at_exit(const char* filename, TegaError* error);
+
+/**
+ * Starts a background thread appending a metrics report to a file at regular intervals,
+ * each on its own line, with the time elapsed since the sampling started.
+ * @param filename  The output file name
+ * @param interval  Time between two samples [s]
+ * @param error     Filled if sampling already runs, the interval is not positive, or the file
+ *                  or the thread cannot be created (can be NULL)
+ * @return          True if the sampling started
+ */
+bool start_metrics_sampling(const char* filename, double interval, TegaError* error);
+
+/**
+ * Stops the sampling thread, after it writes a last sample.
+ */
+void stop_metrics_sampling(void);
+
+#endif //TEGA_METRICS_H
@@ -0,0 +1,264 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#include "model_cache.h"
+#include "instance_binary.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/*
+ * implementation-method
+ */
+static bool has_suffix(const char* str, const char* suffix) {
+    size_t str_len = strlen(str);
+    size_t suffix_len = strlen(suffix);
+
+    return str_len >= suffix_len && strcmp(str + str_len - suffix_len, suffix) == 0;
+}
+
+/*
+ * implementation-method
+ */
+static void free_model(Model* model) {
+    free_packed_model(&model->packed);
+    free(model->filename);
+    free(model);
+}
+
+/*
+ * implementation-method
+ *
+ * Removes a model from the recency list (the mutex must be held).
+ */
+static void unlink_model(ModelCache* cache, Model* model) {
+    if(model->prev != NULL) { model->prev->next = model->next; } else { cache->first = model->next; }
+    if(model->next != NULL) { model->next->prev = model->prev; } else { cache->last = model->prev; }
+
+    model->prev = NULL;
+    model->next = NULL;
+    cache->bytes -= model->bytes;
+}
+
+/*
+ * implementation-method
+ *
+ * Puts a model at the front of the recency list (the mutex must be held).
+ */
+static void push_front(ModelCache* cache, Model* model) {
+    model->prev = NULL;
+    model->next = cache->first;
+
+    if(cache->first != NULL) { cache->first->prev = model; } else { cache->last = model; }
+
+    cache->first = model;
+    cache->bytes += model->bytes;
+}
+
+/*
+ * implementation-method
+ *
+ * Takes a model out of the cache: it is freed now if unused, or by its last release.
+ */
+static void detach_model(ModelCache* cache, Model* model) {
+    unlink_model(cache, model);
+
+    if(model->users == 0) {
+        free_model(model);
+    } else {
+        model->detached = true;
+    }
+}
+
+/*
+ * implementation-method
+ *
+ * Evicts unused models, least recently used first, until the cache is within its budget.
+ */
+static void evict_over_budget(ModelCache* cache) {
+    Model* model = cache->last;
+
+    while(model != NULL && cache->bytes > cache->budget) {
+        Model* prev = model->prev;
+
+        if(model->users == 0 && !model->loading) {
+            detach_model(cache, model);
+            cache->evictions++;
+        }
+
+        model = prev;
+    }
+}
+
+/*
+ * implementation-method
+ */
+static Model* find_model(ModelCache* cache, const char* filename) {
+    for(Model* model = cache->first; model != NULL; model = model->next) {
+        if(strcmp(model->filename, filename) == 0) { return model; }
+    }
+
+    return NULL;
+}
+
+/*
+ * implementation-method
+ *
+ * Reads the instance and packs it with its tables, without holding the mutex. The memory
+ * they use is returned separately, as the model is in the list, where its size must not change.
+ */
+static bool load_model(Model* model, bool huge_pages, size_t* bytes, TegaError* error) {
+    Instance instance = has_suffix(model->filename, ".bin") ?
+        read_instance_binary(model->filename, error) :
+        read_instance_streaming(model->filename, error);
+
+    if(instance.segments == NULL) { return false; }
+
+    bool packed = pack_model(&instance, huge_pages, &model->packed, error);
+
+    free_instance(&instance);
+
+    if(!packed) { return false; }
+
+    *bytes = model->packed.arena.capacity;
+
+    return true;
+}
+
+/*
+ * api-method
+ */
+void init_model_cache(ModelCache* cache, size_t budget) {
+    pthread_mutex_init(&cache->mutex, NULL);
+    pthread_cond_init(&cache->loaded, NULL);
+    cache->first = NULL;
+    cache->last = NULL;
+    cache->bytes = 0;
+    cache->budget = budget;
+    cache->huge_pages = false;
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->evictions = 0;
+}
+
+/*
+ * api-method
+ */
+const Model* acquire_model(ModelCache* cache, const char* filename, bool* hit, TegaError* error) {
+    struct stat file_stat;
+
+    if(stat(filename, &file_stat) != 0) {
+        set_error(error, TEGA_ERROR_IO, "Cannot read input file: %s", filename);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&cache->mutex);
+
+    Model* model;
+
+    // Wait for other threads loading the same file, rather than loading it twice
+    while((model = find_model(cache, filename)) != NULL && model->loading) {
+        pthread_cond_wait(&cache->loaded, &cache->mutex);
+    }
+
+    if(model != NULL && (model->mtime != file_stat.st_mtime || model->file_sz != file_stat.st_size)) {
+        detach_model(cache, model);
+        model = NULL;
+    }
+
+    if(model != NULL) {
+        unlink_model(cache, model);
+        push_front(cache, model);
+        model->users++;
+        cache->hits++;
+        pthread_mutex_unlock(&cache->mutex);
+
+        if(hit != NULL) { *hit = true; }
+        return model;
+    }
+
+    model = calloc(1, sizeof(*model));
+    char* name = strdup(filename);
+
+    if(model == NULL || name == NULL) {
+        pthread_mutex_unlock(&cache->mutex);
+        free(model);
+        free(name);
+        set_error(error, TEGA_ERROR_OUT_OF_MEMORY, "Could not allocate memory for the model of %s", filename);
+        return NULL;
+    }
+
+    model->filename = name;
+    model->mtime = file_stat.st_mtime;
+    model->file_sz = file_stat.st_size;
+    model->users = 1;
+    model->loading = true;
+    push_front(cache, model);
+    cache->misses++;
+    pthread_mutex_unlock(&cache->mutex);
+
+    size_t bytes = 0;
+    bool loaded = load_model(model, cache->huge_pages, &bytes, error);
+
+    pthread_mutex_lock(&cache->mutex);
+
+    unlink_model(cache, model);
+    model->bytes = bytes;
+    model->loading = false;
+
+    if(loaded) {
+        push_front(cache, model);
+        evict_over_budget(cache);
+    }
+
+    pthread_cond_broadcast(&cache->loaded);
+    pthread_mutex_unlock(&cache->mutex);
+
+    if(!loaded) {
+        free_model(model);
+        return NULL;
+    }
+
+    if(hit != NULL) { *hit = false; }
+    return model;
+}
+
+/*
+ * api-method
+ */
+void release_model(ModelCache* cache, const Model* model) {
+    Model* m = (Model*) model;
+
+    pthread_mutex_lock(&cache->mutex);
+
+    m->users--;
+
+    if(m->detached) {
+        if(m->users == 0) { free_model(m); }
+    } else {
+        evict_over_budget(cache);
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+/*
+ * api-method
+ */
+void free_model_cache(ModelCache* cache) {
+    Model* model = cache->first;
+
+    while(model != NULL) {
+        Model* next = model->next;
+        free_model(model);
+        model = next;
+    }
+
+    cache->first = NULL;
+    cache->last = NULL;
+    cache->bytes = 0;
+
+    pthread_cond_destroy(&cache->loaded);
+    pthread_mutex_destroy(&cache->mutex);
+}
@@ -0,0 +1,85 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#ifndef TEGA_MODEL_CACHE_H
+#define TEGA_MODEL_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include "packed_model.h"
+
+/**
+ * An instance file loaded in memory, with its lookup tables.
+ */
+typedef struct Model {
+    char*           filename;   // File the instance was read from
+    PackedModel     packed;     // The instance and its lookup tables
+    size_t          bytes;      // Memory used by the segments and the tables
+    time_t          mtime;      // Modification time and size of the file when it was read, to detect changes
+    off_t           file_sz;
+    size_t          users;      // Number of acquire_model calls not yet released
+    bool            loading;    // Set while a thread is reading the file and building the tables
+    bool            detached;   // Set when the model left the cache while in use; freed by the last release
+    struct Model*   prev;       // Neighbours in the cache's recency list
+    struct Model*   next;
+} Model;
+
+/**
+ * Models kept in memory between solves, up to a memory budget. When the budget is exceeded,
+ * the least recently used models that no thread is using are evicted. A model is reloaded if
+ * its file changes on disk.
+ *
+ * All the functions are thread-safe. Models are read-only once loaded, so any number of
+ * threads can solve on the same model at the same time.
+ */
+typedef struct ModelCache {
+    pthread_mutex_t mutex;
+    pthread_cond_t  loaded;     // Signalled when a model finishes loading
+    Model*          first;      // Most recently used
+    Model*          last;       // Least recently used
+    size_t          bytes;      // Memory used by the models in the list
+    size_t          budget;     // Memory budget [bytes]
+    bool            huge_pages; // Whether models are packed on huge pages (false after init_model_cache)
+    size_t          hits;       // Statistics
+    size_t          misses;
+    size_t          evictions;
+} ModelCache;
+
+/**
+ * Creates an empty cache.
+ * @param cache     The cache to initialise
+ * @param budget    Memory budget [bytes]. A single model larger than the budget is still loaded
+ *                  and served, but it is evicted as soon as nobody uses it.
+ */
+void init_model_cache(ModelCache* cache, size_t budget);
+
+/**
+ * Gives the model for an instance file, loading it if it is not in the cache. Files ending
+ * in .bin are read with read_instance_binary, others with read_instance_streaming. The
+ * model cannot be evicted until it is released.
+ * @param cache     The cache
+ * @param filename  The instance file
+ * @param hit       Set to whether the model was already in the cache (can be NULL)
+ * @param error     Filled if the file cannot be loaded (can be NULL)
+ * @return          The model, or NULL on error
+ */
+const Model* acquire_model(ModelCache* cache, const char* filename, bool* hit, TegaError* error);
+
+/**
+ * Releases a model obtained from acquire_model.
+ * @param cache     The cache
+ * @param model     The model
+ */
+void release_model(ModelCache* cache, const Model* model);
+
+/**
+ * Frees all the models. No model can be in use.
+ * @param cache     The cache
+ */
+void free_model_cache(ModelCache* cache);
+
+#endif //TEGA_MODEL_CACHE_H
@@ -0,0 +1,67 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#include "packed_model.h"
+#include <string.h>
+
+/*
+ * api-method
+ */
+size_t packed_model_size(const Instance* instance) {
+    LookupMemory memory = estimate_lookup_memory(instance);
+    size_t cells_bytes = instance->num_segments * memory.speeds_n * memory.lengths_n * sizeof(float);
+
+    // The segments, the nine style tables and the cruising energy table, each aligned
+    return arena_block_size(instance->num_segments * sizeof(*instance->segments)) +
+           9 * arena_block_size(cells_bytes) +
+           arena_block_size(memory.cruising_energy_bytes);
+}
+
+/*
+ * api-method
+ */
+bool pack_model(const Instance* instance, bool huge_pages, PackedModel* model, TegaError* error) {
+    memset(model, 0, sizeof(*model));
+
+    if(!init_arena(&model->arena, packed_model_size(instance), huge_pages, error)) { return false; }
+
+    Segment* segments = arena_alloc(&model->arena, instance->num_segments * sizeof(*segments));
+
+    // Copied in parallel, so that the pages are faulted in by several threads
+    #pragma omp parallel for schedule(static)
+    for(size_t i = 0; i < instance->num_segments; i++) {
+        segments[i] = instance->segments[i];
+    }
+
+    Instance packed = {
+        .segments = segments,
+        .train = instance->train,
+        .num_segments = instance->num_segments,
+        .start_speed = instance->start_speed,
+        .start_time = instance->start_time,
+        .mapping = NULL,
+        .mapping_sz = 0
+    };
+
+    memcpy(&model->instance, &packed, sizeof(packed));
+
+    model->lookup = generate_lookup_tables_in_arena(&model->instance, &model->arena, error);
+
+    if(model->lookup.cruising_energy == NULL && instance->num_segments > 0) {
+        free_packed_model(model);
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * api-method
+ */
+void free_packed_model(PackedModel* model) {
+    // Tables moved out of the arena by a resize (see update_lookup_tables)
+    free_lookup_tables(&model->lookup);
+    free_arena(&model->arena);
+    memset(model, 0, sizeof(*model));
+}
@@ -0,0 +1,50 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#ifndef TEGA_PACKED_MODEL_H
+#define TEGA_PACKED_MODEL_H
+
+#include <stdbool.h>
+#include "arena.h"
+#include "instance.h"
+#include "lookup.h"
+
+/**
+ * An instance and its lookup tables, all placed in a single arena: the segments, the nine
+ * tables and the cruising energy table are contiguous, mapped at once (optionally on huge
+ * pages), written in parallel, and released with one call. Reach tables, if added, are not
+ * part of the arena (see add_reach_tables).
+ *
+ * Do not call free_instance or free_lookup_tables on the members: use free_packed_model.
+ */
+typedef struct PackedModel {
+    Arena       arena;      // The memory of the model
+    Instance    instance;   // The instance, with its segments in the arena
+    Lookup      lookup;     // Its lookup tables, in the arena
+} PackedModel;
+
+/**
+ * Memory a packed model of an instance takes, before rounding to pages.
+ * @param instance  The instance
+ * @return          Size of the arena [bytes]
+ */
+size_t packed_model_size(const Instance* instance);
+
+/**
+ * Copies an instance into a new arena and generates its lookup tables there.
+ * @param instance      The instance; it is not needed once the model is packed
+ * @param huge_pages    Whether to back the arena with huge pages (see init_arena)
+ * @param model         The model to fill
+ * @param error         Filled if there is not enough memory (can be NULL)
+ * @return              False on error, in which case nothing is allocated
+ */
+bool pack_model(const Instance* instance, bool huge_pages, PackedModel* model, TegaError* error);
+
+/**
+ * Releases the instance and the tables of a packed model.
+ * @param model     The model
+ */
+void free_packed_model(PackedModel* model);
+
+#endif //TEGA_PACKED_MODEL_H
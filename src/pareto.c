@@ -0,0 +1,460 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#include "pareto.h"
+#include "metrics.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+// Marks the ends of a front in non_dominated_sort
+#define NO_POINT ((size_t) -1)
+
+/*
+ * A point of non_dominated_sort, with its position in the input.
+ */
+typedef struct SortedPoint {
+    double  energy;
+    double  deviation;
+    double  violation;
+    size_t  index;
+} SortedPoint;
+
+/*
+ * An individual of the population, with its place in the non-dominated sorting.
+ */
+typedef struct ParetoMember {
+    Individual*             individual;
+    IndividualObjectives    objectives;
+    size_t                  rank;
+    double                  crowding;
+    size_t                  first_changed;  // First segment to simulate, for a child
+} ParetoMember;
+
+/*
+ * implementation-method
+ *
+ * By energy, then by deviation, then by position, so that the order is total.
+ */
+static int compare_sorted_points(const void* a, const void* b) {
+    const SortedPoint* pa = a;
+    const SortedPoint* pb = b;
+
+    if(pa->energy != pb->energy) { return (pa->energy > pb->energy) - (pa->energy < pb->energy); }
+    if(pa->deviation != pb->deviation) { return (pa->deviation > pb->deviation) - (pa->deviation < pb->deviation); }
+
+    return (pa->index > pb->index) - (pa->index < pb->index);
+}
+
+/*
+ * implementation-method
+ *
+ * By violation, then by position.
+ */
+static int compare_violations(const void* a, const void* b) {
+    const SortedPoint* pa = a;
+    const SortedPoint* pb = b;
+
+    if(pa->violation != pb->violation) { return (pa->violation > pb->violation) - (pa->violation < pb->violation); }
+
+    return (pa->index > pb->index) - (pa->index < pb->index);
+}
+
+/*
+ * implementation-method
+ *
+ * Tells whether a point, considered after all those with less energy, can join a front.
+ * The last point of the front has the least deviation, so it is the only one that could
+ * dominate the new point.
+ */
+static bool fits_front(const SortedPoint* last, const SortedPoint* point) {
+    return last->deviation > point->deviation || (last->deviation == point->deviation && last->energy == point->energy);
+}
+
+/*
+ * implementation-method
+ *
+ * Lower rank first; on the same front, the less crowded first.
+ */
+static int compare_members(const void* a, const void* b) {
+    const ParetoMember* ma = a;
+    const ParetoMember* mb = b;
+
+    if(ma->rank != mb->rank) { return (ma->rank > mb->rank) - (ma->rank < mb->rank); }
+    if(ma->crowding != mb->crowding) { return (ma->crowding < mb->crowding) - (ma->crowding > mb->crowding); }
+    if(ma->objectives.energy != mb->objectives.energy) { return (ma->objectives.energy > mb->objectives.energy) - (ma->objectives.energy < mb->objectives.energy); }
+
+    return (ma->objectives.deviation > mb->objectives.deviation) - (ma->objectives.deviation < mb->objectives.deviation);
+}
+
+/*
+ * implementation-method
+ */
+static int compare_members_by_energy(const void* a, const void* b) {
+    const ParetoMember* ma = a;
+    const ParetoMember* mb = b;
+
+    if(ma->objectives.energy != mb->objectives.energy) { return (ma->objectives.energy > mb->objectives.energy) - (ma->objectives.energy < mb->objectives.energy); }
+
+    return (ma->objectives.deviation > mb->objectives.deviation) - (ma->objectives.deviation < mb->objectives.deviation);
+}
+
+/*
+ * implementation-method
+ *
+ * Binary tournament: the lower rank wins, then the less crowded.
+ */
+static const ParetoMember* select_parent(const ParetoMember* members, size_t n, unsigned int* seed) {
+    const ParetoMember* a = &members[(size_t) rand_r(seed) % n];
+    const ParetoMember* b = &members[(size_t) rand_r(seed) % n];
+
+    if(b->rank < a->rank || (b->rank == a->rank && b->crowding > a->crowding)) { return b; }
+
+    return a;
+}
+
+/*
+ * implementation-method
+ *
+ * Stores the objectives of members[first], ..., members[last - 1], which must be evaluated.
+ */
+static void update_objectives(ParetoMember* members, size_t first, size_t last) {
+    #pragma omp parallel for schedule(static)
+    for(size_t i = first; i < last; i++) {
+        members[i].objectives = individual_objectives(members[i].individual);
+    }
+}
+
+/*
+ * implementation-method
+ *
+ * Ranks members[0], ..., members[n - 1] and sorts them by rank and crowding distance.
+ * The buffers hold n entries.
+ */
+static bool sort_members(ParetoMember* members, size_t n, IndividualObjectives* points, size_t* ranks, double* crowding, TegaError* error) {
+    if(n == 0) { return true; }
+
+    for(size_t i = 0; i < n; i++) {
+        points[i] = members[i].objectives;
+    }
+
+    if(non_dominated_sort(points, n, ranks, crowding, error) == 0) { return false; }
+
+    for(size_t i = 0; i < n; i++) {
+        members[i].rank = ranks[i];
+        members[i].crowding = crowding[i];
+    }
+
+    qsort(members, n, sizeof(*members), compare_members);
+
+    return true;
+}
+
+/*
+ * implementation-method
+ *
+ * Copies the first front of the sorted population into the result, without duplicates. It
+ * only holds feasible individuals, which all come before the others: if there are none, the
+ * front is empty.
+ */
+static bool collect_front(const Instance* instance, ParetoMember* members, size_t n, ParetoResult* result, TegaError* error) {
+    size_t front_n = 0;
+
+    while(front_n < n && members[front_n].rank == 0 && members[front_n].objectives.violation == 0) { front_n++; }
+
+    if(front_n == 0) { return true; }
+
+    qsort(members, front_n, sizeof(*members), compare_members_by_energy);
+
+    result->front = calloc(front_n, sizeof(*result->front));
+    result->objectives = malloc(front_n * sizeof(*result->objectives));
+
+    if(result->front == NULL || result->objectives == NULL) {
+        return set_error(error, TEGA_ERROR_OUT_OF_MEMORY, "Could not allocate memory for the Pareto front");
+    }
+
+    for(size_t i = 0; i < front_n; i++) {
+        const IndividualObjectives* objectives = &members[i].objectives;
+
+        if(result->front_n > 0) {
+            const IndividualObjectives* previous = &result->objectives[result->front_n - 1];
+
+            if(previous->energy == objectives->energy && previous->deviation == objectives->deviation) { continue; }
+        }
+
+        Individual* individual = &result->front[result->front_n];
+        *individual = new_individual(instance, error);
+
+        if(individual->entry_speeds == NULL) { return false; }
+
+        copy_individual(individual, members[i].individual);
+        result->objectives[result->front_n++] = *objectives;
+    }
+
+    return true;
+}
+
+/*
+ * implementation-method
+ */
+static double seconds_since(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (double) (now.tv_sec - start->tv_sec) + 1e-9 * (double) (now.tv_nsec - start->tv_nsec);
+}
+
+/*
+ * api-method
+ */
+ParetoParams default_pareto_params(void) {
+    return (ParetoParams) {
+        .population_size = 100,
+        .mutation_probability = 0.05f,
+        .num_generations = 1000,
+        .time_limit = 0,
+        .seed = 1u
+    };
+}
+
+/*
+ * api-method
+ */
+size_t non_dominated_sort(const IndividualObjectives* points, size_t n, size_t* ranks, double* crowding, TegaError* error) {
+    if(n == 0) { return 0; }
+
+    SortedPoint* sorted = malloc(n * sizeof(*sorted));
+
+    // Neighbours of each point on its front, and ends of each front, as positions in sorted
+    size_t* links = malloc(4 * n * sizeof(*links));
+
+    if(sorted == NULL || links == NULL) {
+        free(sorted);
+        free(links);
+        set_error(error, TEGA_ERROR_OUT_OF_MEMORY, "Could not allocate memory to sort %zu points", n);
+        return 0;
+    }
+
+    size_t* previous = links;
+    size_t* next = links + n;
+    size_t* front_first = links + 2 * n;
+    size_t* front_last = links + 3 * n;
+
+    // Feasible points first, then the others
+    size_t feasible_n = 0;
+    size_t infeasible_n = 0;
+
+    for(size_t i = 0; i < n; i++) {
+        size_t s = points[i].violation > 0 ? n - ++infeasible_n : feasible_n++;
+
+        sorted[s] = (SortedPoint) {.energy = points[i].energy, .deviation = points[i].deviation, .violation = points[i].violation, .index = i};
+    }
+
+    qsort(sorted, feasible_n, sizeof(*sorted), compare_sorted_points);
+    qsort(sorted + feasible_n, infeasible_n, sizeof(*sorted), compare_violations);
+
+    size_t fronts = 0;
+
+    // The least deviation of each front grows with the rank, so the first front the point
+    // fits in is found with a binary search
+    for(size_t s = 0; s < feasible_n; s++) {
+        size_t low = 0;
+        size_t high = fronts;
+
+        while(low < high) {
+            size_t middle = low + (high - low) / 2;
+
+            if(fits_front(&sorted[front_last[middle]], &sorted[s])) {
+                high = middle;
+            } else {
+                low = middle + 1;
+            }
+        }
+
+        if(low == fronts) {
+            front_first[fronts++] = s;
+            previous[s] = NO_POINT;
+        } else {
+            previous[s] = front_last[low];
+            next[front_last[low]] = s;
+        }
+
+        next[s] = NO_POINT;
+        front_last[low] = s;
+        ranks[sorted[s].index] = low;
+    }
+
+    // Each front is already sorted by energy, and so by decreasing deviation
+    for(size_t s = 0; s < feasible_n; s++) {
+        size_t front = ranks[sorted[s].index];
+        double distance = INFINITY;
+
+        if(previous[s] != NO_POINT && next[s] != NO_POINT) {
+            const SortedPoint* first = &sorted[front_first[front]];
+            const SortedPoint* last = &sorted[front_last[front]];
+            double energy_range = last->energy - first->energy;
+            double deviation_range = first->deviation - last->deviation;
+
+            distance = 0;
+
+            if(energy_range > 0) { distance += (sorted[next[s]].energy - sorted[previous[s]].energy) / energy_range; }
+            if(deviation_range > 0) { distance += (sorted[previous[s]].deviation - sorted[next[s]].deviation) / deviation_range; }
+        }
+
+        crowding[sorted[s].index] = distance;
+    }
+
+    // An infeasible point is only dominated by those with less violation
+    for(size_t s = feasible_n; s < n; s++) {
+        if(s == feasible_n || sorted[s].violation != sorted[s - 1].violation) { fronts++; }
+
+        ranks[sorted[s].index] = fronts - 1;
+        crowding[sorted[s].index] = 0;
+    }
+
+    free(sorted);
+    free(links);
+
+    return fronts;
+}
+
+/*
+ * api-method
+ */
+ParetoResult run_nsga2(const Instance* instance, const Lookup* lt, const ParetoParams* params, TegaError* error) {
+    ParetoResult result = {
+        .front = NULL,
+        .objectives = NULL,
+        .front_n = 0,
+        .generations = 0,
+        .evaluations = 0,
+        .elapsed_time = 0
+    };
+
+    if(params->population_size == 0) {
+        set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "The population size must be positive");
+        return result;
+    }
+
+    METRICS_TIMER_START(optimisation_start);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // Parents and children: each generation keeps the best half
+    size_t pop_n = params->population_size;
+    size_t pool_n = 2 * pop_n;
+    Individual* pool = calloc(pool_n, sizeof(*pool));
+    ParetoMember* members = calloc(pool_n, sizeof(*members));
+    Individual** batch = malloc(pool_n * sizeof(*batch));
+    size_t* batch_from = malloc(pool_n * sizeof(*batch_from));
+    IndividualObjectives* points = malloc(pool_n * sizeof(*points));
+    size_t* ranks = malloc(pool_n * sizeof(*ranks));
+    double* crowding = malloc(pool_n * sizeof(*crowding));
+
+    bool ok = pool != NULL && members != NULL && batch != NULL && batch_from != NULL && points != NULL && ranks != NULL && crowding != NULL;
+
+    for(size_t i = 0; ok && i < pool_n; i++) {
+        pool[i] = new_individual(instance, error);
+        members[i].individual = &pool[i];
+        ok = pool[i].entry_speeds != NULL;
+    }
+
+    if(!ok) {
+        set_error(error, TEGA_ERROR_OUT_OF_MEMORY, "Could not allocate memory for the population");
+    }
+
+    unsigned int seed = params->seed;
+
+    if(ok) {
+        for(size_t i = 0; i < pop_n; i++) {
+            for(size_t j = 0; j < instance->num_segments; j++) {
+                randomise_segment(instance, &pool[i], j, &seed);
+            }
+
+            batch[i] = &pool[i];
+        }
+
+        result.evaluations += evaluate_population(instance, lt, batch, NULL, pop_n);
+        update_objectives(members, 0, pop_n);
+        ok = sort_members(members, pop_n, points, ranks, crowding, error);
+    }
+
+    while(ok && result.generations < params->num_generations && !(params->time_limit > 0 && seconds_since(&start) >= params->time_limit)) {
+        unsigned int generation_seed = rand_r(&seed);
+
+        #pragma omp parallel for schedule(static)
+        for(size_t c = 0; c < pop_n; c++) {
+            unsigned int child_seed = generation_seed + (unsigned int) c;
+            const ParetoMember* p1 = select_parent(members, pop_n, &child_seed);
+            const ParetoMember* p2 = select_parent(members, pop_n, &child_seed);
+            ParetoMember* child = &members[pop_n + c];
+
+            child->first_changed = breed_individual(instance, p1->individual, p2->individual, child->individual, params->mutation_probability, &child_seed);
+        }
+
+        for(size_t c = 0; c < pop_n; c++) {
+            batch[c] = members[pop_n + c].individual;
+            batch_from[c] = members[pop_n + c].first_changed;
+        }
+
+        result.evaluations += evaluate_population(instance, lt, batch, batch_from, pop_n);
+        update_objectives(members, pop_n, pool_n);
+        ok = sort_members(members, pool_n, points, ranks, crowding, error);
+
+        result.generations++;
+        METRICS_COUNT(COUNTER_GENERATIONS, 1);
+    }
+
+    result.elapsed_time = seconds_since(&start);
+
+    if(ok && !collect_front(instance, members, pop_n, &result, error)) {
+        free_pareto_result(&result);
+    }
+
+    for(size_t i = 0; pool != NULL && i < pool_n; i++) {
+        free_individual(&pool[i]);
+    }
+
+    free(pool);
+    free(members);
+    free(batch);
+    free(batch_from);
+    free(points);
+    free(ranks);
+    free(crowding);
+
+    METRICS_TIMER_STOP(TIMER_OPTIMISATION, optimisation_start);
+
+    return result;
+}
+
+/*
+ * api-method
+ */
+void free_pareto_result(ParetoResult* result) {
+    for(size_t i = 0; result->front != NULL && i < result->front_n; i++) {
+        free_individual(&result->front[i]);
+    }
+
+    free(result->front); result->front = NULL;
+    free(result->objectives); result->objectives = NULL;
+    result->front_n = 0;
+}
+
+/*
+ * api-method
+ */
+void print_pareto_front(const ParetoResult* result) {
+    printf("=== PARETO FRONT (%zu solutions, %zu generations, %zu segment evaluations, %.3f s) ===\n",
+        result->front_n, result->generations, result->evaluations, result->elapsed_time);
+    if(result->front_n == 0) {
+        printf("\tNo driving profile of the last population can be driven\n");
+    }
+    for(size_t i = 0; i < result->front_n; i++) {
+        printf("\tEnergy: %.2f, arrival time deviation: %.2f s, cost: %.2f\n",
+            result->objectives[i].energy, result->objectives[i].deviation, result->front[i].cost);
+    }
+}
@@ -0,0 +1,99 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#ifndef TEGA_PARETO_H
+#define TEGA_PARETO_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "instance.h"
+#include "lookup.h"
+#include "individual.h"
+
+/**
+ * Parameters of the multi-objective genetic algorithm (NSGA-II).
+ */
+typedef struct ParetoParams {
+    size_t          population_size;        // Number of individuals
+    float           mutation_probability;   // Probability of randomising the genes of each segment
+    size_t          num_generations;        // Maximum number of generations
+    double          time_limit;             // Wall-clock budget in [s] (0 means no limit)
+    unsigned int    seed;                   // Seed of the random number generator
+} ParetoParams;
+
+/**
+ * Outcome of a run of the multi-objective genetic algorithm.
+ */
+typedef struct ParetoResult {
+    /**
+     * The non-dominated feasible individuals of the last population, by increasing energy
+     * (and so by decreasing deviation), with their objectives. Individuals with the same
+     * objectives appear once. The front is empty if no individual is feasible.
+     */
+    Individual* front;
+    IndividualObjectives* objectives;
+    size_t front_n;
+
+    /**
+     * Generations completed, total segment simulations, and wall-clock time [s].
+     */
+    size_t generations;
+    size_t evaluations;
+    double elapsed_time;
+} ParetoResult;
+
+/**
+ * Gives a reasonable set of parameters for the multi-objective genetic algorithm.
+ * @return  The default parameters
+ */
+ParetoParams default_pareto_params(void);
+
+/**
+ * Fast non-dominated sorting of points in the (energy, deviation) plane, both minimised, under
+ * constrained domination: a feasible point (with no violation) dominates every infeasible one,
+ * and an infeasible point dominates those with more violation. Rank 0 is the Pareto front,
+ * rank 1 the front of the others, and so on; points with the same objectives have the same
+ * rank, and so do infeasible points with the same violation, which come after all feasible
+ * ones. The crowding distance of a feasible point is the perimeter of the box spanned by its
+ * two neighbours on its front, relative to the extent of the front, and it is infinite at both
+ * ends of the front; it is 0 for infeasible points.
+ *
+ * With two objectives, the feasible points are sorted by energy once, and each one is placed
+ * on its front with a binary search, in O(n log n) overall.
+ * @param points    The points
+ * @param n         Number of points
+ * @param ranks     Filled with the rank of each point
+ * @param crowding  Filled with the crowding distance of each point
+ * @param error     Filled if there is not enough memory (can be NULL)
+ * @return          The number of fronts, or 0 on error
+ */
+size_t non_dominated_sort(const IndividualObjectives* points, size_t n, size_t* ranks, double* crowding, TegaError* error);
+
+/**
+ * Runs NSGA-II, which keeps the traction energy and the deviation from the desired arrival
+ * times as separate objectives, ranked by constrained domination (see non_dominated_sort):
+ * parents are chosen by binary tournament on rank and crowding distance, and each generation
+ * keeps the best half of parents and children by the same criteria. Children are evaluated
+ * with evaluate_population.
+ * @param instance  The instance
+ * @param lt        The look-up tables
+ * @param params    The parameters of the algorithm
+ * @param error     Filled if the parameters are invalid or there is not enough memory (can be NULL)
+ * @return          The result, to be freed with free_pareto_result (with an empty front on error)
+ */
+ParetoResult run_nsga2(const Instance* instance, const Lookup* lt, const ParetoParams* params, TegaError* error);
+
+/**
+ * Frees the memory used by a multi-objective result.
+ * @param result    The result
+ */
+void free_pareto_result(ParetoResult* result);
+
+/**
+ * Prints the Pareto front of a multi-objective result.
+ * @param result    The result
+ */
+void print_pareto_front(const ParetoResult* result);
+
+#endif //TEGA_PARETO_H
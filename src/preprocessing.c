@@ -0,0 +1,225 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#include "preprocessing.h"
+#include "lookup.h"
+#include "eps.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <assert.h>
+
+/*
+ * implementation-method
+ *
+ * Tells whether the next segment can be appended to a run ending with the current one.
+ */
+static bool can_merge(const Segment* current, const Segment* next) {
+    return !current->is_station &&
+           !next->is_station &&
+           !current->has_arrival_time &&
+           current->slope == next->slope &&
+           current->curve == next->curve &&
+           current->speed_limit == next->speed_limit;
+}
+
+/*
+ * implementation-method
+ *
+ * Longest a merged run can get: the tables are as long as the longest segment, so a longer
+ * run would make all of them longer.
+ */
+static float merge_limit(const Instance* instance, const PreprocessingParams* params) {
+    if(params->max_segment_length > SEGMENT_LENGTH_EPS) { return params->max_segment_length; }
+
+    float longest = 0;
+
+    for(size_t i = 0; i < instance->num_segments; i++) {
+        if(instance->segments[i].length > longest) { longest = instance->segments[i].length; }
+    }
+
+    return longest;
+}
+
+/*
+ * implementation-method
+ *
+ * Number of parts in which a segment must be split. Every part is at least one distance step long.
+ */
+static size_t num_parts(const Segment* segment, const PreprocessingParams* params) {
+    if(params->max_segment_length <= SEGMENT_LENGTH_EPS || segment->length <= params->max_segment_length) {
+        return 1;
+    }
+
+    size_t parts = (size_t) ceilf(segment->length / params->max_segment_length);
+    size_t steps = (size_t) (segment->length / DISTANCE_STEP);
+
+    return (parts < steps) ? parts : (steps > 0 ? steps : 1);
+}
+
+/*
+ * implementation-method
+ *
+ * Finds the original segments covered by a part of a merged run, which starts at a given
+ * distance from the beginning of the run.
+ */
+static SegmentOrigin origin_of_part(const Instance* instance, const SegmentOrigin* run, float start, float length) {
+    SegmentOrigin origin = {.first = run->first, .last = run->first, .offset = start};
+
+    while(origin.first < run->last && origin.offset >= instance->segments[origin.first].length - DISTANCE_EPS) {
+        origin.offset -= instance->segments[origin.first].length;
+        origin.first++;
+    }
+
+    float end = origin.offset + length;
+    origin.last = origin.first;
+
+    while(origin.last < run->last && end > instance->segments[origin.last].length + DISTANCE_EPS) {
+        end -= instance->segments[origin.last].length;
+        origin.last++;
+    }
+
+    return origin;
+}
+
+/*
+ * api-method
+ */
+PreprocessingParams default_preprocessing_params(void) {
+    return (PreprocessingParams) {
+        .merge = true,
+        .max_segment_length = 0
+    };
+}
+
+/*
+ * api-method
+ */
+Instance preprocess_instance(const Instance* instance, const PreprocessingParams* params, RouteMapping* mapping, TegaError* error) {
+    size_t n = instance->num_segments;
+    float max_run_length = merge_limit(instance, params);
+
+    // First pass: merge runs of equivalent segments
+    Segment* merged = malloc(n * sizeof(*merged));
+    SegmentOrigin* merged_origins = malloc(n * sizeof(*merged_origins));
+    size_t merged_n = 0;
+
+    mapping->origins = NULL;
+    mapping->num_segments = 0;
+
+    if(n > 0 && (merged == NULL || merged_origins == NULL)) {
+        free(merged);
+        free(merged_origins);
+        set_error(error, TEGA_ERROR_OUT_OF_MEMORY, "Could not allocate memory for the segments");
+        return (Instance) {.segments = NULL, .num_segments = 0};
+    }
+
+    for(size_t i = 0; i < n; i++) {
+        const Segment* seg = &instance->segments[i];
+
+        if(params->merge && merged_n > 0 && can_merge(&merged[merged_n - 1], seg) &&
+           merged[merged_n - 1].length + seg->length <= max_run_length + SEGMENT_LENGTH_EPS) {
+            Segment* run = &merged[merged_n - 1];
+
+            run->length += seg->length;
+            run->end_x = seg->end_x;
+            run->has_arrival_time = seg->has_arrival_time;
+            run->arrival_time = seg->arrival_time;
+            merged_origins[merged_n - 1].last = i;
+        } else {
+            merged[merged_n] = *seg;
+            merged_origins[merged_n] = (SegmentOrigin) {.first = i, .last = i, .offset = 0};
+            merged_n++;
+        }
+    }
+
+    // Second pass: split over-long segments
+    size_t final_n = 0;
+
+    for(size_t i = 0; i < merged_n; i++) {
+        final_n += num_parts(&merged[i], params);
+    }
+
+    Segment* segments = malloc(final_n * sizeof(*segments));
+    mapping->origins = malloc(final_n * sizeof(*mapping->origins));
+    mapping->num_segments = final_n;
+
+    if(final_n > 0 && (segments == NULL || mapping->origins == NULL)) {
+        free(segments);
+        free(merged);
+        free(merged_origins);
+        free_route_mapping(mapping);
+        set_error(error, TEGA_ERROR_OUT_OF_MEMORY, "Could not allocate memory for the segments");
+        return (Instance) {.segments = NULL, .num_segments = 0};
+    }
+
+    size_t k = 0;
+
+    for(size_t i = 0; i < merged_n; i++) {
+        const Segment* seg = &merged[i];
+        size_t parts = num_parts(seg, params);
+
+        // Parts are whole distance steps, spread evenly, so that the look-up tables reach their
+        // ends; the last part also takes what is left beyond the last step
+        size_t steps = (size_t) (seg->length / DISTANCE_STEP);
+        size_t start_step = 0;
+
+        for(size_t p = 0; p < parts; p++) {
+            bool last_part = (p + 1 == parts);
+            size_t end_step = steps * (p + 1) / parts;
+            float start = start_step * DISTANCE_STEP;
+
+            segments[k] = *seg;
+            segments[k].id = (uint_fast32_t) k;
+            segments[k].start_x = seg->start_x + start;
+            segments[k].end_x = last_part ? seg->end_x : seg->start_x + end_step * DISTANCE_STEP;
+            segments[k].length = last_part ? seg->length - start : (end_step - start_step) * DISTANCE_STEP;
+
+            // Only the last part keeps the arrival time
+            segments[k].has_arrival_time = seg->has_arrival_time && last_part;
+            segments[k].arrival_time = segments[k].has_arrival_time ? seg->arrival_time : -1;
+
+            mapping->origins[k] = origin_of_part(instance, &merged_origins[i], start, segments[k].length);
+            start_step = end_step;
+            k++;
+        }
+    }
+
+    assert(k == final_n);
+
+    free(merged);
+    free(merged_origins);
+
+    return (Instance) {
+        .segments = segments,
+        .train = instance->train,
+        .num_segments = final_n,
+        .start_speed = instance->start_speed,
+        .start_time = instance->start_time
+    };
+}
+
+/*
+ * api-method
+ */
+void print_route_mapping(const RouteMapping* mapping) {
+    printf("=== ROUTE MAPPING (%zu segments) ===\n", mapping->num_segments);
+    for(size_t i = 0; i < mapping->num_segments; i++) {
+        const SegmentOrigin* origin = &mapping->origins[i];
+
+        if(origin->first == origin->last) {
+            printf("Segment #%zu: original segment #%zu, from %.2f m\n", i, origin->first, origin->offset);
+        } else {
+            printf("Segment #%zu: original segments #%zu to #%zu, from %.2f m\n", i, origin->first, origin->last, origin->offset);
+        }
+    }
+}
+
+/*
+ * api-method
+ */
+void free_route_mapping(RouteMapping* mapping) {
+    free(mapping->origins); mapping->origins = NULL;
+    mapping->num_segments = 0;
+}
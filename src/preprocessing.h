@@ -0,0 +1,80 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#ifndef TEGA_PREPROCESSING_H
+#define TEGA_PREPROCESSING_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "instance.h"
+
+/**
+ * Parameters of the route preprocessing.
+ */
+typedef struct PreprocessingParams {
+    /**
+     * Merge runs of adjacent non-station segments with the same slope, curve, and speed
+     * limit. A segment with an arrival time can only be the last of a run. A run stops
+     * before it gets longer than max_segment_length or, if that is 0, than the longest
+     * original segment, so that merging never makes the look-up tables longer.
+     */
+    bool merge;
+
+    /**
+     * Split segments longer than this length [m] into parts of whole distance steps, as equal
+     * as possible; the last part also takes the remainder beyond the last step (0 means never
+     * split).
+     */
+    float max_segment_length;
+} PreprocessingParams;
+
+/**
+ * Where a preprocessed segment comes from, in the original instance.
+ */
+typedef struct SegmentOrigin {
+    size_t  first;      // Index of the first original segment covered
+    size_t  last;       // Index of the last original segment covered (at least partially)
+    float   offset;     // Position where the segment starts, within the first original one [m]
+} SegmentOrigin;
+
+/**
+ * Mapping from the segments of a preprocessed instance back to the original ones.
+ */
+typedef struct RouteMapping {
+    SegmentOrigin*  origins;        // Origin of each preprocessed segment
+    size_t          num_segments;   // Number of preprocessed segments
+} RouteMapping;
+
+/**
+ * Gives parameters that merge equivalent segments, up to the longest original segment, and
+ * never split.
+ * @return  The default parameters
+ */
+PreprocessingParams default_preprocessing_params(void);
+
+/**
+ * Builds a new instance merging and splitting the segments of an instance.
+ * Segments of the new instance have progressive ids.
+ * @param instance  The original instance
+ * @param params    The preprocessing parameters
+ * @param mapping   Filled with the mapping to the original segments (to be freed with free_route_mapping)
+ * @param error     Filled if there is not enough memory (can be NULL)
+ * @return          The new instance, or one without segments on error
+ */
+Instance preprocess_instance(const Instance* instance, const PreprocessingParams* params, RouteMapping* mapping, TegaError* error);
+
+/**
+ * Prints which original segments each preprocessed segment covers, so that the segment ids
+ * printed for a solution of the preprocessed instance can be traced back to the route.
+ * @param mapping   The mapping
+ */
+void print_route_mapping(const RouteMapping* mapping);
+
+/**
+ * Frees the memory used by a route mapping.
+ * @param mapping   The mapping
+ */
+void free_route_mapping(RouteMapping* mapping);
+
+#endif //TEGA_PREPROCESSING_H
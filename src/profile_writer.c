@@ -0,0 +1,233 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#include "profile_writer.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <memory.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <assert.h>
+
+/*
+ * Room reserved for a CSV row [bytes]: enough for any real run. Rows with huge or
+ * non-finite values can be longer, and are formatted on the heap.
+ */
+#define PROFILE_CSV_MAX_ROW 256
+
+/*
+ * implementation-method
+ */
+static bool write_all(int fd, const char* data, size_t sz) {
+    while(sz > 0) {
+        ssize_t written = write(fd, data, sz);
+
+        if(written < 0) {
+            if(errno == EINTR) { continue; }
+            return false;
+        }
+
+        data += written;
+        sz -= (size_t) written;
+    }
+
+    return true;
+}
+
+/*
+ * implementation-method
+ *
+ * Makes room for at least sz bytes in the buffer.
+ */
+static bool reserve(ProfileWriter* writer, size_t sz) {
+    if(writer->error) { return false; }
+    if(writer->buffer_sz - writer->used >= sz) { return true; }
+
+    return flush_profile_writer(writer);
+}
+
+/*
+ * implementation-method
+ *
+ * Data larger than the whole buffer is written out directly, after what is buffered.
+ */
+static void append(ProfileWriter* writer, const void* data, size_t sz) {
+    if(!reserve(writer, sz)) { return; }
+
+    if(sz > writer->buffer_sz - writer->used) {
+        if(!write_all(writer->fd, data, sz)) { writer->error = true; }
+        return;
+    }
+
+    memcpy(writer->buffer + writer->used, data, sz);
+    writer->used += sz;
+}
+
+/*
+ * implementation-method
+ *
+ * Formats a row straight into the buffer; a row longer than PROFILE_CSV_MAX_ROW is formatted
+ * again into a buffer of its own size, and appended from there.
+ */
+static void append_csv_row(ProfileWriter* writer, const char* format, ...) {
+    if(!reserve(writer, PROFILE_CSV_MAX_ROW)) { return; }
+
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(writer->buffer + writer->used, PROFILE_CSV_MAX_ROW, format, args);
+    va_end(args);
+
+    if(len < 0) {
+        writer->error = true;
+        return;
+    }
+
+    if(len < PROFILE_CSV_MAX_ROW) {
+        writer->used += (size_t) len;
+        return;
+    }
+
+    char* row = malloc((size_t) len + 1);
+
+    if(row == NULL) {
+        writer->error = true;
+        return;
+    }
+
+    va_start(args, format);
+    vsnprintf(row, (size_t) len + 1, format, args);
+    va_end(args);
+
+    append(writer, row, (size_t) len);
+    free(row);
+}
+
+/*
+ * api-method
+ */
+ProfileWriter new_profile_writer(int fd, ProfileFormat format, size_t buffer_sz, TegaError* error) {
+    if(buffer_sz < PROFILE_CSV_MAX_ROW) { buffer_sz = PROFILE_WRITER_BUFFER_SZ; }
+
+    ProfileWriter writer = {
+        .fd = fd,
+        .format = format,
+        .buffer = malloc(buffer_sz),
+        .buffer_sz = buffer_sz,
+        .used = 0,
+        .error = false
+    };
+
+    // A writer without a buffer is already failed, and ignores all writes
+    if(writer.buffer == NULL) {
+        writer.error = true;
+        set_error(error, TEGA_ERROR_OUT_OF_MEMORY, "Could not allocate memory for the profile writer");
+        return writer;
+    }
+
+    if(format == PROFILE_CSV) {
+        const char* header = "run,segment,phase,start_position,end_position,start_time,end_time,start_speed,end_speed,acceleration,energy\n";
+        append(&writer, header, strlen(header));
+    } else {
+        uint32_t version = PROFILE_BINARY_VERSION;
+        uint32_t record_sz = sizeof(ProfileRecord);
+
+        append(&writer, PROFILE_BINARY_MAGIC, strlen(PROFILE_BINARY_MAGIC));
+        append(&writer, &version, sizeof(version));
+        append(&writer, &record_sz, sizeof(record_sz));
+    }
+
+    return writer;
+}
+
+/*
+ * api-method
+ */
+bool write_segment_run(ProfileWriter* writer, const Instance* instance, size_t run_id, size_t segment, const SegmentRun* run) {
+    assert(segment < instance->num_segments);
+
+    // An invalid run has no profile, only -1 everywhere
+    if(!is_valid_run(run)) { return !writer->error; }
+
+    float offset = instance->segments[segment].start_x;
+
+    for(size_t phase = 0; phase < DRIVING_PHASES; phase++) {
+        if(writer->format == PROFILE_CSV) {
+            append_csv_row(writer, "%zu,%zu,%zu,%.2f,%.2f,%.3f,%.3f,%.3f,%.3f,%.4f,%.3f\n",
+                run_id, segment, phase,
+                offset + run->start_positions[phase], offset + run->end_positions[phase],
+                run->start_times[phase], run->end_times[phase],
+                run->start_speeds[phase], run->end_speeds[phase],
+                run->accelerations[phase], run->energies[phase]);
+        } else {
+            ProfileRecord record = {
+                .run = (uint32_t) run_id,
+                .segment = (uint32_t) segment,
+                .phase = (uint32_t) phase,
+                .start_position = offset + run->start_positions[phase],
+                .end_position = offset + run->end_positions[phase],
+                .start_time = run->start_times[phase],
+                .end_time = run->end_times[phase],
+                .start_speed = run->start_speeds[phase],
+                .end_speed = run->end_speeds[phase],
+                .acceleration = run->accelerations[phase],
+                .energy = run->energies[phase]
+            };
+
+            append(writer, &record, sizeof(record));
+        }
+    }
+
+    return !writer->error;
+}
+
+/*
+ * api-method
+ */
+bool write_individual_profile(ProfileWriter* writer, const Instance* instance, const Lookup* lt, const Individual* individual, size_t run_id) {
+    for(size_t i = 0; i < individual->num_segments && !writer->error; i++) {
+        const SwitchingPoints* genes = &individual->genes[i];
+
+        EvaluationInput input = {
+            .segment_id = i,
+            .x1 = genes->x1,
+            .x2 = genes->x2,
+            .x3 = genes->x3,
+            .e_speed = individual->entry_speeds[i],
+            .e_time = individual->entry_times[i]
+        };
+
+        SegmentRun run = run_on_segment(instance, lt, &input);
+        write_segment_run(writer, instance, run_id, i, &run);
+    }
+
+    return !writer->error;
+}
+
+/*
+ * api-method
+ */
+bool flush_profile_writer(ProfileWriter* writer) {
+    if(writer->error) { return false; }
+
+    if(!write_all(writer->fd, writer->buffer, writer->used)) {
+        writer->error = true;
+        return false;
+    }
+
+    writer->used = 0;
+    return true;
+}
+
+/*
+ * api-method
+ */
+bool free_profile_writer(ProfileWriter* writer) {
+    bool ok = flush_profile_writer(writer);
+
+    free(writer->buffer);
+    writer->buffer = NULL;
+
+    return ok;
+}
@@ -0,0 +1,114 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#ifndef TEGA_PROFILE_WRITER_H
+#define TEGA_PROFILE_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "instance.h"
+#include "lookup.h"
+#include "individual.h"
+#include "segment_evaluation.h"
+
+/*
+ * Binary profiles start with this magic string (without null terminator), followed by a
+ * 32-bit version and a 32-bit record size, and then by ProfileRecords.
+ */
+#define PROFILE_BINARY_MAGIC    "TEGAPROF"
+#define PROFILE_BINARY_VERSION  1
+
+/*
+ * Default size of the output buffer [bytes].
+ */
+#define PROFILE_WRITER_BUFFER_SZ (1 << 20)
+
+/**
+ * Output formats of the profile writer.
+ */
+typedef enum ProfileFormat {
+    PROFILE_CSV = 0,
+    PROFILE_BINARY = 1
+} ProfileFormat;
+
+/**
+ * A record of the binary format: one driving phase on one segment.
+ * Positions are absolute (from the beginning of the route).
+ */
+typedef struct ProfileRecord {
+    uint32_t    run;
+    uint32_t    segment;
+    uint32_t    phase;
+    float       start_position;
+    float       end_position;
+    float       start_time;
+    float       end_time;
+    float       start_speed;
+    float       end_speed;
+    float       acceleration;
+    float       energy;
+} ProfileRecord;
+
+/**
+ * Buffered writer of driving profiles to a file descriptor. Each driving phase of each
+ * segment becomes one CSV row or one binary record.
+ */
+typedef struct ProfileWriter {
+    int             fd;         // Output file descriptor (not owned by the writer)
+    ProfileFormat   format;     // Output format
+    char*           buffer;     // Output buffer
+    size_t          buffer_sz;  // Size of the buffer
+    size_t          used;       // Bytes in the buffer not yet written
+    bool            error;      // Set when a write fails; further writes are ignored
+} ProfileWriter;
+
+/**
+ * Creates a writer and writes the CSV header or binary preamble.
+ * @param fd        The output file descriptor
+ * @param format    The output format
+ * @param buffer_sz Size of the output buffer (0 means PROFILE_WRITER_BUFFER_SZ)
+ * @param error     Filled if there is not enough memory for the buffer (can be NULL)
+ * @return          The writer, already in the error state if it could not be created
+ */
+ProfileWriter new_profile_writer(int fd, ProfileFormat format, size_t buffer_sz, TegaError* error);
+
+/**
+ * Writes the four phases of a run on a segment. Invalid runs (see is_valid_run) are skipped.
+ * @param writer    The writer
+ * @param instance  The instance
+ * @param run_id    Identifier of the run (e.g. the index of the solution), written with each phase
+ * @param segment   The segment
+ * @param run       The run on the segment
+ * @return          False if writing failed
+ */
+bool write_segment_run(ProfileWriter* writer, const Instance* instance, size_t run_id, size_t segment, const SegmentRun* run);
+
+/**
+ * Simulates the route driven by an individual, streaming each segment as soon as it is
+ * evaluated. Segments whose run is invalid are left out.
+ * @param writer        The writer
+ * @param instance      The instance
+ * @param lt            The look-up tables
+ * @param individual    The (evaluated) individual
+ * @param run_id        Identifier of the run
+ * @return              False if writing failed
+ */
+bool write_individual_profile(ProfileWriter* writer, const Instance* instance, const Lookup* lt, const Individual* individual, size_t run_id);
+
+/**
+ * Writes out the content of the buffer.
+ * @param writer    The writer
+ * @return          False if writing failed
+ */
+bool flush_profile_writer(ProfileWriter* writer);
+
+/**
+ * Flushes the writer and frees its memory. The file descriptor is not closed.
+ * @param writer    The writer
+ * @return          False if writing failed at any point
+ */
+bool free_profile_writer(ProfileWriter* writer);
+
+#endif //TEGA_PROFILE_WRITER_H
@@ -0,0 +1,125 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#include "rolling_horizon.h"
+#include "eps.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <memory.h>
+#include <assert.h>
+
+/*
+ * implementation-method
+ *
+ * Shifts a switching point of the first segment, so that it is measured from the train's
+ * position, clamping it to the remaining part of the segment.
+ */
+static size_t shift_switching_point(size_t x, size_t offset, size_t steps) {
+    size_t shifted = (x > offset) ? x - offset : 0;
+    return (shifted > steps) ? steps : shifted;
+}
+
+/*
+ * api-method
+ */
+RollingHorizonResult reoptimise_from_state(const Instance* instance, const Lookup* lt, const Individual* previous, const RouteState* state, size_t horizon, const GeneticParams* params, TegaError* error) {
+    RollingHorizonResult result = {
+        .solver = {.best = {.genes = NULL, .entry_speeds = NULL, .entry_times = NULL, .costs = NULL, .deviations = NULL, .energies = NULL, .violations = NULL, .num_segments = 0}, .trace = NULL, .trace_n = 0},
+        .first_segment = 0,
+        .num_segments = 0
+    };
+
+    if(state->segment >= instance->num_segments || !(state->position >= 0) || !(state->speed >= 0)) {
+        set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "Invalid route state: segment %zu of %zu, position %f, speed %f", state->segment, instance->num_segments, state->position, state->speed);
+        return result;
+    }
+
+    if(previous != NULL && previous->num_segments != instance->num_segments) {
+        set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "The previous solution has %zu segments, but the instance has %zu", previous->num_segments, instance->num_segments);
+        return result;
+    }
+
+    size_t first = state->segment;
+    float position = state->position;
+
+    // A train at the end of a segment is at the beginning of the next one
+    if(position >= instance->segments[first].length - SEGMENT_LENGTH_EPS && first + 1 < instance->num_segments) {
+        first++;
+        position = 0;
+    }
+
+    size_t remaining = instance->num_segments - first;
+    size_t n = (horizon == 0 || horizon > remaining) ? remaining : horizon;
+
+    Segment* segments = malloc(n * sizeof(*segments));
+
+    if(segments == NULL && n > 0) {
+        set_error(error, TEGA_ERROR_OUT_OF_MEMORY, "Could not allocate memory for the segments");
+        return result;
+    }
+
+    memcpy(segments, instance->segments + first, n * sizeof(*segments));
+
+    // Segments are uniform, so running on the rest of the first one is like running on a
+    // shorter segment, and the tables built for the whole segment are still valid
+    if(position > 0) {
+        segments[0].length -= position;
+        segments[0].start_x += position;
+        if(segments[0].length < 0) { segments[0].length = 0; }
+    }
+
+    Instance window = {
+        .segments = segments,
+        .train = instance->train,
+        .num_segments = n,
+        .start_speed = state->speed,
+        .start_time = state->time
+    };
+    Lookup view = lookup_view(lt, first);
+    Lookup screening_view;
+    GeneticParams window_params = *params;
+    Individual warm_start = {.genes = NULL};
+
+    if(previous != NULL) {
+        warm_start = new_individual(&window, error);
+
+        if(warm_start.entry_speeds == NULL) {
+            free(segments);
+            return result;
+        }
+
+        memcpy(warm_start.genes, previous->genes + first, n * sizeof(*warm_start.genes));
+
+        size_t offset = (size_t) (position / DISTANCE_STEP);
+        size_t steps = get_distance_steps(&segments[0]);
+        SwitchingPoints* sp = &warm_start.genes[0];
+
+        sp->x1 = shift_switching_point(sp->x1, offset, steps);
+        sp->x2 = shift_switching_point(sp->x2, offset, steps);
+        sp->x3 = shift_switching_point(sp->x3, offset, steps);
+
+        window_params.warm_start = &warm_start;
+    }
+
+    if(params->screening_lookup != NULL) {
+        screening_view = lookup_view(params->screening_lookup, first);
+        window_params.screening_lookup = &screening_view;
+    }
+
+    result.solver = run_genetic_algorithm(&window, &view, &window_params, error);
+    result.first_segment = first;
+    result.num_segments = n;
+
+    if(previous != NULL) { free_individual(&warm_start); }
+    free(segments);
+
+    return result;
+}
+
+/*
+ * api-method
+ */
+void free_rolling_horizon_result(RollingHorizonResult* result) {
+    free_solver_result(&result->solver);
+}
@@ -0,0 +1,58 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#ifndef TEGA_ROLLING_HORIZON_H
+#define TEGA_ROLLING_HORIZON_H
+
+#include <stddef.h>
+#include "instance.h"
+#include "lookup.h"
+#include "individual.h"
+#include "genetic.h"
+
+/**
+ * State of the train somewhere along the route.
+ */
+typedef struct RouteState {
+    size_t  segment;    // Segment the train is on
+    float   position;   // Distance from the beginning of the segment [m]
+    float   speed;      // Current speed [m/s]
+    float   time;       // Current clock [s]
+} RouteState;
+
+/**
+ * Result of a re-optimisation of the remainder of the route.
+ *
+ * The best individual of the solver result covers only the segments in the horizon, i.e.
+ * its gene i refers to segment first_segment + i of the original instance. The switching
+ * points of its first segment are measured from the position of the train, not from the
+ * beginning of the segment.
+ */
+typedef struct RollingHorizonResult {
+    SolverResult    solver;
+    size_t          first_segment;
+    size_t          num_segments;
+} RollingHorizonResult;
+
+/**
+ * Re-optimises the driving profile from a state in the middle of the route, reusing the
+ * lookup tables already built for the whole instance.
+ * @param instance  The whole instance
+ * @param lt        The lookup tables for the whole instance
+ * @param previous  The previous solution for the whole instance, used as a warm start (can be NULL)
+ * @param state     The current state of the train
+ * @param horizon   Number of segments to optimise (0 means up to the end of the route)
+ * @param params    Parameters of the genetic algorithm (the warm start is set here)
+ * @param error     Filled if the state is not on the route or the solver fails (can be NULL)
+ * @return          The result, to be freed with free_rolling_horizon_result
+ */
+RollingHorizonResult reoptimise_from_state(const Instance* instance, const Lookup* lt, const Individual* previous, const RouteState* state, size_t horizon, const GeneticParams* params, TegaError* error);
+
+/**
+ * Frees the memory used by a rolling horizon result.
+ * @param result    The result
+ */
+void free_rolling_horizon_result(RollingHorizonResult* result);
+
+#endif //TEGA_ROLLING_HORIZON_H
@@ -5,6 +5,7 @@
 #include "segment.h"
 #include <stdio.h>
 #include <inttypes.h>
+#include <math.h>
 
 /*
  * api-method
@@ -25,4 +26,31 @@ void print_segment(const Segment* segment) {
     printf("\tSlope: %.2f rad\n", segment->slope);
     printf("\tCurve radius: %.2f m\n", segment->curve);
     printf("\tSpeed limit: %.2f m/s\n", segment->speed_limit);
-}
\ No newline at end of file
+}
+
+/*
+ * api-method
+ *
+ * Comparisons are written so that NaNs fail.
+ */
+bool check_segment(const Segment* segment, const char *const filename, TegaError* error) {
+    if(segment->is_station) {
+        if(!(segment->arrival_time >= 0) || !(segment->stop_time >= 0) || !isfinite(segment->arrival_time) || !isfinite(segment->stop_time)) {
+            return set_error(error, TEGA_ERROR_INVALID_INSTANCE, "Error reading segment #%" PRIuFAST32 " from %s: a station needs a non-negative arrival time and stop time", segment->id, filename);
+        }
+    } else {
+        if(!(segment->length > 0) || !(segment->curve >= 0) || !(segment->speed_limit > 0) || !isfinite(segment->slope) || !isfinite(segment->curve)) {
+            return set_error(error, TEGA_ERROR_INVALID_INSTANCE, "Error reading segment #%" PRIuFAST32 " from %s: length and speed limit must be positive, and the curve non-negative", segment->id, filename);
+        }
+
+        if(!(segment->length <= MAX_SEGMENT_LENGTH) || !(segment->speed_limit <= MAX_SPEED_LIMIT)) {
+            return set_error(error, TEGA_ERROR_INVALID_INSTANCE, "Error reading segment #%" PRIuFAST32 " from %s: length and speed limit must be at most %.0f m and %.0f m/s", segment->id, filename, MAX_SEGMENT_LENGTH, MAX_SPEED_LIMIT);
+        }
+
+        if(segment->has_arrival_time && (!(segment->arrival_time >= 0) || !isfinite(segment->arrival_time))) {
+            return set_error(error, TEGA_ERROR_INVALID_INSTANCE, "Error reading segment #%" PRIuFAST32 " from %s: negative arrival time", segment->id, filename);
+        }
+    }
+
+    return true;
+}
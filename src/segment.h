@@ -7,6 +7,12 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "error.h"
+
+// Longest segment and highest speed limit accepted from a file, far beyond any real track,
+// so that the look-up tables built for them have a size that fits in memory arithmetic
+#define MAX_SEGMENT_LENGTH 1e6f
+#define MAX_SPEED_LIMIT 200.0f
 
 /**
  * Representation of a uniform segment of track.
@@ -31,4 +37,16 @@ typedef struct Segment {
  */
 void print_segment(const Segment* segment);
 
+/**
+ * Checks the values of a segment read from a file: a station needs a non-negative arrival
+ * and stop time; any other segment a positive, finite length and speed limit (at most
+ * MAX_SEGMENT_LENGTH and MAX_SPEED_LIMIT), a non-negative curve, a finite slope, and a
+ * non-negative arrival time, if it has one. NaNs fail every check.
+ * @param segment   The segment
+ * @param filename  The file it was read from, for the error message
+ * @param error     Filled if the segment is invalid (can be NULL)
+ * @return          True iff the segment is valid
+ */
+bool check_segment(const Segment* segment, const char *const filename, TegaError* error);
+
 #endif //TEGA_SEGMENT_H
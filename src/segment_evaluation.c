@@ -4,52 +4,20 @@
 
 #include <assert.h>
 #include <memory.h>
+#include <math.h>
 #include "segment_evaluation.h"
 #include "lookup.h"
 #include "davis.h"
-
-/*
- * implementation-enum
- *
- * Successive driving phases when driving on a segment.
- */
-typedef enum DrivingPhase {
-    MAX_ACCELERATION = 0,
-    CRUISING = 1,
-    COASTING = 2,
-    MAX_BRAKING = 3
-} DrivingPhase;
-
-/*
- * implementation-struct
- *
- * Describes the run of a train on a segment: switching points, switching times, speeds achieved, accelerations.
- * Notice that a run is always made of four phases, therefore we can use static vectors of size 4.
- */
-typedef struct SegmentRun {
-    float start_positions[DRIVING_PHASES];
-    float end_positions[DRIVING_PHASES];
-    float start_times[DRIVING_PHASES];
-    float end_times[DRIVING_PHASES];
-    float start_speeds[DRIVING_PHASES];
-    float end_speeds[DRIVING_PHASES];
-    float accelerations[DRIVING_PHASES];
-} SegmentRun;
-
-/*
- * implementation method
- */
-static float cruising_acceleration(const Instance* instance, const EvaluationInput* input, float speed) {
-    assert(input->segment_id < instance->num_segments);
-
-    const Segment* seg = &instance->segments[input->segment_id];
-    return - resistance(&instance->train, seg, speed);
-}
+#include "eps.h"
+#include "metrics.h"
+#include "trace.h"
 
 /*
  * implementation-method
  */
 static void invalidate_segment(const Instance* instance, SegmentRun* run, DrivingPhase from) {
+    METRICS_COUNT(COUNTER_INVALID_TABLE_HITS, 1);
+
     const float invalid[DRIVING_PHASES] = {-1.0f, -1.0f, -1.0f, -1.0f};
     memcpy(run->start_positions, invalid, sizeof(invalid));
     memcpy(run->end_positions, invalid, sizeof(invalid));
@@ -58,19 +26,24 @@ static void invalidate_segment(const Instance* instance, SegmentRun* run, Drivin
     memcpy(run->start_speeds, invalid, sizeof(invalid));
     memcpy(run->end_speeds, invalid, sizeof(invalid));
     memcpy(run->accelerations, invalid, sizeof(invalid));
+    memcpy(run->energies, invalid, sizeof(invalid));
 }
 
 /*
- * implementation-method
+ * api-method
  */
-static SegmentRun run_on_segment(const Instance* instance, const Lookup* lt, const EvaluationInput* input) {
+SegmentRun run_on_segment(const Instance* instance, const Lookup* lt, const EvaluationInput* input) {
     assert(input->segment_id < instance->num_segments);
 
+    METRICS_COUNT(COUNTER_SEGMENT_EVALUATIONS, 1);
+    TRACE_EVALUATION(input);
+
     const Segment* seg = &instance->segments[input->segment_id];
+    size_t distance_steps = get_distance_steps(seg);
 
     assert(input->x1 <= input->x2);
     assert(input->x2 <= input->x3);
-    assert(input->x3 <= seg->length / DISTANCE_STEP);
+    assert(input->x3 <= distance_steps);
 
     SegmentRun run;
 
@@ -80,57 +53,104 @@ static SegmentRun run_on_segment(const Instance* instance, const Lookup* lt, con
     run.start_times[MAX_ACCELERATION] = input->e_time;
     run.accelerations[MAX_ACCELERATION] = instance->train.max_acceleration;
 
-    size_t ma_start_speed_index = input->e_speed / SPEED_STEP;
+    size_t ma_start_speed_index = get_speed_index(input->e_speed);
     size_t ma_distance_index = input->x1;
 
+    if(ma_start_speed_index >= lt->speeds_n) {
+        invalidate_segment(instance, &run, MAX_ACCELERATION);
+        return run;
+    }
+
     float ma_end_speed = get_max_acceleration_speed(lt, input->segment_id, ma_start_speed_index, ma_distance_index);
     float ma_end_pos = get_max_acceleration_position(lt, input->segment_id, ma_start_speed_index, ma_distance_index);
-    float ma_end_time = get_max_acceleration_time(lt, input->segment_id, input->e_speed, ma_distance_index);
+    float ma_end_time = input->e_time + get_max_acceleration_time(lt, input->segment_id, ma_start_speed_index, ma_distance_index);
+
+    if(ma_end_speed < 0) {
+        invalidate_segment(instance, &run, MAX_ACCELERATION);
+        return run;
+    }
 
     run.end_speeds[MAX_ACCELERATION] = run.start_speeds[CRUISING] = ma_end_speed;
     run.end_positions[MAX_ACCELERATION] = run.start_positions[CRUISING] = ma_end_pos;
     run.end_times[MAX_ACCELERATION] = run.start_times[CRUISING] = ma_end_time;
+    run.energies[MAX_ACCELERATION] = instance->train.max_acceleration * ma_end_pos;
 
     // 2) Cruising phase
-    size_t cr_start_speed_index = ma_end_speed / SPEED_STEP;
+    size_t cr_start_speed_index = get_speed_index(ma_end_speed);
     size_t cr_distance_index = input->x2 - input->x1;
 
-    float cr_start_speed = ma_end_speed;
-    float cr_acceleration = cruising_acceleration(instance, input, cr_start_speed);
+    if(cr_start_speed_index >= lt->speeds_n) {
+        invalidate_segment(instance, &run, CRUISING);
+        return run;
+    }
 
-    run.accelerations[CRUISING] = cr_acceleration;
+    // The acceleration compensating the resistance is the traction energy per metre
+    float cr_energy_per_metre = get_cruising_energy_per_metre(lt, input->segment_id, cr_start_speed_index);
+
+    run.accelerations[CRUISING] = cr_energy_per_metre;
 
     float cr_end_speed = get_cruising_speed(cr_start_speed_index, cr_distance_index);
-    float cr_end_pos = ma_end_pos + get_cruising_position(cr_start_speed_index, cr_distance_index);
-    float cr_end_time = get_cruising_time(cr_start_speed_index, cr_distance_index);
+    float cr_end_pos = ma_end_pos;
+    float cr_end_time = ma_end_time;
+
+    // A train standing still cannot cruise: it stays where it is
+    if(cr_distance_index > 0 && cr_start_speed_index > 0) {
+        cr_end_pos += get_cruising_position(cr_start_speed_index, cr_distance_index);
+        cr_end_time += get_cruising_time(cr_start_speed_index, cr_distance_index);
+    }
 
     run.end_speeds[CRUISING] = run.start_speeds[COASTING] = cr_end_speed;
     run.end_positions[CRUISING] = run.start_positions[COASTING] = cr_end_pos;
     run.end_times[CRUISING] = run.start_times[COASTING] = cr_end_time;
 
+    // When going downhill the train must brake, and no traction energy is spent
+    run.energies[CRUISING] = (cr_energy_per_metre > 0) ? cr_energy_per_metre * (cr_end_pos - ma_end_pos) : 0;
+
     // 3) Coasting phase
-    size_t co_start_speed_index = cr_end_speed / SPEED_STEP;
+    size_t co_start_speed_index = get_speed_index(cr_end_speed);
     size_t co_distance_index = input->x3 - input->x2;
 
     run.accelerations[COASTING] = 0;
+    run.energies[COASTING] = 0;
+
+    if(co_start_speed_index >= lt->speeds_n) {
+        invalidate_segment(instance, &run, COASTING);
+        return run;
+    }
 
     float co_end_speed = get_coasting_speed(lt, input->segment_id, co_start_speed_index, co_distance_index);
     float co_end_pos = cr_end_pos + get_coasting_position(lt, input->segment_id, co_start_speed_index, co_distance_index);
-    float co_end_time = get_coasting_time(lt, input->segment_id, co_start_speed_index, co_distance_index);
+    float co_end_time = cr_end_time + get_coasting_time(lt, input->segment_id, co_start_speed_index, co_distance_index);
+
+    if(co_end_speed < 0) {
+        invalidate_segment(instance, &run, COASTING);
+        return run;
+    }
 
     run.end_speeds[COASTING] = run.start_speeds[MAX_BRAKING] = co_end_speed;
     run.end_positions[COASTING] = run.start_positions[MAX_BRAKING] = co_end_pos;
     run.end_times[COASTING] = run.start_times[MAX_BRAKING] = co_end_time;
 
     // 4) Max-braking phase
-    size_t mb_start_speed_index = co_end_speed / SPEED_STEP;
-    size_t mb_distance_index = (instance->segments[input->segment_id].length / SPEED_STEP) - input->x3;
+    size_t mb_start_speed_index = get_speed_index(co_end_speed);
+    size_t mb_distance_index = distance_steps - input->x3;
 
     run.accelerations[MAX_BRAKING] = -instance->train.max_braking;
+    run.energies[MAX_BRAKING] = 0;
+
+    if(mb_start_speed_index >= lt->speeds_n) {
+        invalidate_segment(instance, &run, MAX_BRAKING);
+        return run;
+    }
 
     float mb_end_speed = get_max_braking_speed(lt, input->segment_id, mb_start_speed_index, mb_distance_index);
     float mb_end_pos = co_end_pos + get_max_braking_position(lt, input->segment_id, mb_start_speed_index, mb_distance_index);
-    float mb_end_time = get_max_braking_time(lt, input->segment_id, mb_start_speed_index, mb_distance_index);
+    float mb_end_time = co_end_time + get_max_braking_time(lt, input->segment_id, mb_start_speed_index, mb_distance_index);
+
+    if(mb_end_speed < 0) {
+        invalidate_segment(instance, &run, MAX_BRAKING);
+        return run;
+    }
 
     run.end_speeds[MAX_BRAKING] = mb_end_speed;
     run.end_positions[MAX_BRAKING] = mb_end_pos;
@@ -139,10 +159,111 @@ static SegmentRun run_on_segment(const Instance* instance, const Lookup* lt, con
     return run;
 }
 
+/*
+ * api-method
+ */
+bool is_valid_run(const SegmentRun* run) {
+    return run->end_times[MAX_BRAKING] >= 0;
+}
+
+/*
+ * api-method
+ */
+float arrival_deviation_of_run(const Instance* instance, const EvaluationInput* input, const SegmentRun* run) {
+    assert(input->segment_id < instance->num_segments);
+
+    const Segment* seg = &instance->segments[input->segment_id];
+
+    if(!seg->has_arrival_time || !is_valid_run(run)) { return 0; }
+
+    return fabsf(run->end_times[MAX_BRAKING] - seg->arrival_time);
+}
+
+/*
+ * implementation-method
+ *
+ * Adds the penalties 3a-3c of cost_of_segment for a valid run to cost, in the order in which
+ * cost_of_run adds them.
+ */
+static float add_violation_penalties(const Instance* instance, const EvaluationInput* input, const SegmentRun* run, float cost) {
+    const Segment* seg = &instance->segments[input->segment_id];
+
+    // 3a) Cruising speed exceeds the speed limit at the present segment
+    if(run->end_speeds[CRUISING] > seg->speed_limit) {
+        cost += SPEED_EXCESS_PENALTY * (run->end_speeds[CRUISING] - seg->speed_limit);
+    }
+
+    // 3b) Final speed exceeds the speed limit at the next segment
+    if(input->segment_id + 1 < instance->num_segments) {
+        const Segment* next = &instance->segments[input->segment_id + 1];
+
+        if(run->end_speeds[MAX_BRAKING] > next->speed_limit) {
+            cost += SPEED_EXCESS_PENALTY * (run->end_speeds[MAX_BRAKING] - next->speed_limit);
+        }
+    }
+
+    // 3c) The train stops before the end of the segment, as far as the look-up tables reach
+    float reachable_length = get_distance_steps(seg) * DISTANCE_STEP;
+
+    if(reachable_length - run->end_positions[MAX_BRAKING] > DISTANCE_EPS) {
+        cost += SHORT_RUN_PENALTY * (reachable_length - run->end_positions[MAX_BRAKING]);
+    }
+
+    return cost;
+}
+
+/*
+ * api-method
+ */
+float energy_of_run(const SegmentRun* run) {
+    if(!is_valid_run(run)) { return 0; }
+
+    return run->energies[MAX_ACCELERATION] + run->energies[CRUISING];
+}
+
+/*
+ * api-method
+ */
+float violation_of_run(const Instance* instance, const EvaluationInput* input, const SegmentRun* run) {
+    assert(input->segment_id < instance->num_segments);
+
+    if(!is_valid_run(run)) { return INVALID_RUN_PENALTY; }
+
+    return add_violation_penalties(instance, input, run, 0);
+}
+
+/*
+ * api-method
+ */
+float cost_of_run(const Instance* instance, const EvaluationInput* input, const SegmentRun* run) {
+    assert(input->segment_id < instance->num_segments);
+
+    if(!is_valid_run(run)) { return INVALID_RUN_PENALTY; }
+
+    const Segment* seg = &instance->segments[input->segment_id];
+    float cost = 0;
+
+    // 1) Energy spent at maximum acceleration
+    cost += run->energies[MAX_ACCELERATION];
+
+    // 2) Energy spent at cruising speed
+    cost += run->energies[CRUISING];
+
+    // 3a-c) Speed limits, and runs which stop short
+    cost = add_violation_penalties(instance, input, run, cost);
+
+    // 3d) Arrival time far from the desired one
+    if(seg->has_arrival_time) {
+        cost += RUN_TIME_PENALTY * arrival_deviation_of_run(instance, input, run);
+    }
+
+    return cost;
+}
+
 /*
  * api-method
  */
 float cost_of_segment(const Instance* instance, const Lookup* lt, const EvaluationInput* input) {
-    // TODO
-    return 0.0;
+    SegmentRun run = run_on_segment(instance, lt, input);
+    return cost_of_run(instance, input, &run);
 }
@@ -23,11 +23,45 @@
  */
 #define RUN_TIME_PENALTY        10
 
+/*
+ * Cost assigned to a run that cannot be simulated with the look-up tables (e.g. because the
+ * train enters a driving phase faster than the segment's speed limit).
+ */
+#define INVALID_RUN_PENALTY     1e6
+
 /*
  * Number of driving phases on a segment (max acceleration, crusing, coasting, max braking).
  */
 #define DRIVING_PHASES          4
 
+/**
+ * Successive driving phases when driving on a segment.
+ */
+typedef enum DrivingPhase {
+    MAX_ACCELERATION = 0,
+    CRUISING = 1,
+    COASTING = 2,
+    MAX_BRAKING = 3
+} DrivingPhase;
+
+/**
+ * Describes the run of a train on a segment: switching points, switching times, speeds achieved, accelerations.
+ * Notice that a run is always made of four phases, therefore we can use static vectors of size 4.
+ * Positions are relative to the beginning of the segment, while times are absolute.
+ * Energies are the traction energy spent in each phase [J/kg], derived from the look-up tables.
+ * An invalid run has all its entries set to -1.
+ */
+typedef struct SegmentRun {
+    float start_positions[DRIVING_PHASES];
+    float end_positions[DRIVING_PHASES];
+    float start_times[DRIVING_PHASES];
+    float end_times[DRIVING_PHASES];
+    float start_speeds[DRIVING_PHASES];
+    float end_speeds[DRIVING_PHASES];
+    float accelerations[DRIVING_PHASES];
+    float energies[DRIVING_PHASES];
+} SegmentRun;
+
 /**
  * Data that goes as input to the evaluation and describes the state of the run up to the
  * current segment, and the switching points.
@@ -65,6 +99,70 @@ typedef struct EvaluationInput {
 
 } EvaluationInput;
 
+/**
+ * Simulates the run of the train on a segment, using the look-up tables.
+ *
+ * @param  instance The instance considered
+ * @param  lt       Look-up tables to be used in the calculations
+ * @param  input    Input state used for the simulation
+ * @return          The run, which is invalid if it falls outside the look-up tables
+ */
+SegmentRun run_on_segment(const Instance* instance, const Lookup* lt, const EvaluationInput* input);
+
+/**
+ * Tells whether a run could be simulated with the look-up tables.
+ *
+ * @param  run      The run
+ * @return          True iff the run is valid
+ */
+bool is_valid_run(const SegmentRun* run);
+
+/**
+ * Gives the difference between the time at which a run ends and the desired arrival time at
+ * the end of its segment. It is 0 for segments without a desired arrival time, and for
+ * invalid runs (which are penalised as such by cost_of_run).
+ *
+ * @param  instance The instance considered
+ * @param  input    Input state used for the simulation
+ * @param  run      The run obtained from input
+ * @return          The absolute deviation from the desired arrival time [s]
+ */
+float arrival_deviation_of_run(const Instance* instance, const EvaluationInput* input, const SegmentRun* run);
+
+/**
+ * Gives the traction energy of a run: the energy spent at maximum acceleration and at
+ * cruising speed (items 1 and 2 of cost_of_segment), without any penalty. It is 0 for
+ * invalid runs.
+ *
+ * @param  run      The run
+ * @return          The energy of the run [J/kg]
+ */
+float energy_of_run(const SegmentRun* run);
+
+/**
+ * Gives how far a run is from being drivable: the penalties 3a-3c of cost_of_segment, or
+ * INVALID_RUN_PENALTY for an invalid run. It is 0 iff the run is valid, reaches the end of
+ * its segment and respects the speed limits.
+ *
+ * @param  instance The instance considered
+ * @param  input    Input state used for the simulation
+ * @param  run      The run obtained from input
+ * @return          The constraint violation of the run
+ */
+float violation_of_run(const Instance* instance, const EvaluationInput* input, const SegmentRun* run);
+
+/**
+ * Gives the cost of a run that has already been simulated with run_on_segment.
+ * See cost_of_segment for the components of the cost. Energy is specific to the train's
+ * mass, i.e. it is measured in [J/kg].
+ *
+ * @param  instance The instance considered
+ * @param  input    Input state used for the simulation
+ * @param  run      The run obtained from input
+ * @return          The cost of the run
+ */
+float cost_of_run(const Instance* instance, const EvaluationInput* input, const SegmentRun* run);
+
 /**
  * Gives the cost of driving through a segment with given break points.
  * The cost is given by:
@@ -0,0 +1,330 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#include "solution_cache.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// Length of a cache file path, without the directory
+#define SOLUTION_FILENAME_SZ 64
+
+/**
+ * Header of a cache file. It is followed by num_segments triples of uint32_t switching points.
+ */
+typedef struct SolutionFileHeader {
+    char        magic[8];           // SOLUTION_CACHE_MAGIC, without the null terminator
+    uint32_t    version;            // SOLUTION_CACHE_VERSION
+    uint32_t    feasible;           // 1 if the solution is feasible
+    uint64_t    hash[2];            // Key of the problem
+    uint64_t    num_segments;       // Number of segments
+    double      cost;               // Cost of the solution
+} SolutionFileHeader;
+
+/*
+ * implementation-method
+ *
+ * Adds bytes to the key. The two halves are FNV-1a hashes with different offsets and
+ * primes, so that they are independent.
+ */
+static void hash_bytes(SolutionKey* key, const void* data, size_t sz) {
+    const unsigned char* bytes = data;
+
+    for(size_t i = 0; i < sz; i++) {
+        key->hash[0] = (key->hash[0] ^ bytes[i]) * 0x100000001b3ull;
+        key->hash[1] = (key->hash[1] ^ bytes[i]) * 0x9e3779b97f4a7c15ull;
+    }
+}
+
+/*
+ * implementation-method
+ */
+static void hash_u64(SolutionKey* key, uint64_t value) {
+    unsigned char bytes[8];
+
+    // Always little endian, so that keys do not depend on the platform
+    for(size_t i = 0; i < 8; i++) { bytes[i] = (unsigned char) (value >> (8 * i)); }
+
+    hash_bytes(key, bytes, sizeof(bytes));
+}
+
+/*
+ * implementation-method
+ */
+static void hash_double(SolutionKey* key, double value) {
+    uint64_t bits;
+
+    // -0 and 0 are the same value
+    if(value == 0) { value = 0; }
+
+    memcpy(&bits, &value, sizeof(bits));
+    hash_u64(key, bits);
+}
+
+/*
+ * implementation-method
+ */
+static void solution_filename(char* path, size_t path_sz, const char* directory, const SolutionKey* key) {
+    snprintf(path, path_sz, "%s/%016llx%016llx.sol", directory, (unsigned long long) key->hash[0], (unsigned long long) key->hash[1]);
+}
+
+/*
+ * implementation-method
+ *
+ * Reads the header of the cached solution, if there is one for the key.
+ */
+static bool read_header(FILE* fd, const SolutionKey* key, SolutionFileHeader* header) {
+    return fread(header, sizeof(*header), 1, fd) == 1 &&
+           memcmp(header->magic, SOLUTION_CACHE_MAGIC, sizeof(header->magic)) == 0 &&
+           header->version == SOLUTION_CACHE_VERSION &&
+           header->hash[0] == key->hash[0] &&
+           header->hash[1] == key->hash[1];
+}
+
+/*
+ * api-method
+ */
+SolutionKey solution_key(const Instance* instance, const GeneticParams* params) {
+    SolutionKey key = {.hash = {0xcbf29ce484222325ull, 0x84222325cbf29ce4ull}};
+    const Train* t = &instance->train;
+
+    hash_u64(&key, SOLUTION_CACHE_VERSION);
+
+    // The genes are indices in the tables, which depend on their resolution
+    hash_double(&key, DISTANCE_STEP);
+    hash_double(&key, SPEED_STEP);
+
+    hash_u64(&key, (uint64_t) t->type);
+    hash_u64(&key, (uint64_t) t->num_coaches);
+    hash_double(&key, t->mass);
+    hash_double(&key, t->mass_per_axle);
+    hash_double(&key, t->max_acceleration);
+    hash_double(&key, t->max_braking);
+    hash_double(&key, t->length);
+
+    hash_double(&key, instance->start_speed);
+    hash_double(&key, instance->start_time);
+    hash_u64(&key, instance->num_segments);
+
+    for(size_t i = 0; i < instance->num_segments; i++) {
+        const Segment* s = &instance->segments[i];
+
+        hash_u64(&key, (uint64_t) s->is_station | ((uint64_t) s->has_arrival_time << 1));
+        hash_double(&key, s->is_station ? s->stop_time : 0);
+        hash_double(&key, s->has_arrival_time ? s->arrival_time : 0);
+
+        if(!s->is_station) {
+            hash_double(&key, s->length);
+            hash_double(&key, s->slope);
+            hash_double(&key, s->curve);
+            hash_double(&key, s->speed_limit);
+        }
+    }
+
+    hash_u64(&key, params->population_size);
+    hash_u64(&key, params->num_elites);
+    hash_u64(&key, params->tournament_size);
+    hash_double(&key, params->mutation_probability);
+    hash_u64(&key, params->num_generations);
+    hash_double(&key, params->time_limit);
+    hash_u64(&key, params->stall_generations);
+    hash_double(&key, params->stall_tolerance);
+    hash_u64(&key, params->seed);
+    hash_u64(&key, params->local_search.max_simulated_segments);
+    hash_u64(&key, params->local_search.max_failed_moves);
+    hash_u64(&key, params->screening_lookup != NULL ? params->screening_lookup->distance_stride : 0);
+    hash_double(&key, params->screening_lookup != NULL ? params->promotion_ratio : 0);
+
+    return key;
+}
+
+/*
+ * api-method
+ */
+bool load_cached_solution(const char* directory, const SolutionKey* key, const Instance* instance, Individual* individual, TegaError* error) {
+    char path[strlen(directory) + SOLUTION_FILENAME_SZ];
+    solution_filename(path, sizeof(path), directory, key);
+
+    FILE* fd = fopen(path, "rb");
+
+    if(fd == NULL) { return false; }
+
+    SolutionFileHeader header;
+
+    if(!read_header(fd, key, &header) || header.num_segments != instance->num_segments || individual->num_segments != instance->num_segments) {
+        fclose(fd);
+        return set_error(error, TEGA_ERROR_PARSE, "Error reading %s: not a cached solution for this instance", path);
+    }
+
+    for(size_t i = 0; i < instance->num_segments; i++) {
+        uint32_t x[3];
+        size_t steps = get_distance_steps(&instance->segments[i]);
+
+        if(fread(x, sizeof(x), 1, fd) != 1 || x[0] > x[1] || x[1] > x[2] || x[2] > steps) {
+            fclose(fd);
+            return set_error(error, TEGA_ERROR_PARSE, "Error reading %s: the file is truncated or corrupted", path);
+        }
+
+        individual->genes[i] = (SwitchingPoints) {.x1 = x[0], .x2 = x[1], .x3 = x[2]};
+    }
+
+    fclose(fd);
+
+    return true;
+}
+
+/*
+ * implementation-method
+ *
+ * Writes the solution to path, unless the file there holds one at least as good. The caller
+ * holds the lock of the key, so that the comparison and the rename happen together.
+ */
+static bool replace_if_better(const char* directory, const char* path, const SolutionKey* key, const Individual* individual, bool feasible, TegaError* error) {
+    char temp_path[strlen(directory) + SOLUTION_FILENAME_SZ];
+    SolutionFileHeader header;
+
+    FILE* fd = fopen(path, "rb");
+
+    if(fd != NULL) {
+        struct stat file_stat;
+
+        // A truncated file is replaced, whatever its header says
+        bool better = read_header(fd, key, &header) &&
+                      fstat(fileno(fd), &file_stat) == 0 &&
+                      (size_t) file_stat.st_size == sizeof(header) + header.num_segments * 3 * sizeof(uint32_t) &&
+                      (header.feasible > (uint32_t) feasible || (header.feasible == (uint32_t) feasible && header.cost <= individual->cost));
+        fclose(fd);
+
+        if(better) { return false; }
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SOLUTION_CACHE_MAGIC, sizeof(header.magic));
+    header.version = SOLUTION_CACHE_VERSION;
+    header.feasible = feasible ? 1 : 0;
+    header.hash[0] = key->hash[0];
+    header.hash[1] = key->hash[1];
+    header.num_segments = individual->num_segments;
+    header.cost = individual->cost;
+
+    // Written next to the final file, and renamed over it, so that readers never see half a file
+    snprintf(temp_path, sizeof(temp_path), "%s/.solution.XXXXXX", directory);
+
+    int temp_fd = mkstemp(temp_path);
+
+    // mkstemp creates the file readable by the owner only; other processes sharing the cache must read it
+    if(temp_fd < 0 || fchmod(temp_fd, 0644) != 0 || (fd = fdopen(temp_fd, "wb")) == NULL) {
+        if(temp_fd >= 0) { close(temp_fd); unlink(temp_path); }
+        return set_error(error, TEGA_ERROR_IO, "Cannot write to the solution cache: %s", directory);
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, fd) == 1;
+
+    for(size_t i = 0; ok && i < individual->num_segments; i++) {
+        const SwitchingPoints* sp = &individual->genes[i];
+        uint32_t x[3] = {(uint32_t) sp->x1, (uint32_t) sp->x2, (uint32_t) sp->x3};
+
+        ok = fwrite(x, sizeof(x), 1, fd) == 1;
+    }
+
+    ok = (fclose(fd) == 0) && ok && rename(temp_path, path) == 0;
+
+    if(!ok) {
+        unlink(temp_path);
+        return set_error(error, TEGA_ERROR_IO, "Cannot write to the solution cache: %s", path);
+    }
+
+    return true;
+}
+
+/*
+ * api-method
+ */
+bool store_cached_solution(const char* directory, const SolutionKey* key, const Individual* individual, bool feasible, TegaError* error) {
+    char path[strlen(directory) + SOLUTION_FILENAME_SZ];
+    char lock_path[strlen(directory) + SOLUTION_FILENAME_SZ];
+
+    solution_filename(path, sizeof(path), directory, key);
+    snprintf(lock_path, sizeof(lock_path), "%s.lock", path);
+
+    // The lock file of a key stays: removing it would let two writers lock different files
+    int lock_fd = open(lock_path, O_RDWR | O_CREAT, 0644);
+
+    if(lock_fd < 0 || flock(lock_fd, LOCK_EX) != 0) {
+        if(lock_fd >= 0) { close(lock_fd); }
+        return set_error(error, TEGA_ERROR_IO, "Cannot lock the solution cache: %s", lock_path);
+    }
+
+    bool stored = replace_if_better(directory, path, key, individual, feasible, error);
+
+    close(lock_fd);
+
+    return stored;
+}
+
+/*
+ * api-method
+ */
+SolverResult run_genetic_algorithm_cached(const char* directory, SolutionCachePolicy policy, const Instance* instance, const Lookup* lt, const GeneticParams* params, bool* hit, TegaError* error) {
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    SolutionKey key = solution_key(instance, params);
+    Individual cached = new_individual(instance, error);
+
+    if(cached.entry_speeds == NULL) {
+        return (SolverResult) {.best = cached, .feasible = false, .trace = NULL, .trace_n = 0};
+    }
+
+    bool found = load_cached_solution(directory, &key, instance, &cached, NULL);
+
+    if(hit != NULL) { *hit = found; }
+
+    if(found) {
+        evaluate_individual(instance, lt, &cached);
+
+        bool feasible = is_feasible_individual(instance, lt, &cached);
+
+        if(policy == SOLUTION_CACHE_RETURN && feasible) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+
+            SolverResult result = {
+                .best = cached,
+                .feasible = true,
+                .generations = 0,
+                .evaluations = instance->num_segments,
+                .elapsed_time = (double) (now.tv_sec - start.tv_sec) + 1e-9 * (double) (now.tv_nsec - start.tv_nsec),
+                .trace = malloc(sizeof(ConvergencePoint)),
+                .trace_n = 1
+            };
+
+            if(result.trace == NULL) {
+                result.trace_n = 0;
+            } else {
+                result.trace[0] = (ConvergencePoint) {.time = result.elapsed_time, .evaluations = result.evaluations, .best_cost = cached.cost};
+            }
+
+            return result;
+        }
+    }
+
+    GeneticParams cached_params = *params;
+
+    if(found) { cached_params.warm_start = &cached; }
+
+    SolverResult result = run_genetic_algorithm(instance, lt, &cached_params, error);
+
+    free_individual(&cached);
+
+    if(result.best.entry_speeds != NULL) {
+        store_cached_solution(directory, &key, &result.best, result.feasible, NULL);
+    }
+
+    return result;
+}
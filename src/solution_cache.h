@@ -0,0 +1,89 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#ifndef TEGA_SOLUTION_CACHE_H
+#define TEGA_SOLUTION_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "instance.h"
+#include "lookup.h"
+#include "genetic.h"
+
+/*
+ * On-disk store of the best known solutions, addressed by the content of the problem.
+ *
+ * Each solution is a file in a directory, named after a 128-bit hash of the instance (train,
+ * physics of the segments, arrival and stop times, start state), of the table resolution,
+ * and of the solver settings. Segment ids and coordinates are not part of the key, so the
+ * same route saved by different tools is recognised. Files are replaced atomically, and
+ * only by a better solution, so that several processes can share a directory: writers of a
+ * key take an flock on its lock file (the solution file name with .lock appended) around the
+ * comparison and the rename.
+ */
+#define SOLUTION_CACHE_MAGIC    "TEGASOLN"
+#define SOLUTION_CACHE_VERSION  1
+
+/**
+ * Hash of a problem.
+ */
+typedef struct SolutionKey {
+    uint64_t    hash[2];
+} SolutionKey;
+
+/**
+ * How a solution found in the cache is used.
+ */
+typedef enum SolutionCachePolicy {
+    SOLUTION_CACHE_RETURN = 0,      // Return a cached feasible solution without searching (warm start otherwise)
+    SOLUTION_CACHE_WARM_START       // Always search, seeding the population with the cached solution
+} SolutionCachePolicy;
+
+/**
+ * Computes the key of a problem.
+ * @param instance  The instance
+ * @param params    The solver settings (the warm start is ignored)
+ * @return          The key
+ */
+SolutionKey solution_key(const Instance* instance, const GeneticParams* params);
+
+/**
+ * Reads a solution from the cache.
+ * @param directory     The cache directory
+ * @param key           The key of the problem
+ * @param instance      The instance, to check that the switching points are valid
+ * @param individual    Allocated with new_individual; its genes are set if the solution is found
+ * @param error         Filled if the file exists but cannot be read or does not match (can be NULL)
+ * @return              True if the solution was found
+ */
+bool load_cached_solution(const char* directory, const SolutionKey* key, const Instance* instance, Individual* individual, TegaError* error);
+
+/**
+ * Stores a solution in the cache, unless the cached one is at least as good (a feasible
+ * solution is better than an infeasible one, whatever the cost).
+ * @param directory     The cache directory, which must exist
+ * @param key           The key of the problem
+ * @param individual    The (evaluated) solution
+ * @param feasible      Whether it is feasible
+ * @param error         Filled if the file cannot be written (can be NULL)
+ * @return              True if the solution was stored
+ */
+bool store_cached_solution(const char* directory, const SolutionKey* key, const Individual* individual, bool feasible, TegaError* error);
+
+/**
+ * Runs the genetic algorithm through the cache: a cached solution is used according to the
+ * policy, and the result is stored back if it improves on it.
+ * @param directory     The cache directory, which must exist
+ * @param policy        How to use a cached solution
+ * @param instance      The instance
+ * @param lt            The look-up tables
+ * @param params        The parameters of the algorithm (the warm start is replaced by a cached solution)
+ * @param hit           Set to whether a cached solution was found (can be NULL)
+ * @param error         Filled if the solver fails (can be NULL). Cache errors are not fatal:
+ *                      the search runs as if the solution was not cached.
+ * @return              The result, to be freed with free_solver_result
+ */
+SolverResult run_genetic_algorithm_cached(const char* directory, SolutionCachePolicy policy, const Instance* instance, const Lookup* lt, const GeneticParams* params, bool* hit, TegaError* error);
+
+#endif //TEGA_SOLUTION_CACHE_H
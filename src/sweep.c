@@ -0,0 +1,230 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#include "sweep.h"
+#include "lookup.h"
+#include "davis.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Joules in a kilowatt-hour
+#define JOULES_PER_KWH 3.6e6
+
+/*
+ * implementation-method
+ */
+static double seconds_since(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (double) (now.tv_sec - start->tv_sec) + 1e-9 * (double) (now.tv_nsec - start->tv_nsec);
+}
+
+/*
+ * implementation-method
+ *
+ * Besides is_valid_train, the type must be known, and Sauthoff's formula needs coaches.
+ */
+static bool check_sweep_train(const Train* train, size_t index, TegaError* error) {
+    bool db = (train->type == DB_ICE || train->type == DB_NORMAL);
+
+    if(!is_valid_train(train) || train_type_name(train->type) == NULL || (db && train->num_coaches == 0)) {
+        return set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "Train #%zu of the sweep is not valid: its type must be known, its characteristics positive, and the mass per axle less than the mass", index);
+    }
+
+    return true;
+}
+
+/*
+ * implementation-method
+ *
+ * Trains whose tables are built at the same time.
+ */
+static size_t sweep_batch_size(size_t trains_n) {
+#ifdef _OPENMP
+    size_t threads = (size_t) omp_get_max_threads();
+
+    if(trains_n >= threads) { return threads; }
+#endif
+
+    return 1;
+}
+
+/*
+ * implementation-method
+ *
+ * Stores the solution of a train, which the entry takes over.
+ */
+static void fill_sweep_entry(SweepEntry* entry, const Instance* instance, SolverResult* solved) {
+    entry->best = solved->best;
+    entry->feasible = solved->feasible;
+    entry->objectives = individual_objectives(&solved->best);
+    // Penalties are not energy: they are reported as the violation
+    entry->energy_kwh = entry->objectives.energy * instance->train.mass / JOULES_PER_KWH;
+    entry->running_time = solved->best.entry_times[instance->num_segments] - instance->start_time;
+    entry->solve_time = solved->elapsed_time;
+
+    solved->best = (Individual) {.genes = NULL, .entry_speeds = NULL, .entry_times = NULL, .costs = NULL, .deviations = NULL, .energies = NULL, .violations = NULL, .num_segments = 0};
+    free_solver_result(solved);
+}
+
+/*
+ * api-method
+ */
+SweepResult run_train_sweep(const Instance* route, const Train* trains, size_t trains_n, const GeneticParams* params, TegaError* error) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    SweepResult result = {
+        .entries = NULL,
+        .entries_n = 0,
+        .num_segments = route->num_segments,
+        .shared_time = 0,
+        .elapsed_time = 0
+    };
+
+    if(trains_n == 0) {
+        set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "There are no trains to sweep");
+        return result;
+    }
+
+    for(size_t t = 0; t < trains_n; t++) {
+        if(!check_sweep_train(&trains[t], t, error)) { return result; }
+    }
+
+    size_t batch_n = sweep_batch_size(trains_n);
+    SweepEntry* entries = calloc(trains_n, sizeof(*entries));
+    TrackResistance* tracks = malloc((route->num_segments > 0 ? route->num_segments : 1) * sizeof(*tracks));
+    Instance* variants = malloc(batch_n * sizeof(*variants));
+    Lookup* lookups = calloc(batch_n, sizeof(*lookups));
+    TegaError* errors = malloc(batch_n * sizeof(*errors));
+
+    bool ok = (entries != NULL && tracks != NULL && variants != NULL && lookups != NULL && errors != NULL);
+
+    if(!ok) {
+        set_error(error, TEGA_ERROR_OUT_OF_MEMORY, "Could not allocate memory for a sweep of %zu trains", trains_n);
+    } else {
+        struct timespec shared_start;
+        clock_gettime(CLOCK_MONOTONIC, &shared_start);
+
+        #pragma omp parallel for schedule(static)
+        for(size_t i = 0; i < route->num_segments; i++) {
+            tracks[i] = track_resistance(&route->segments[i]);
+        }
+
+        result.shared_time = seconds_since(&shared_start);
+    }
+
+    for(size_t first = 0; ok && first < trains_n; first += batch_n) {
+        size_t n = (trains_n - first < batch_n) ? trains_n - first : batch_n;
+
+        // Each train runs on the route's own segments
+        for(size_t b = 0; b < n; b++) {
+            Instance variant = {
+                .segments = route->segments,
+                .train = trains[first + b],
+                .num_segments = route->num_segments,
+                .start_speed = route->start_speed,
+                .start_time = route->start_time,
+                .mapping = NULL,
+                .mapping_sz = 0
+            };
+
+            memcpy(&variants[b], &variant, sizeof(variant));
+            errors[b] = no_error();
+        }
+
+        #pragma omp parallel for schedule(dynamic) if(n > 1)
+        for(size_t b = 0; b < n; b++) {
+            struct timespec table_start;
+            clock_gettime(CLOCK_MONOTONIC, &table_start);
+
+            lookups[b] = generate_lookup_tables_on_track(&variants[b], tracks, &errors[b]);
+            entries[first + b].table_time = seconds_since(&table_start);
+        }
+
+        for(size_t b = 0; ok && b < n; b++) {
+            if(errors[b].status != TEGA_OK) {
+                if(error != NULL) { *error = errors[b]; }
+                ok = false;
+                break;
+            }
+
+            SolverResult solved = run_genetic_algorithm(&variants[b], &lookups[b], params, error);
+
+            if(solved.best.entry_speeds == NULL) {
+                free_solver_result(&solved);
+                ok = false;
+                break;
+            }
+
+            fill_sweep_entry(&entries[first + b], &variants[b], &solved);
+        }
+
+        for(size_t b = 0; b < n; b++) {
+            free_lookup_tables(&lookups[b]);
+        }
+    }
+
+    if(ok) {
+        result.entries = entries;
+        result.entries_n = trains_n;
+    } else if(entries != NULL) {
+        for(size_t t = 0; t < trains_n; t++) { free_individual(&entries[t].best); }
+        free(entries);
+    }
+
+    free(tracks);
+    free(variants);
+    free(lookups);
+    free(errors);
+
+    result.elapsed_time = seconds_since(&start);
+
+    return result;
+}
+
+/*
+ * api-method
+ */
+void free_sweep_result(SweepResult* result) {
+    for(size_t t = 0; result->entries != NULL && t < result->entries_n; t++) {
+        free_individual(&result->entries[t].best);
+    }
+
+    free(result->entries); result->entries = NULL;
+    result->entries_n = 0;
+}
+
+/*
+ * api-method
+ */
+void print_sweep_report(const SweepResult* result, const Train* trains) {
+    printf("=== TRAIN SWEEP (%zu trains, %zu segments, %.3f s, shared route data %.3f s) ===\n",
+        result->entries_n, result->num_segments, result->elapsed_time, result->shared_time);
+    printf("%4s %-12s %7s %9s %10s %9s %12s %8s %10s %13s %10s %10s %10s %s\n",
+        "#", "Type", "Coaches", "Mass [t]", "Length [m]", "Acc [m/s2]", "Energy [kWh]", "vs #0", "Time [s]", "Deviation [s]", "Violation", "Tables [s]", "Solve [s]", "");
+    for(size_t t = 0; t < result->entries_n; t++) {
+        const SweepEntry* e = &result->entries[t];
+        const SweepEntry* first = &result->entries[0];
+        const Train* train = &trains[t];
+        char relative[16] = "n/a";
+
+        // Energies of profiles which cannot be driven are not comparable
+        if(e->feasible && first->feasible && first->energy_kwh != 0) {
+            snprintf(relative, sizeof(relative), "%+.1f%%", 100 * (e->energy_kwh / first->energy_kwh - 1));
+        }
+
+        printf("%4zu %-12s %7lu %9.1f %10.1f %9.2f %12.2f %8s %10.1f %13.1f %10.1f %10.3f %10.3f %s\n",
+            t, train_type_name(train->type), (unsigned long) train->num_coaches, train->mass / 1000, train->length, train->max_acceleration,
+            e->energy_kwh, relative, e->running_time, e->objectives.deviation, e->objectives.violation,
+            e->table_time, e->solve_time, e->feasible ? "" : "(infeasible)");
+    }
+}
@@ -0,0 +1,70 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#ifndef TEGA_SWEEP_H
+#define TEGA_SWEEP_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "instance.h"
+#include "individual.h"
+#include "genetic.h"
+
+/**
+ * Outcome of the optimisation of one train of a sweep.
+ */
+typedef struct SweepEntry {
+    Individual              best;           // Best driving profile found (see SolverResult)
+    bool                    feasible;       // Whether best is feasible
+    IndividualObjectives    objectives;     // Traction energy [J/kg], arrival time deviation [s] and constraint violation of best
+    double                  energy_kwh;     // Traction energy of best for the whole train, without penalties [kWh]
+    double                  running_time;   // Time from the start to the end of the route [s]
+    double                  table_time;     // Wall-clock time to build the train's tables [s]
+    double                  solve_time;     // Wall-clock time of the optimisation [s]
+} SweepEntry;
+
+/**
+ * Outcome of a sweep over several trains on the same route.
+ */
+typedef struct SweepResult {
+    SweepEntry* entries;        // One per train, in the order given
+    size_t      entries_n;      // Number of trains
+    size_t      num_segments;   // Segments of the route
+    double      shared_time;    // Wall-clock time to compute what the trains share [s]
+    double      elapsed_time;   // Wall-clock time of the whole sweep [s]
+} SweepResult;
+
+/**
+ * Optimises the driving profile of several trains (e.g. different consists) on the same route.
+ *
+ * The trains share the route: its segments, which are not copied, and the track terms of the
+ * resistance on each segment, computed once (see generate_lookup_tables_on_track). The tables
+ * of the trains are built in parallel: with at least as many trains as threads, one train per
+ * thread; otherwise one train at a time, with its segments in parallel. Only the tables of
+ * the trains being built and solved are held in memory.
+ * @param route     The route; its own train is not part of the sweep
+ * @param trains    The trains
+ * @param trains_n  Number of trains
+ * @param params    The parameters of the genetic algorithm, the same for every train
+ * @param error     Filled if a train or the parameters are invalid, or there is not enough memory (can be NULL)
+ * @return          The result, to be freed with free_sweep_result (with no entries on error)
+ */
+SweepResult run_train_sweep(const Instance* route, const Train* trains, size_t trains_n, const GeneticParams* params, TegaError* error);
+
+/**
+ * Frees the memory used by a sweep result.
+ * @param result    The result
+ */
+void free_sweep_result(SweepResult* result);
+
+/**
+ * Prints a comparison of the trains of a sweep, with the energy of each one relative to the
+ * first. The constraint violation of each train is shown apart, and the relative energy only
+ * when both trains are feasible.
+ * @param result    The result
+ * @param trains    The trains, as passed to run_train_sweep
+ */
+void print_sweep_report(const SweepResult* result, const Train* trains);
+
+#endif //TEGA_SWEEP_H
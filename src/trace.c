@@ -0,0 +1,386 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#include "trace.h"
+#include "lookup.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+// Threads beyond this number share the last buffer, under the lock
+#define TRACE_MAX_THREADS 256
+
+// Records buffered by each thread before they are written
+#define TRACE_BUFFER_RECORDS 4096
+
+/**
+ * Records of a thread which are not written yet.
+ */
+typedef struct TraceSlot {
+    EvaluationTraceRecord*  records;
+    uint32_t                records_n;
+    uint32_t                thread;
+} TraceSlot;
+
+static TraceSlot slots[TRACE_MAX_THREADS];
+static size_t slots_used = 0;
+static __thread TraceSlot* thread_slot = NULL;
+
+static struct {
+    pthread_mutex_t mutex;
+    FILE*           fd;
+    const char*     filename;
+    bool            recording;
+    bool            failed;
+} recorder = {.mutex = PTHREAD_MUTEX_INITIALIZER, .fd = NULL, .filename = NULL, .recording = false, .failed = false};
+
+/*
+ * implementation-method
+ *
+ * FNV-1a, on the bits of the value, with -0 and 0 hashed the same.
+ */
+static uint64_t hash_value(uint64_t hash, double value) {
+    uint64_t bits;
+
+    if(value == 0) { value = 0; }
+    memcpy(&bits, &value, sizeof(bits));
+
+    for(size_t i = 0; i < 8; i++) {
+        hash = (hash ^ ((bits >> (8 * i)) & 0xffu)) * 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+/*
+ * api-method
+ */
+uint64_t instance_fingerprint(const Instance* instance) {
+    const Train* t = &instance->train;
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    // Inputs are indices in the tables, which depend on their resolution
+    hash = hash_value(hash, DISTANCE_STEP);
+    hash = hash_value(hash, SPEED_STEP);
+
+    hash = hash_value(hash, t->type);
+    hash = hash_value(hash, t->num_coaches);
+    hash = hash_value(hash, t->mass);
+    hash = hash_value(hash, t->mass_per_axle);
+    hash = hash_value(hash, t->max_acceleration);
+    hash = hash_value(hash, t->max_braking);
+    hash = hash_value(hash, t->length);
+    hash = hash_value(hash, (double) instance->num_segments);
+
+    for(size_t i = 0; i < instance->num_segments; i++) {
+        const Segment* s = &instance->segments[i];
+
+        hash = hash_value(hash, s->is_station);
+        hash = hash_value(hash, s->has_arrival_time ? s->arrival_time : 0);
+        hash = hash_value(hash, s->length);
+        hash = hash_value(hash, s->slope);
+        hash = hash_value(hash, s->curve);
+        hash = hash_value(hash, s->speed_limit);
+    }
+
+    return hash;
+}
+
+/*
+ * implementation-method
+ *
+ * Writes the buffered records of a slot as a block. The lock must be held.
+ */
+static void flush_slot(TraceSlot* slot) {
+    if(slot->records_n == 0) { return; }
+
+    EvaluationTraceBlock block = {.thread = slot->thread, .records_n = slot->records_n};
+
+    if(!recorder.failed && (fwrite(&block, sizeof(block), 1, recorder.fd) != 1 ||
+                            fwrite(slot->records, sizeof(*slot->records), slot->records_n, recorder.fd) != slot->records_n)) {
+        recorder.failed = true;
+    }
+
+    slot->records_n = 0;
+}
+
+/*
+ * implementation-method
+ *
+ * Gives the slot of the calling thread, claiming one the first time, or NULL if there is not
+ * enough memory for its buffer.
+ */
+static TraceSlot* get_thread_slot(void) {
+    if(thread_slot == NULL) {
+        size_t index = __atomic_fetch_add(&slots_used, 1, __ATOMIC_RELAXED);
+        TraceSlot* slot = &slots[index < TRACE_MAX_THREADS ? index : TRACE_MAX_THREADS - 1];
+
+        pthread_mutex_lock(&recorder.mutex);
+
+        if(slot->records == NULL) {
+            slot->records = malloc(TRACE_BUFFER_RECORDS * sizeof(*slot->records));
+            slot->thread = (uint32_t) (index < TRACE_MAX_THREADS ? index : TRACE_MAX_THREADS - 1);
+        }
+
+        pthread_mutex_unlock(&recorder.mutex);
+
+        if(slot->records == NULL) { return NULL; }
+
+        thread_slot = slot;
+    }
+
+    return thread_slot;
+}
+
+/*
+ * api-method
+ */
+bool start_evaluation_trace(const char* filename, const Instance* instance, TegaError* error) {
+#ifndef TEGA_TRACE
+    // run_on_segment would never call trace_evaluation, and the trace would stay empty
+    return set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "Cannot record %s: evaluation traces need a build with TEGA_TRACE", filename);
+#endif
+
+    pthread_mutex_lock(&recorder.mutex);
+
+    if(recorder.recording) {
+        pthread_mutex_unlock(&recorder.mutex);
+        return set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "Cannot record %s: an evaluation trace is already being recorded", filename);
+    }
+
+    EvaluationTraceHeader header = {
+        .magic = EVALUATION_TRACE_MAGIC,
+        .version = EVALUATION_TRACE_VERSION,
+        .record_size = sizeof(EvaluationTraceRecord),
+        .num_segments = instance->num_segments,
+        .fingerprint = instance_fingerprint(instance)
+    };
+
+    FILE* fd = fopen(filename, "wb");
+
+    if(fd == NULL || fwrite(&header, sizeof(header), 1, fd) != 1) {
+        if(fd != NULL) { fclose(fd); }
+        pthread_mutex_unlock(&recorder.mutex);
+        return set_error(error, TEGA_ERROR_IO, "Cannot write evaluation trace: %s", filename);
+    }
+
+    // Records left from an earlier trace were written when it stopped
+    for(size_t s = 0; s < TRACE_MAX_THREADS; s++) { slots[s].records_n = 0; }
+
+    recorder.fd = fd;
+    recorder.filename = filename;
+    recorder.failed = false;
+    __atomic_store_n(&recorder.recording, true, __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock(&recorder.mutex);
+
+    return true;
+}
+
+/*
+ * api-method
+ */
+void trace_evaluation(const EvaluationInput* input) {
+    if(!__atomic_load_n(&recorder.recording, __ATOMIC_ACQUIRE)) { return; }
+
+    TraceSlot* slot = get_thread_slot();
+
+    if(slot == NULL) {
+        __atomic_store_n(&recorder.failed, true, __ATOMIC_RELAXED);
+        return;
+    }
+
+    EvaluationTraceRecord record = {
+        .segment_id = (uint32_t) input->segment_id,
+        .x1 = (uint32_t) input->x1,
+        .x2 = (uint32_t) input->x2,
+        .x3 = (uint32_t) input->x3,
+        .e_speed = input->e_speed,
+        .e_time = input->e_time
+    };
+
+    bool shared = (slot == &slots[TRACE_MAX_THREADS - 1]);
+
+    if(shared) { pthread_mutex_lock(&recorder.mutex); }
+
+    slot->records[slot->records_n++] = record;
+
+    if(slot->records_n == TRACE_BUFFER_RECORDS) {
+        if(!shared) { pthread_mutex_lock(&recorder.mutex); }
+        flush_slot(slot);
+        if(!shared) { pthread_mutex_unlock(&recorder.mutex); }
+    }
+
+    if(shared) { pthread_mutex_unlock(&recorder.mutex); }
+}
+
+/*
+ * api-method
+ */
+bool stop_evaluation_trace(TegaError* error) {
+    pthread_mutex_lock(&recorder.mutex);
+
+    if(!recorder.recording) {
+        pthread_mutex_unlock(&recorder.mutex);
+        return true;
+    }
+
+    __atomic_store_n(&recorder.recording, false, __ATOMIC_RELEASE);
+
+    for(size_t s = 0; s < TRACE_MAX_THREADS; s++) { flush_slot(&slots[s]); }
+
+    bool ok = !__atomic_load_n(&recorder.failed, __ATOMIC_RELAXED);
+
+    if(fclose(recorder.fd) != 0) { ok = false; }
+
+    const char* filename = recorder.filename;
+    recorder.fd = NULL;
+    recorder.filename = NULL;
+
+    pthread_mutex_unlock(&recorder.mutex);
+
+    if(!ok) {
+        return set_error(error, TEGA_ERROR_IO, "Error writing evaluation trace: %s", filename);
+    }
+
+    return true;
+}
+
+/*
+ * implementation-method
+ *
+ * Tells whether a recorded evaluation could have been made on the instance.
+ */
+static bool is_valid_record(const Instance* instance, const EvaluationTraceRecord* record) {
+    if(record->segment_id >= instance->num_segments) { return false; }
+
+    size_t distance_steps = get_distance_steps(&instance->segments[record->segment_id]);
+
+    return record->x1 <= record->x2 && record->x2 <= record->x3 && record->x3 <= distance_steps &&
+           isfinite(record->e_speed) && record->e_speed >= 0 && isfinite(record->e_time);
+}
+
+/*
+ * implementation-method
+ *
+ * Reads the blocks of a trace file, after its header. Arrays grow by doubling.
+ */
+static bool read_blocks(FILE* fd, const char* filename, const Instance* instance, EvaluationTrace* trace, TegaError* error) {
+    size_t inputs_cap = 0, blocks_cap = 1;
+    EvaluationTraceRecord* records = malloc(TRACE_BUFFER_RECORDS * sizeof(*records));
+
+    trace->block_starts = malloc(blocks_cap * sizeof(*trace->block_starts));
+
+    if(records == NULL || trace->block_starts == NULL) {
+        free(records);
+        return set_error(error, TEGA_ERROR_OUT_OF_MEMORY, "Could not allocate memory to read %s", filename);
+    }
+
+    EvaluationTraceBlock block;
+
+    while(fread(&block, sizeof(block), 1, fd) == 1) {
+        if(block.records_n == 0 || block.records_n > TRACE_BUFFER_RECORDS) {
+            free(records);
+            return set_error(error, TEGA_ERROR_PARSE, "Error reading %s: the file is truncated or corrupted", filename);
+        }
+
+        if(fread(records, sizeof(*records), block.records_n, fd) != block.records_n) {
+            free(records);
+            return set_error(error, TEGA_ERROR_PARSE, "Error reading %s: the file is truncated or corrupted", filename);
+        }
+
+        if(trace->inputs_n + block.records_n > inputs_cap || trace->blocks_n + 2 > blocks_cap) {
+            size_t new_inputs_cap = inputs_cap > 0 ? 2 * inputs_cap : TRACE_BUFFER_RECORDS;
+            while(new_inputs_cap < trace->inputs_n + block.records_n) { new_inputs_cap *= 2; }
+
+            EvaluationInput* inputs = realloc(trace->inputs, new_inputs_cap * sizeof(*inputs));
+            if(inputs != NULL) { trace->inputs = inputs; inputs_cap = new_inputs_cap; }
+
+            size_t* starts = realloc(trace->block_starts, 2 * blocks_cap * sizeof(*starts));
+            if(starts != NULL) { trace->block_starts = starts; blocks_cap *= 2; }
+
+            if(inputs == NULL || starts == NULL) {
+                free(records);
+                return set_error(error, TEGA_ERROR_OUT_OF_MEMORY, "Could not allocate memory to read %s", filename);
+            }
+        }
+
+        trace->block_starts[trace->blocks_n++] = trace->inputs_n;
+
+        if(block.thread + 1u > trace->threads) { trace->threads = block.thread + 1u; }
+
+        for(size_t r = 0; r < block.records_n; r++) {
+            if(!is_valid_record(instance, &records[r])) {
+                free(records);
+                return set_error(error, TEGA_ERROR_INVALID_INSTANCE, "Error reading %s: evaluation #%zu does not fit the tables of the instance",
+                    filename, trace->inputs_n + r);
+            }
+
+            EvaluationInput input = {
+                .segment_id = records[r].segment_id,
+                .x1 = records[r].x1,
+                .x2 = records[r].x2,
+                .x3 = records[r].x3,
+                .e_speed = records[r].e_speed,
+                .e_time = records[r].e_time
+            };
+
+            trace->inputs[trace->inputs_n + r] = input;
+        }
+
+        trace->inputs_n += block.records_n;
+    }
+
+    trace->block_starts[trace->blocks_n] = trace->inputs_n;
+    free(records);
+
+    if(ferror(fd) || !feof(fd)) {
+        return set_error(error, TEGA_ERROR_IO, "Error reading %s", filename);
+    }
+
+    return true;
+}
+
+/*
+ * api-method
+ */
+EvaluationTrace read_evaluation_trace(const char* filename, const Instance* instance, TegaError* error) {
+    EvaluationTrace trace = {.inputs = NULL, .inputs_n = 0, .block_starts = NULL, .blocks_n = 0, .threads = 0};
+    EvaluationTraceHeader header;
+    FILE* fd = fopen(filename, "rb");
+
+    if(fd == NULL) {
+        set_error(error, TEGA_ERROR_IO, "Cannot read input file: %s", filename);
+        return trace;
+    }
+
+    if(fread(&header, sizeof(header), 1, fd) != 1 || memcmp(header.magic, EVALUATION_TRACE_MAGIC, sizeof(header.magic)) != 0) {
+        set_error(error, TEGA_ERROR_PARSE, "Error reading %s: not an evaluation trace", filename);
+    } else if(header.version != EVALUATION_TRACE_VERSION) {
+        set_error(error, TEGA_ERROR_PARSE, "Error reading %s: version %u is not supported (expected %u)", filename, header.version, EVALUATION_TRACE_VERSION);
+    } else if(header.record_size != sizeof(EvaluationTraceRecord)) {
+        set_error(error, TEGA_ERROR_PARSE, "Error reading %s: the file was written on a platform with a different data layout", filename);
+    } else if(header.num_segments != instance->num_segments || header.fingerprint != instance_fingerprint(instance)) {
+        set_error(error, TEGA_ERROR_INVALID_INSTANCE, "Error reading %s: the trace was recorded on a different instance", filename);
+    } else if(!read_blocks(fd, filename, instance, &trace, error)) {
+        free_evaluation_trace(&trace);
+    }
+
+    fclose(fd);
+
+    return trace;
+}
+
+/*
+ * api-method
+ */
+void free_evaluation_trace(EvaluationTrace* trace) {
+    free(trace->inputs); trace->inputs = NULL;
+    free(trace->block_starts); trace->block_starts = NULL;
+    trace->inputs_n = 0;
+    trace->blocks_n = 0;
+    trace->threads = 0;
+}
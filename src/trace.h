@@ -0,0 +1,128 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#ifndef TEGA_TRACE_H
+#define TEGA_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "instance.h"
+#include "segment_evaluation.h"
+#include "error.h"
+
+/*
+ * run_on_segment records its inputs with the TRACE_EVALUATION macro below, which compiles to
+ * nothing unless TEGA_TRACE is defined (cmake -DTEGA_TRACE=ON). It is off by default: even
+ * while no trace is being recorded, it costs a call and a load per evaluation.
+ *
+ * A trace file is a header followed by blocks, each holding the consecutive evaluations of
+ * one thread, in the order they were made. All values are in the byte order of the machine
+ * which recorded the trace.
+ */
+
+#define EVALUATION_TRACE_MAGIC      "TEGAEVT"
+#define EVALUATION_TRACE_VERSION    1u
+
+/**
+ * Header of a trace file.
+ */
+typedef struct EvaluationTraceHeader {
+    char        magic[8];           // EVALUATION_TRACE_MAGIC, with its terminator
+    uint32_t    version;            // EVALUATION_TRACE_VERSION
+    uint32_t    record_size;        // sizeof(EvaluationTraceRecord)
+    uint64_t    num_segments;       // Segments of the instance
+    uint64_t    fingerprint;        // See instance_fingerprint
+} EvaluationTraceHeader;
+
+/**
+ * Header of a block of evaluations made by the same thread.
+ */
+typedef struct EvaluationTraceBlock {
+    uint32_t    thread;             // Recording thread, numbered from 0
+    uint32_t    records_n;          // Records which follow
+} EvaluationTraceBlock;
+
+/**
+ * An EvaluationInput, as stored in a trace file.
+ */
+typedef struct EvaluationTraceRecord {
+    uint32_t    segment_id;
+    uint32_t    x1;
+    uint32_t    x2;
+    uint32_t    x3;
+    float       e_speed;
+    float       e_time;
+} EvaluationTraceRecord;
+
+/**
+ * A trace read back from a file.
+ */
+typedef struct EvaluationTrace {
+    EvaluationInput*    inputs;         // The evaluations, block after block
+    size_t              inputs_n;
+    size_t*             block_starts;   // Index of the first input of each block, plus inputs_n at the end
+    size_t              blocks_n;
+    size_t              threads;        // Threads which recorded the trace
+} EvaluationTrace;
+
+#ifdef TEGA_TRACE
+#define TRACE_EVALUATION(input)     trace_evaluation(input)
+#else
+#define TRACE_EVALUATION(input)     ((void) 0)
+#endif
+
+/**
+ * Hash of everything the look-up tables depend on: the train and the segments of an instance.
+ * A trace can only be replayed on an instance with the same fingerprint.
+ * @param instance  The instance
+ * @return          The fingerprint
+ */
+uint64_t instance_fingerprint(const Instance* instance);
+
+/**
+ * Starts recording every call to run_on_segment into a file, until stop_evaluation_trace.
+ * Segment ids are those of the given instance, so the trace should only cover evaluations on
+ * it (not, for instance, on the windows of the rolling horizon). Evaluations on coarse tables
+ * are recorded as well, with their inputs in fine steps.
+ * @param filename  The output file name
+ * @param instance  The instance which is going to be evaluated
+ * @param error     Filled if tracing is not compiled in, a trace is already being recorded, or
+ *                  the file cannot be written (can be NULL)
+ * @return          True if the recording started
+ */
+bool start_evaluation_trace(const char* filename, const Instance* instance, TegaError* error);
+
+/**
+ * Records an evaluation, if a trace is being recorded. Each thread buffers its own records,
+ * and only takes a lock to write a full buffer.
+ * @param input     The input of run_on_segment
+ */
+void trace_evaluation(const EvaluationInput* input);
+
+/**
+ * Stops recording, writes the records still buffered, and closes the file. No evaluation
+ * must be running.
+ * @param error     Filled if a write failed (can be NULL)
+ * @return          True if the whole trace was written, or no trace was being recorded
+ */
+bool stop_evaluation_trace(TegaError* error);
+
+/**
+ * Reads a trace file, checking that it was recorded on the given instance and that every
+ * evaluation lies within its tables.
+ * @param filename  The trace file name
+ * @param instance  The instance the trace was recorded on
+ * @param error     Filled if the file cannot be read or does not match the instance (can be NULL)
+ * @return          The trace, to be freed with free_evaluation_trace (with no inputs on error)
+ */
+EvaluationTrace read_evaluation_trace(const char* filename, const Instance* instance, TegaError* error);
+
+/**
+ * Frees the memory used by a trace.
+ * @param trace     The trace
+ */
+void free_evaluation_trace(EvaluationTrace* trace);
+
+#endif //TEGA_TRACE_H
@@ -6,6 +6,7 @@
 #include <stdbool.h>
 #include <assert.h>
 #include <inttypes.h>
+#include <math.h>
 #include "train.h"
 
 /*
@@ -33,4 +34,31 @@ void print_train(const Train* train) {
     printf("\tNumber of coaches: %" PRIuFAST32 ", total length: %.2f m\n", train->num_coaches, train->length);
     printf("\tMass: %.2f kg (%.2f kg per axle)\n", train->mass, train->mass_per_axle);
     printf("\tMax acceleration: %.2f m/s^2, max braking: %.2f m/s^2\n", train->max_acceleration, train->max_braking);
-}
\ No newline at end of file
+}
+
+/*
+ * api-method
+ */
+bool is_valid_train(const Train* train) {
+    return isfinite(train->mass) && isfinite(train->max_acceleration) && isfinite(train->max_braking) && isfinite(train->length) &&
+           train->mass > 0 && train->mass_per_axle > 0 && train->mass_per_axle < train->mass &&
+           train->max_acceleration > 0 && train->max_braking > 0 && train->length > 0;
+}
+
+/*
+ * api-method
+ */
+const char* train_type_name(TrainType type) {
+    switch(type) {
+        case SNCF_TGV:
+            return "SNCF TVG";
+        case SNCF_NORMAL:
+            return "SNCF Normal";
+        case DB_ICE:
+            return "DB ICE";
+        case DB_NORMAL:
+            return "DB Normal";
+        default:
+            return NULL;
+    }
+}
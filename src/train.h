@@ -6,6 +6,7 @@
 #define TEGA_TRAIN_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 typedef enum TrainType {
     SNCF_TGV = 10,
@@ -33,4 +34,19 @@ typedef struct Train {
  */
 void print_train(const Train* train);
 
+/**
+ * Tells whether the characteristics of a train can be simulated: they must be positive and
+ * finite, and the mass per axle less than the mass.
+ * @param train     The train
+ * @return          True iff the train is valid
+ */
+bool is_valid_train(const Train* train);
+
+/**
+ * Gives the name of a train type, as used in the json instance files.
+ * @param type      The train type
+ * @return          The name, or NULL if the type is not known
+ */
+const char* train_type_name(TrainType type);
+
 #endif //TEGA_TRAIN_H
@@ -0,0 +1,393 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../src/instance.h"
+#include "../src/generator.h"
+#include "../src/lookup.h"
+#include "../src/davis.h"
+#include "../src/eps.h"
+
+// Maximum number of step sizes of each kind
+#define MAX_STEPS 16
+
+/**
+ * Command line options.
+ */
+typedef struct AccuracyOptions {
+    const char*     instance_file;                  // If NULL, use a generated instance
+    size_t          segments;                       // Segments of the generated instance
+    unsigned int    seed;                           // Seed of the generated instance and of the samples
+    size_t          samples;                        // Runs compared for each pair of step sizes
+    double          dt;                             // Time step of the reference integration [s]
+    float           speed_steps[MAX_STEPS];         // Speed steps to evaluate [m/s]
+    size_t          speed_steps_n;
+    float           distance_steps[MAX_STEPS];      // Distance steps to evaluate [m]
+    size_t          distance_steps_n;
+    bool            json_output;                    // One json object per pair of step sizes
+} AccuracyOptions;
+
+/**
+ * Trajectory of the reference integration, sampled every dt.
+ */
+typedef struct Trajectory {
+    double* time;
+    double* speed;
+    double* position;
+    size_t  n;
+    size_t  capacity;
+} Trajectory;
+
+/**
+ * One sampled run: a segment, a driving style, and an entry speed.
+ */
+typedef struct Sample {
+    size_t      segment;
+    float       train_acceleration;
+    float       entry_speed;
+    float       fraction;       // Distance run, as a fraction of the segment length
+    Trajectory  reference;
+} Sample;
+
+/**
+ * Absolute errors of time, speed, and position over all samples.
+ */
+typedef struct Errors {
+    double* time;
+    double* speed;
+    double* position;
+    size_t  n;
+} Errors;
+
+static void append_point(Trajectory* tr, double t, double v, double x) {
+    if(tr->n == tr->capacity) {
+        tr->capacity = (tr->capacity == 0) ? 1024 : 2 * tr->capacity;
+        tr->time = realloc(tr->time, tr->capacity * sizeof(*tr->time));
+        tr->speed = realloc(tr->speed, tr->capacity * sizeof(*tr->speed));
+        tr->position = realloc(tr->position, tr->capacity * sizeof(*tr->position));
+
+        if(tr->time == NULL || tr->speed == NULL || tr->position == NULL) {
+            fprintf(stderr, "Could not allocate memory for the trajectory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    tr->time[tr->n] = t;
+    tr->speed[tr->n] = v;
+    tr->position[tr->n] = x;
+    tr->n++;
+}
+
+static double acceleration(const Train* train, const Segment* segment, float train_acceleration, double speed) {
+    return train_acceleration + resistance(train, segment, (float) fmax(speed, 0));
+}
+
+/*
+ * Reference integration of the same physics with classic Runge-Kutta in time, where the
+ * resistance follows the speed continuously. It ends at the end of the segment, or when the
+ * train stops.
+ */
+static Trajectory reference_trajectory(const Train* train, const Segment* segment, float train_acceleration, float entry_speed, double dt) {
+    Trajectory tr = {.time = NULL, .speed = NULL, .position = NULL, .n = 0, .capacity = 0};
+    double t = 0, v = entry_speed, x = 0;
+
+    append_point(&tr, t, v, x);
+
+    while(x < segment->length) {
+        if(v <= SPEED_EPS && acceleration(train, segment, train_acceleration, 0) <= ACCELERATION_EPS) { break; }
+
+        double k1v = acceleration(train, segment, train_acceleration, v);
+        double k1x = v;
+        double k2v = acceleration(train, segment, train_acceleration, v + 0.5 * dt * k1v);
+        double k2x = v + 0.5 * dt * k1v;
+        double k3v = acceleration(train, segment, train_acceleration, v + 0.5 * dt * k2v);
+        double k3x = v + 0.5 * dt * k2v;
+        double k4v = acceleration(train, segment, train_acceleration, v + dt * k3v);
+        double k4x = v + dt * k3v;
+
+        double next_v = v + dt / 6 * (k1v + 2 * k2v + 2 * k3v + k4v);
+        double next_x = x + dt / 6 * (k1x + 2 * k2x + 2 * k3x + k4x);
+
+        if(next_v <= 0) {
+            // The train stops within this step: end where the speed reaches 0
+            double fraction = v / (v - next_v);
+            append_point(&tr, t + fraction * dt, 0, x + fraction * (next_x - x));
+            break;
+        }
+
+        t += dt;
+        v = next_v;
+        x = next_x;
+        append_point(&tr, t, v, x);
+    }
+
+    return tr;
+}
+
+/*
+ * State of the reference trajectory after running a distance (or where it stops).
+ */
+static Motion reference_at(const Trajectory* tr, double distance) {
+    size_t last = tr->n - 1;
+
+    if(distance >= tr->position[last]) {
+        return (Motion) {.time = (float) tr->time[last], .speed = (float) tr->speed[last], .position = (float) tr->position[last], .energy = 0};
+    }
+
+    size_t lo = 0, hi = last;
+
+    while(hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if(tr->position[mid] <= distance) { lo = mid; } else { hi = mid; }
+    }
+
+    double w = (distance - tr->position[lo]) / (tr->position[hi] - tr->position[lo]);
+
+    return (Motion) {
+        .time = (float) (tr->time[lo] + w * (tr->time[hi] - tr->time[lo])),
+        .speed = (float) (tr->speed[lo] + w * (tr->speed[hi] - tr->speed[lo])),
+        .position = (float) distance,
+        .energy = 0
+    };
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double da = *(const double*) a, db = *(const double*) b;
+    return (da > db) - (da < db);
+}
+
+static double percentile(const double* sorted, size_t n, double p) {
+    if(n == 0) { return 0; }
+    return sorted[(size_t) (p * (double) (n - 1))];
+}
+
+static void print_errors(const char* name, double* errors, size_t n, bool json_output, bool last) {
+    double sum = 0;
+
+    qsort(errors, n, sizeof(*errors), compare_doubles);
+    for(size_t i = 0; i < n; i++) { sum += errors[i]; }
+
+    double mean = (n == 0) ? 0 : sum / (double) n;
+
+    if(json_output) {
+        printf("\"%s\": {\"mean\": %.6g, \"p50\": %.6g, \"p95\": %.6g, \"max\": %.6g}%s",
+            name, mean, percentile(errors, n, 0.5), percentile(errors, n, 0.95), percentile(errors, n, 1), last ? "" : ", ");
+    } else {
+        printf("  %-8s mean %10.4f  p50 %10.4f  p95 %10.4f  max %10.4f\n",
+            name, mean, percentile(errors, n, 0.5), percentile(errors, n, 0.95), percentile(errors, n, 1));
+    }
+}
+
+/*
+ * Memory of the tables of the instance for a pair of step sizes, as generate_lookup_tables
+ * would allocate it.
+ */
+static double table_megabytes(const Instance* instance, float speed_step, float distance_step) {
+    float max_speed = 0, max_length = 0;
+
+    for(size_t i = 0; i < instance->num_segments; i++) {
+        max_speed = fmaxf(max_speed, instance->segments[i].speed_limit);
+        max_length = fmaxf(max_length, instance->segments[i].length);
+    }
+
+    double cells = (double) instance->num_segments * floor(max_speed / speed_step + 1) * floor(max_length / distance_step + 1);
+
+    return 10 * cells * sizeof(float) / 1e6;
+}
+
+static size_t parse_steps(const char* str, float* steps) {
+    size_t n = 0;
+    char* end;
+
+    while(n < MAX_STEPS) {
+        float step = strtof(str, &end);
+
+        if(end == str || step <= 0) {
+            fprintf(stderr, "Invalid list of steps\n");
+            exit(EXIT_FAILURE);
+        }
+
+        steps[n++] = step;
+
+        if(*end != ',') { break; }
+        str = end + 1;
+    }
+
+    return n;
+}
+
+static AccuracyOptions parse_options(int argc, char** argv) {
+    AccuracyOptions options = {
+        .instance_file = NULL,
+        .segments = 200,
+        .seed = 1u,
+        .samples = 500,
+        .dt = 0.01,
+        .speed_steps = {1, 2.5f, SPEED_STEP, 10},
+        .speed_steps_n = 4,
+        .distance_steps = {10, 25, DISTANCE_STEP, 100},
+        .distance_steps_n = 4,
+        .json_output = false
+    };
+
+    for(int i = 1; i < argc; i++) {
+        bool has_value = (i + 1 < argc);
+
+        if(strcmp(argv[i], "--instance") == 0 && has_value) {
+            options.instance_file = argv[++i];
+        } else if(strcmp(argv[i], "--segments") == 0 && has_value) {
+            options.segments = (size_t) strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--seed") == 0 && has_value) {
+            options.seed = (unsigned int) strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--samples") == 0 && has_value) {
+            options.samples = (size_t) strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--dt") == 0 && has_value) {
+            options.dt = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--speed-steps") == 0 && has_value) {
+            options.speed_steps_n = parse_steps(argv[++i], options.speed_steps);
+        } else if(strcmp(argv[i], "--distance-steps") == 0 && has_value) {
+            options.distance_steps_n = parse_steps(argv[++i], options.distance_steps);
+        } else if(strcmp(argv[i], "--json") == 0) {
+            options.json_output = true;
+        } else {
+            fprintf(stderr, "Usage: %s [--instance file.json | --segments N] [--seed N] [--samples N] [--dt s] "
+                            "[--speed-steps a,b,...] [--distance-steps a,b,...] [--json]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if(options.samples == 0 || options.dt <= 0 || options.segments < 2) {
+        fprintf(stderr, "There must be at least 1 sample, 2 segments, and a positive time step\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return options;
+}
+
+int main(int argc, char** argv) {
+    AccuracyOptions options = parse_options(argc, argv);
+    GeneratorParams params = default_generator_params(options.segments, options.seed);
+    TegaError error = no_error();
+    Instance instance = (options.instance_file != NULL) ? read_instance_streaming(options.instance_file, &error) : generate_instance(&params, &error);
+    const Train* train = &instance.train;
+    unsigned int seed = options.seed;
+
+    if(error.status != TEGA_OK) {
+        fprintf(stderr, "%s\n", error.message);
+        exit(EXIT_FAILURE);
+    }
+
+    size_t* running = malloc(instance.num_segments * sizeof(*running));
+    size_t running_n = 0;
+
+    if(running == NULL) {
+        fprintf(stderr, "Could not allocate memory for the samples\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for(size_t i = 0; i < instance.num_segments; i++) {
+        if(instance.segments[i].length > SEGMENT_LENGTH_EPS) { running[running_n++] = i; }
+    }
+
+    if(running_n == 0) {
+        fprintf(stderr, "The instance has no segment of positive length\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // The reference runs are integrated once, and compared with all step sizes
+    Sample* samples = malloc(options.samples * sizeof(*samples));
+    const float styles[3] = {train->max_acceleration, 0, - train->max_braking};
+
+    if(samples == NULL) {
+        fprintf(stderr, "Could not allocate memory for the samples\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for(size_t s = 0; s < options.samples; s++) {
+        samples[s].segment = running[(size_t) rand_r(&seed) % running_n];
+        samples[s].train_acceleration = styles[rand_r(&seed) % 3];
+        samples[s].entry_speed = instance.segments[samples[s].segment].speed_limit * ((float) rand_r(&seed) / (float) RAND_MAX);
+        samples[s].fraction = (float) rand_r(&seed) / (float) RAND_MAX;
+    }
+
+    #pragma omp parallel for schedule(dynamic)
+    for(size_t s = 0; s < options.samples; s++) {
+        samples[s].reference = reference_trajectory(train, &instance.segments[samples[s].segment], samples[s].train_acceleration, samples[s].entry_speed, options.dt);
+    }
+
+    Errors errors = {
+        .time = malloc(options.samples * sizeof(double)),
+        .speed = malloc(options.samples * sizeof(double)),
+        .position = malloc(options.samples * sizeof(double)),
+        .n = 0
+    };
+
+    if(errors.time == NULL || errors.speed == NULL || errors.position == NULL) {
+        fprintf(stderr, "Could not allocate memory for the errors\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for(size_t si = 0; si < options.speed_steps_n; si++) {
+        for(size_t di = 0; di < options.distance_steps_n; di++) {
+            float speed_step = options.speed_steps[si];
+            float distance_step = options.distance_steps[di];
+            size_t invalid = 0;
+
+            errors.n = 0;
+
+            for(size_t s = 0; s < options.samples; s++) {
+                const Segment* seg = &instance.segments[samples[s].segment];
+
+                // The tables only know the row below the entry speed, and distances on the grid
+                float grid_speed = speed_step * floorf(samples[s].entry_speed / speed_step);
+                float distance = distance_step * floorf(samples[s].fraction * seg->length / distance_step);
+                Motion table;
+
+                if(!integrate_motion(train, seg, samples[s].train_acceleration, grid_speed, distance, distance_step, &table)) {
+                    invalid++;
+                    continue;
+                }
+
+                Motion reference = reference_at(&samples[s].reference, distance);
+
+                errors.time[errors.n] = fabs(table.time - reference.time);
+                errors.speed[errors.n] = fabs(table.speed - reference.speed);
+                errors.position[errors.n] = fabs(table.position - reference.position);
+                errors.n++;
+            }
+
+            if(options.json_output) {
+                printf("{\"speed_step\": %g, \"distance_step\": %g, \"samples\": %zu, \"invalid\": %zu, \"table_mb\": %.3f, ",
+                    speed_step, distance_step, errors.n, invalid, table_megabytes(&instance, speed_step, distance_step));
+            } else {
+                printf("Speed step %g m/s, distance step %g m: %zu samples (%zu invalid), tables %.2f MB\n",
+                    speed_step, distance_step, errors.n, invalid, table_megabytes(&instance, speed_step, distance_step));
+            }
+
+            print_errors("time", errors.time, errors.n, options.json_output, false);
+            print_errors("speed", errors.speed, errors.n, options.json_output, false);
+            print_errors("position", errors.position, errors.n, options.json_output, true);
+
+            if(options.json_output) { printf("}\n"); }
+        }
+    }
+
+    for(size_t s = 0; s < options.samples; s++) {
+        free(samples[s].reference.time);
+        free(samples[s].reference.speed);
+        free(samples[s].reference.position);
+    }
+
+    free(samples);
+    free(running);
+    free(errors.time);
+    free(errors.speed);
+    free(errors.position);
+    free_instance(&instance);
+
+    return 0;
+}
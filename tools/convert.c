@@ -0,0 +1,27 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/instance.h"
+#include "../src/instance_binary.h"
+
+int main(int argc, char** argv) {
+    if(argc != 3) {
+        fprintf(stderr, "Usage: %s instance.json instance.bin\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    TegaError error = no_error();
+    Instance instance = read_instance_streaming(argv[1], &error);
+    bool ok = (error.status == TEGA_OK) && write_instance_binary(&instance, argv[2], &error);
+
+    if(!ok) {
+        fprintf(stderr, "%s\n", error.message);
+    }
+
+    free_instance(&instance);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,713 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+/*
+ * Solver daemon. It keeps instances and their lookup tables in memory (see model_cache.h)
+ * and serves solve requests over a Unix domain socket, from a pool of worker threads. The
+ * main thread watches the idle connections, and hands a connection to a worker only when a
+ * request arrives on it: a worker serves that one request, then gives the connection back.
+ * Idle or slow clients therefore never hold a worker, beyond IO_TIMEOUT for a request which
+ * arrives piece by piece.
+ *
+ * Protocol: both requests and responses are frames made of a 4-byte length, in network
+ * byte order, followed by a json object of that length. A client can send any number of
+ * requests on a connection; each gets a response, in order.
+ *
+ * Solve request (all fields but "instance" are optional; strings are taken verbatim, without
+ * unescaping):
+ *   {"instance": "route.json", "segment": 0, "position": 0, "speed": 0, "time": 0,
+ *    "horizon": 0, "time_limit": 1.0, "generations": 200, "seed": 1}
+ * The time limit must be positive, and at most the daemon's --max-time-limit, so that no
+ * request holds a worker for long; numbers must fit the fields they go in.
+ * Files ending in .bin are read as binary instances. The start state and the horizon are
+ * those of reoptimise_from_state.
+ *
+ * Response:
+ *   {"ok": true, "cached": true, "setup": 0.000, "first_segment": 0, "cost": 1234.5,
+ *    "feasible": true, "generations": 200, "evaluations": 12345, "elapsed": 0.9,
+ *    "switching_points": [[x1, x2, x3], ...]}
+ * or {"ok": false, "error": "message"}.
+ *
+ * The request {"command": "stats"} gives the statistics of the cache.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "../src/model_cache.h"
+#include "../src/rolling_horizon.h"
+#include "../src/json_stream.h"
+#include "../src/metrics.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Largest request accepted [bytes]
+#define MAX_REQUEST_SZ (1u << 20)
+
+// Connections with a request, not yet picked up by a worker
+#define QUEUE_SZ 64
+
+// Connections open at the same time; further ones wait to be accepted
+#define MAX_CONNECTIONS 1024
+
+// How often the main thread checks whether the daemon is stopping [ms]
+#define POLL_INTERVAL 500
+
+// Longest wait for the rest of a request, or for a client to take a response [s]
+#define IO_TIMEOUT 10
+
+/**
+ * Command line options.
+ */
+typedef struct DaemonOptions {
+    const char*     socket_path;
+    size_t          workers;            // Requests served at the same time
+    int             solver_threads;     // OpenMP threads used by each solve
+    size_t          memory_budget;      // Memory budget of the model cache [bytes]
+    double          time_limit;         // Default time budget of a solve [s]
+    double          max_time_limit;     // Largest time budget a request can ask for [s]
+    bool            huge_pages;         // Whether models are packed on huge pages
+} DaemonOptions;
+
+/**
+ * A solve request.
+ */
+typedef struct SolveRequest {
+    char            instance[4096];
+    RouteState      state;
+    size_t          horizon;
+    double          time_limit;
+    size_t          generations;
+    unsigned int    seed;
+    bool            stats;              // Only asks for the cache statistics
+} SolveRequest;
+
+/**
+ * A growing output buffer.
+ */
+typedef struct Buffer {
+    char*   data;
+    size_t  used;
+    size_t  capacity;
+    bool    error;
+} Buffer;
+
+/**
+ * Connections with a request waiting for a worker. A negative descriptor tells a worker to stop.
+ */
+static struct {
+    int             fds[QUEUE_SZ];
+    size_t          head;
+    size_t          n;
+    pthread_mutex_t mutex;
+    pthread_cond_t  not_empty;
+    pthread_cond_t  not_full;
+} queue = {.head = 0, .n = 0, .mutex = PTHREAD_MUTEX_INITIALIZER, .not_empty = PTHREAD_COND_INITIALIZER, .not_full = PTHREAD_COND_INITIALIZER};
+
+/**
+ * Connections whose request has been served, to be watched again by the main thread, which
+ * a byte on the wake pipe tells that there are some.
+ */
+static struct {
+    int             fds[MAX_CONNECTIONS];
+    size_t          n;
+    pthread_mutex_t mutex;
+    int             wake[2];
+} returned = {.n = 0, .mutex = PTHREAD_MUTEX_INITIALIZER, .wake = {-1, -1}};
+
+// Set by SIGINT and SIGTERM, read by all threads
+static int stopping = 0;
+
+// Connections open, idle or being served: the main thread opens them, and the workers close them
+static size_t open_connections = 0;
+static ModelCache cache;
+static DaemonOptions options;
+
+static void on_signal(int signal) {
+    (void) signal;
+    __atomic_store_n(&stopping, 1, __ATOMIC_RELAXED);
+}
+
+static bool is_stopping(void) {
+    return __atomic_load_n(&stopping, __ATOMIC_RELAXED) != 0;
+}
+
+static void push_connection(int fd) {
+    pthread_mutex_lock(&queue.mutex);
+    while(queue.n == QUEUE_SZ) { pthread_cond_wait(&queue.not_full, &queue.mutex); }
+    queue.fds[(queue.head + queue.n) % QUEUE_SZ] = fd;
+    queue.n++;
+    pthread_cond_signal(&queue.not_empty);
+    pthread_mutex_unlock(&queue.mutex);
+}
+
+static int pop_connection(void) {
+    pthread_mutex_lock(&queue.mutex);
+    while(queue.n == 0) { pthread_cond_wait(&queue.not_empty, &queue.mutex); }
+    int fd = queue.fds[queue.head];
+    queue.head = (queue.head + 1) % QUEUE_SZ;
+    queue.n--;
+    pthread_cond_signal(&queue.not_full);
+    pthread_mutex_unlock(&queue.mutex);
+
+    return fd;
+}
+
+static void return_connection(int fd) {
+    char wake = 0;
+
+    pthread_mutex_lock(&returned.mutex);
+    returned.fds[returned.n++] = fd;
+    pthread_mutex_unlock(&returned.mutex);
+
+    // The pipe is non-blocking: if it is full, the main thread is going to wake up anyway
+    if(write(returned.wake[1], &wake, 1) < 0) { return; }
+}
+
+static void close_connection(int fd) {
+    close(fd);
+    __atomic_sub_fetch(&open_connections, 1, __ATOMIC_RELAXED);
+}
+
+static void append(Buffer* b, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+static void append(Buffer* b, const char* format, ...) {
+    while(!b->error) {
+        va_list args;
+        va_start(args, format);
+        int n = vsnprintf(b->data + b->used, b->capacity - b->used, format, args);
+        va_end(args);
+
+        if(n < 0) { b->error = true; return; }
+        if((size_t) n < b->capacity - b->used) { b->used += (size_t) n; return; }
+
+        size_t capacity = 2 * b->capacity + (size_t) n;
+        char* data = realloc(b->data, capacity);
+
+        if(data == NULL) { b->error = true; return; }
+
+        b->data = data;
+        b->capacity = capacity;
+    }
+}
+
+/*
+ * Appends a json string, escaping what needs to be.
+ */
+static void append_string(Buffer* b, const char* str) {
+    append(b, "\"");
+
+    for(const char* c = str; *c != '\0'; c++) {
+        if(*c == '"' || *c == '\\') {
+            append(b, "\\%c", *c);
+        } else if((unsigned char) *c < 0x20) {
+            append(b, "\\u%04x", (unsigned int) (unsigned char) *c);
+        } else {
+            append(b, "%c", *c);
+        }
+    }
+
+    append(b, "\"");
+}
+
+static bool read_all(int fd, void* data, size_t sz) {
+    char* p = data;
+
+    while(sz > 0) {
+        ssize_t n = read(fd, p, sz);
+
+        if(n < 0 && errno == EINTR) { continue; }
+        if(n <= 0) { return false; }
+
+        p += n;
+        sz -= (size_t) n;
+    }
+
+    return true;
+}
+
+static bool write_all(int fd, const void* data, size_t sz) {
+    const char* p = data;
+
+    while(sz > 0) {
+        ssize_t n = write(fd, p, sz);
+
+        if(n < 0 && errno == EINTR) { continue; }
+        if(n <= 0) { return false; }
+
+        p += n;
+        sz -= (size_t) n;
+    }
+
+    return true;
+}
+
+/*
+ * Reads a request from a connection with data to read. Returns false when the client
+ * disconnects, sends a malformed frame, or takes more than IO_TIMEOUT to send it.
+ */
+static bool read_frame(int fd, char** frame, size_t* frame_sz) {
+    uint32_t length;
+
+    if(!read_all(fd, &length, sizeof(length))) { return false; }
+
+    length = ntohl(length);
+
+    if(length == 0 || length > MAX_REQUEST_SZ) { return false; }
+
+    *frame = malloc(length);
+    *frame_sz = length;
+
+    if(*frame == NULL || !read_all(fd, *frame, length)) {
+        free(*frame);
+        return false;
+    }
+
+    return true;
+}
+
+static bool write_frame(int fd, const Buffer* b) {
+    uint32_t length = htonl((uint32_t) b->used);
+
+    return write_all(fd, &length, sizeof(length)) && write_all(fd, b->data, b->used);
+}
+
+/*
+ * Bound (excluded) of the numbers a request field can hold: (double) SIZE_MAX is 2^64, the
+ * first value which does not fit in a size_t, and UINT_MAX + 1 the first which does not fit
+ * in an unsigned int. The other fields are floats, kept below FLT_MAX.
+ */
+static double field_limit(const char* key, size_t key_len) {
+    if(json_stream_equals(key, key_len, "segment") || json_stream_equals(key, key_len, "horizon") || json_stream_equals(key, key_len, "generations")) {
+        return (double) SIZE_MAX;
+    }
+
+    if(json_stream_equals(key, key_len, "seed")) { return (double) UINT_MAX + 1; }
+
+    return FLT_MAX;
+}
+
+static bool parse_request(const char* frame, size_t frame_sz, SolveRequest* request, TegaError* error) {
+    JsonStream s = json_stream(frame, frame_sz);
+    const char* key;
+    size_t key_len;
+    double value = 0;
+    bool is_integer;
+
+    *request = (SolveRequest) {
+        .instance = "",
+        .state = {.segment = 0, .position = 0, .speed = 0, .time = 0},
+        .horizon = 0,
+        .time_limit = options.time_limit,
+        .generations = default_genetic_params().num_generations,
+        .seed = 1u,
+        .stats = false
+    };
+
+    json_stream_object_begin(&s);
+
+    while(json_stream_next_key(&s, &key, &key_len)) {
+        if(json_stream_equals(key, key_len, "instance") || json_stream_equals(key, key_len, "command")) {
+            bool is_command = json_stream_equals(key, key_len, "command");
+            const char* str;
+            size_t str_len;
+
+            if(!json_stream_string(&s, &str, &str_len)) { break; }
+
+            if(is_command) {
+                request->stats = json_stream_equals(str, str_len, "stats");
+
+                if(!request->stats) {
+                    return set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "Unknown command: %.*s", (int) str_len, str);
+                }
+            } else if(str_len >= sizeof(request->instance)) {
+                return set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "Instance file name too long");
+            } else {
+                memcpy(request->instance, str, str_len);
+                request->instance[str_len] = '\0';
+            }
+        } else if(json_stream_number(&s, &value, &is_integer)) {
+            // Checked before the casts below, which are undefined for values out of range
+            if(!(value >= 0)) {
+                return set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "Negative value for ``%.*s''", (int) key_len, key);
+            }
+
+            if(!(value < field_limit(key, key_len))) {
+                return set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "Value too large for ``%.*s''", (int) key_len, key);
+            }
+
+            if(json_stream_equals(key, key_len, "segment")) {
+                request->state.segment = (size_t) value;
+            } else if(json_stream_equals(key, key_len, "position")) {
+                request->state.position = (float) value;
+            } else if(json_stream_equals(key, key_len, "speed")) {
+                request->state.speed = (float) value;
+            } else if(json_stream_equals(key, key_len, "time")) {
+                request->state.time = (float) value;
+            } else if(json_stream_equals(key, key_len, "horizon")) {
+                request->horizon = (size_t) value;
+            } else if(json_stream_equals(key, key_len, "time_limit")) {
+                request->time_limit = value;
+            } else if(json_stream_equals(key, key_len, "generations")) {
+                request->generations = (size_t) value;
+            } else if(json_stream_equals(key, key_len, "seed")) {
+                request->seed = (unsigned int) value;
+            }
+        } else {
+            // Not a number: the stream is not in error only if it was another kind of value
+            if(!json_stream_skip(&s)) { break; }
+        }
+    }
+
+    if(s.error) {
+        return set_error(error, TEGA_ERROR_PARSE, "Malformed request, line %d", json_stream_line(&s));
+    }
+
+    if(!request->stats && request->instance[0] == '\0') {
+        return set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "Missing ``instance''");
+    }
+
+    if(!request->stats && !(request->time_limit > 0 && request->time_limit <= options.max_time_limit)) {
+        return set_error(error, TEGA_ERROR_INVALID_ARGUMENT, "The time limit must be positive, and at most %.1f s", options.max_time_limit);
+    }
+
+    return true;
+}
+
+static void write_stats(Buffer* response) {
+    pthread_mutex_lock(&cache.mutex);
+
+    size_t models = 0;
+    for(const Model* model = cache.first; model != NULL; model = model->next) { models++; }
+
+    append(response, "{\"ok\": true, \"models\": %zu, \"bytes\": %zu, \"budget\": %zu, \"hits\": %zu, \"misses\": %zu, \"evictions\": %zu}",
+        models, cache.bytes, cache.budget, cache.hits, cache.misses, cache.evictions);
+
+    pthread_mutex_unlock(&cache.mutex);
+}
+
+static void solve(const SolveRequest* request, Buffer* response, TegaError* error) {
+    uint64_t start = metrics_clock();
+    bool hit = false;
+    const Model* model = acquire_model(&cache, request->instance, &hit, error);
+
+    if(model == NULL) { return; }
+
+    double setup = 1e-9 * (double) (metrics_clock() - start);
+    GeneticParams params = default_genetic_params();
+
+    params.time_limit = request->time_limit;
+    params.num_generations = request->generations;
+    params.seed = request->seed;
+
+    RollingHorizonResult result = reoptimise_from_state(&model->packed.instance, &model->packed.lookup, NULL, &request->state, request->horizon, &params, error);
+
+    release_model(&cache, model);
+
+    if(error->status != TEGA_OK) {
+        free_rolling_horizon_result(&result);
+        return;
+    }
+
+    const SolverResult* solver = &result.solver;
+
+    append(response, "{\"ok\": true, \"cached\": %s, \"setup\": %.6f, \"first_segment\": %zu, \"cost\": %.6f, \"feasible\": %s, "
+                     "\"generations\": %zu, \"evaluations\": %zu, \"elapsed\": %.6f, \"switching_points\": [",
+        hit ? "true" : "false", setup, result.first_segment, solver->best.cost, solver->feasible ? "true" : "false",
+        solver->generations, solver->evaluations, solver->elapsed_time);
+
+    for(size_t i = 0; i < solver->best.num_segments; i++) {
+        const SwitchingPoints* sp = &solver->best.genes[i];
+        append(response, "%s[%zu, %zu, %zu]", (i == 0 ? "" : ", "), sp->x1, sp->x2, sp->x3);
+    }
+
+    append(response, "]}");
+
+    free_rolling_horizon_result(&result);
+}
+
+/*
+ * Serves the next request of a connection. Returns false if the connection must be closed.
+ */
+static bool serve_request(int fd, Buffer* response) {
+    TegaError error = no_error();
+    SolveRequest request;
+    char* frame;
+    size_t frame_sz;
+
+    if(!read_frame(fd, &frame, &frame_sz)) { return false; }
+
+    response->used = 0;
+    response->error = false;
+
+    if(parse_request(frame, frame_sz, &request, &error)) {
+        if(request.stats) {
+            write_stats(response);
+        } else {
+            solve(&request, response, &error);
+        }
+    }
+
+    free(frame);
+
+    if(response->error) {
+        set_error(&error, TEGA_ERROR_OUT_OF_MEMORY, "Could not allocate memory for the response");
+    }
+
+    if(error.status != TEGA_OK) {
+        response->used = 0;
+        response->error = false;
+        append(response, "{\"ok\": false, \"error\": ");
+        append_string(response, error.message);
+        append(response, "}");
+    }
+
+    return !response->error && write_frame(fd, response);
+}
+
+static void* worker(void* arg) {
+    (void) arg;
+
+#ifdef _OPENMP
+    omp_set_num_threads(options.solver_threads);
+#endif
+
+    Buffer response = {.data = malloc(4096), .used = 0, .capacity = 4096, .error = false};
+    int fd;
+
+    // Without a buffer, the worker still takes its connections, and closes them
+    while((fd = pop_connection()) >= 0) {
+        if(response.data != NULL && serve_request(fd, &response)) {
+            return_connection(fd);
+        } else {
+            close_connection(fd);
+        }
+    }
+
+    free(response.data);
+
+    return NULL;
+}
+
+static DaemonOptions parse_options(int argc, char** argv) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    DaemonOptions opts = {
+        .socket_path = NULL,
+        .workers = 4,
+        .solver_threads = 0,
+        .memory_budget = (size_t) 1024 << 20,
+        .time_limit = 1.0,
+        .max_time_limit = 60.0,
+        .huge_pages = false
+    };
+
+    for(int i = 1; i < argc; i++) {
+        bool has_value = (i + 1 < argc);
+
+        if(strcmp(argv[i], "--socket") == 0 && has_value) {
+            opts.socket_path = argv[++i];
+        } else if(strcmp(argv[i], "--workers") == 0 && has_value) {
+            opts.workers = (size_t) strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--solver-threads") == 0 && has_value) {
+            opts.solver_threads = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--memory") == 0 && has_value) {
+            opts.memory_budget = (size_t) strtoul(argv[++i], NULL, 10) << 20;
+        } else if(strcmp(argv[i], "--time-limit") == 0 && has_value) {
+            opts.time_limit = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--max-time-limit") == 0 && has_value) {
+            opts.max_time_limit = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--huge-pages") == 0) {
+            opts.huge_pages = true;
+        } else {
+            opts.socket_path = NULL;
+            break;
+        }
+    }
+
+    if(opts.socket_path == NULL || opts.workers == 0 || !(opts.time_limit > 0) || !(opts.time_limit <= opts.max_time_limit)) {
+        fprintf(stderr, "Usage: %s --socket path [--workers N] [--solver-threads N] [--memory MB] [--time-limit s] [--max-time-limit s] [--huge-pages]\n", argv[0]);
+        fprintf(stderr, "The time limit must be positive, and at most the maximum time limit (default 60 s)\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // By default, the workers share the processors
+    if(opts.solver_threads <= 0) {
+        opts.solver_threads = (cpus > (long) opts.workers) ? (int) (cpus / (long) opts.workers) : 1;
+    }
+
+    return opts;
+}
+
+/*
+ * Hands the idle connections with a request, or hung up, to the workers: they are no longer
+ * watched until a worker gives them back. The pfds swapped in are checked in turn.
+ */
+static void dispatch_requests(struct pollfd* connections, size_t* n) {
+    for(size_t i = 0; i < *n;) {
+        if(connections[i].revents == 0) {
+            i++;
+            continue;
+        }
+
+        int fd = connections[i].fd;
+
+        connections[i] = connections[--*n];
+        push_connection(fd);
+    }
+}
+
+/*
+ * Watches again the connections given back by the workers.
+ */
+static void watch_returned(int wake, struct pollfd* connections, size_t* n) {
+    char drain[64];
+
+    while(read(wake, drain, sizeof(drain)) > 0) {}
+
+    pthread_mutex_lock(&returned.mutex);
+
+    for(size_t i = 0; i < returned.n; i++) {
+        connections[(*n)++] = (struct pollfd) {.fd = returned.fds[i], .events = POLLIN};
+    }
+
+    returned.n = 0;
+    pthread_mutex_unlock(&returned.mutex);
+}
+
+static bool accept_connection(int listener, struct pollfd* connections, size_t* n) {
+    struct timeval timeout = {.tv_sec = IO_TIMEOUT};
+    int fd = accept(listener, NULL, NULL);
+
+    if(fd < 0) { return errno == EINTR || errno == ECONNABORTED || errno == EAGAIN; }
+
+    // A client sending its request piece by piece, or not reading the response, frees its worker
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    connections[(*n)++] = (struct pollfd) {.fd = fd, .events = POLLIN};
+    __atomic_add_fetch(&open_connections, 1, __ATOMIC_RELAXED);
+
+    return true;
+}
+
+int main(int argc, char** argv) {
+    options = parse_options(argc, argv);
+
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+
+    if(strlen(options.socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", options.socket_path);
+        return EXIT_FAILURE;
+    }
+
+    strcpy(address.sun_path, options.socket_path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    unlink(options.socket_path);
+
+    if(listener < 0 || bind(listener, (struct sockaddr*) &address, sizeof(address)) != 0 || listen(listener, QUEUE_SZ) != 0) {
+        fprintf(stderr, "Cannot listen on %s: %s\n", options.socket_path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    if(pipe(returned.wake) != 0 || fcntl(returned.wake[0], F_SETFL, O_NONBLOCK) != 0 || fcntl(returned.wake[1], F_SETFL, O_NONBLOCK) != 0) {
+        fprintf(stderr, "Cannot create the wake pipe: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    // No SA_RESTART: a signal interrupts poll, so that the daemon can stop
+    struct sigaction action = {.sa_handler = on_signal};
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    init_model_cache(&cache, options.memory_budget);
+    cache.huge_pages = options.huge_pages;
+
+    pthread_t* workers = malloc(options.workers * sizeof(*workers));
+
+    // The listener and the wake pipe, then the idle connections
+    struct pollfd* pfds = malloc((2 + MAX_CONNECTIONS) * sizeof(*pfds));
+    struct pollfd* idle = pfds + 2;
+    size_t idle_n = 0;
+
+    if(workers == NULL || pfds == NULL) {
+        fprintf(stderr, "Could not allocate memory for the workers\n");
+        return EXIT_FAILURE;
+    }
+
+    for(size_t i = 0; i < options.workers; i++) {
+        if(pthread_create(&workers[i], NULL, worker, NULL) != 0) {
+            fprintf(stderr, "Cannot start the worker threads\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    fprintf(stderr, "Listening on %s (%zu workers, %d solver threads each, %zu MB of models)\n",
+        options.socket_path, options.workers, options.solver_threads, options.memory_budget >> 20);
+
+    pfds[0] = (struct pollfd) {.fd = listener, .events = POLLIN};
+    pfds[1] = (struct pollfd) {.fd = returned.wake[0], .events = POLLIN};
+
+    while(!is_stopping()) {
+        // At MAX_CONNECTIONS, new clients wait in the listen backlog
+        bool full = __atomic_load_n(&open_connections, __ATOMIC_RELAXED) >= MAX_CONNECTIONS;
+
+        pfds[0].events = full ? 0 : POLLIN;
+
+        int ready = poll(pfds, 2 + idle_n, POLL_INTERVAL);
+
+        if(ready < 0 && errno != EINTR) {
+            fprintf(stderr, "Cannot wait for requests: %s\n", strerror(errno));
+            break;
+        }
+
+        if(ready <= 0) { continue; }
+
+        dispatch_requests(idle, &idle_n);
+
+        if(pfds[1].revents & POLLIN) { watch_returned(returned.wake[0], idle, &idle_n); }
+
+        if((pfds[0].revents & POLLIN) && !accept_connection(listener, idle, &idle_n)) {
+            fprintf(stderr, "Cannot accept connections: %s\n", strerror(errno));
+            break;
+        }
+    }
+
+    close(listener);
+    unlink(options.socket_path);
+
+    for(size_t i = 0; i < options.workers; i++) { push_connection(-1); }
+    for(size_t i = 0; i < options.workers; i++) { pthread_join(workers[i], NULL); }
+
+    // The workers have given back the connections they were serving
+    watch_returned(returned.wake[0], idle, &idle_n);
+
+    for(size_t i = 0; i < idle_n; i++) { close(idle[i].fd); }
+
+    close(returned.wake[0]);
+    close(returned.wake[1]);
+    free(pfds);
+    free(workers);
+    free_model_cache(&cache);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,747 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../src/instance.h"
+#include "../src/generator.h"
+#include "../src/lookup.h"
+#include "../src/davis.h"
+#include "../src/eps.h"
+#include "../src/segment_evaluation.h"
+#include "../src/individual.h"
+#include "../src/packed_model.h"
+
+/*
+ * Differential checks of the look-up tables and of the evaluator.
+ *
+ * The reference below is a frozen copy of the scalar physics of lookup.c and
+ * segment_evaluation.c, cell by cell and phase by phase, in the same floating point order:
+ * it must not be optimised along with them. Every other way the library has to build tables
+ * or evaluate runs is compared against it, on randomised instances.
+ */
+
+// Tables of the reference, in the order their cells are compared
+#define REFERENCE_TABLES 9
+
+// Random individuals evaluated with each evaluator
+#define POPULATION_SIZE 32
+
+/**
+ * Command line options.
+ */
+typedef struct DifferentialOptions {
+    const char*     instance_file;      // If not NULL, check this instance only
+    size_t          instances;          // Generated instances
+    size_t          segments;           // Segments of each generated instance
+    unsigned int    seed;               // Seed of the first generated instance, and of the inputs
+    size_t          evaluations;        // Random evaluations per segment
+    size_t          distance_stride;    // Stride of the coarse tables
+    double          abs_tolerance;      // Largest absolute difference accepted
+    double          rel_tolerance;      // Largest difference accepted, relative to the reference value
+} DifferentialOptions;
+
+/**
+ * The tables built by the reference, indexed as those of Lookup with distance_stride = 1.
+ */
+typedef struct ReferenceTables {
+    size_t  speeds_n;
+    size_t  lengths_n;
+    float*  cells[REFERENCE_TABLES];    // See table_names
+    float*  cruising_energy;
+} ReferenceTables;
+
+/**
+ * Outcome of a comparison.
+ */
+typedef struct Divergence {
+    size_t  compared;           // Values compared
+    size_t  diverging;          // Values outside the tolerance
+    double  max_difference;     // Largest absolute difference between two available values
+    char    first[256];         // Where the first divergence is, and the values there
+} Divergence;
+
+static const char* const table_names[REFERENCE_TABLES] = {
+    "max_acceleration.time", "max_acceleration.speed", "max_acceleration.position",
+    "coasting.time", "coasting.speed", "coasting.position",
+    "max_braking.time", "max_braking.speed", "max_braking.position"
+};
+
+enum {
+    MA_TIME = 0, MA_SPEED, MA_POSITION,
+    CO_TIME, CO_SPEED, CO_POSITION,
+    MB_TIME, MB_SPEED, MB_POSITION
+};
+
+static DifferentialOptions parse_options(int argc, char** argv) {
+    DifferentialOptions options = {
+        .instance_file = NULL,
+        .instances = 5,
+        .segments = 100,
+        .seed = 1u,
+        .evaluations = 200,
+        .distance_stride = 4,
+        .abs_tolerance = 0,
+        .rel_tolerance = 0
+    };
+
+    for(int i = 1; i < argc; i++) {
+        bool has_value = (i + 1 < argc);
+
+        if(strcmp(argv[i], "--instance") == 0 && has_value) {
+            options.instance_file = argv[++i];
+        } else if(strcmp(argv[i], "--instances") == 0 && has_value) {
+            options.instances = (size_t) strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--segments") == 0 && has_value) {
+            options.segments = (size_t) strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--seed") == 0 && has_value) {
+            options.seed = (unsigned int) strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--evaluations") == 0 && has_value) {
+            options.evaluations = (size_t) strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--stride") == 0 && has_value) {
+            options.distance_stride = (size_t) strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--abs-tol") == 0 && has_value) {
+            options.abs_tolerance = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--rel-tol") == 0 && has_value) {
+            options.rel_tolerance = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "Usage: %s [--instance file.json | --instances N --segments N] [--seed N] [--evaluations N] [--stride N] "
+                            "[--abs-tol x] [--rel-tol x]\n", argv[0]);
+            fprintf(stderr, "Compares the tables and the evaluator with a frozen reference; values agree if they differ by at most "
+                            "abs-tol + rel-tol * |reference| (by default, they must be identical)\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if(options.segments < 2 || options.instances == 0) {
+        fprintf(stderr, "There must be at least 1 instance of 2 segments\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return options;
+}
+
+/*
+ * Frozen copy of advance_motion (lookup.c).
+ */
+static bool reference_advance(const Train* train, const TrackResistance* track, float train_acceleration, float target_position, Motion* m) {
+    float acc = train_acceleration + resistance_on_track(train, track, m->speed);
+    float final_time;
+    float final_speed;
+    float final_position;
+    float distance_to_run = target_position - m->position;
+
+    if(acc > ACCELERATION_EPS) {
+        float running_time = (sqrtf(powf(m->speed, 2) + 2 * acc * distance_to_run) - m->speed) / acc;
+        final_time = m->time + running_time;
+        final_speed = m->speed + acc * running_time;
+        final_position = m->position + distance_to_run;
+    } else if(acc > - ACCELERATION_EPS) {
+        if(m->speed > SPEED_EPS) {
+            final_time = m->time + distance_to_run / m->speed;
+            final_speed = m->speed;
+            final_position = m->position + distance_to_run;
+        } else if(m->speed > -SPEED_EPS) {
+            final_time = m->time;
+            final_speed = m->speed;
+            final_position = m->position;
+        } else {
+            return false;
+        }
+    } else {
+        float running_length = - powf(m->speed, 2) / (2 * acc);
+
+        if(running_length >= distance_to_run) {
+            float running_time = (sqrtf(powf(m->speed, 2) + 2 * acc * distance_to_run) - m->speed) / acc;
+            final_time = m->time + running_time;
+            final_speed = m->speed + acc * running_time;
+            final_position = m->position + distance_to_run;
+        } else {
+            final_time = m->time - m->speed / acc;
+            final_speed = 0;
+            final_position = m->position - powf(m->speed, 2) / (2 * acc);
+        }
+    }
+
+    if(train_acceleration > 0) { m->energy += train_acceleration * (final_position - m->position); }
+
+    m->speed = final_speed;
+    m->time = final_time;
+    m->position = final_position;
+
+    return true;
+}
+
+/*
+ * Frozen copy of generate_lookup_table_for_acceleration (lookup.c), for full tables. The
+ * tables are the indices in ref->cells of the time, speed, and position tables of the driving
+ * style.
+ */
+static void reference_driving_style(const Instance* instance, ReferenceTables* ref, float train_acceleration, int time, int speed, int position) {
+    size_t slab_sz = ref->speeds_n * ref->lengths_n;
+
+    for(size_t i = 0; i < instance->num_segments; i++) {
+        const Segment* seg = &instance->segments[i];
+        TrackResistance track = track_resistance(seg);
+
+        for(size_t c = i * slab_sz; c < (i + 1) * slab_sz; c++) {
+            ref->cells[time][c] = ref->cells[speed][c] = ref->cells[position][c] = -1.0f;
+        }
+
+        for(size_t j = 0; j * SPEED_STEP <= seg->speed_limit; j++) {
+            float* row[3] = {
+                ref->cells[time] + i * slab_sz + j * ref->lengths_n,
+                ref->cells[speed] + i * slab_sz + j * ref->lengths_n,
+                ref->cells[position] + i * slab_sz + j * ref->lengths_n
+            };
+            Motion m = {.time = 0, .speed = j * SPEED_STEP, .position = 0, .energy = 0};
+
+            row[0][0] = 0; row[1][0] = m.speed; row[2][0] = 0;
+
+            if(seg->length <= SEGMENT_LENGTH_EPS) { break; }
+
+            for(size_t k = 1; k * DISTANCE_STEP <= seg->length; k++) {
+                bool valid = reference_advance(&instance->train, &track, train_acceleration, k * DISTANCE_STEP, &m);
+
+                row[0][k] = valid ? m.time : -1.0f;
+                row[1][k] = valid ? m.speed : -1.0f;
+                row[2][k] = valid ? m.position : -1.0f;
+            }
+        }
+    }
+}
+
+static ReferenceTables build_reference_tables(const Instance* instance) {
+    ReferenceTables ref;
+    float max_speed = 0, max_length = 0;
+
+    for(size_t i = 0; i < instance->num_segments; i++) {
+        if(instance->segments[i].speed_limit > max_speed) { max_speed = instance->segments[i].speed_limit; }
+        if(instance->segments[i].length > max_length) { max_length = instance->segments[i].length; }
+    }
+
+    ref.speeds_n = (size_t) (max_speed / SPEED_STEP + 1);
+    ref.lengths_n = (size_t) (max_length / DISTANCE_STEP + 1);
+
+    size_t cells = instance->num_segments * ref.speeds_n * ref.lengths_n;
+    bool ok = true;
+
+    for(size_t t = 0; t < REFERENCE_TABLES; t++) {
+        ref.cells[t] = malloc(cells * sizeof(float));
+        ok = ok && ref.cells[t] != NULL;
+    }
+
+    ref.cruising_energy = malloc(instance->num_segments * ref.speeds_n * sizeof(float));
+
+    if(!ok || ref.cruising_energy == NULL) {
+        fprintf(stderr, "Could not allocate memory for the reference tables\n");
+        exit(EXIT_FAILURE);
+    }
+
+    reference_driving_style(instance, &ref, instance->train.max_acceleration, MA_TIME, MA_SPEED, MA_POSITION);
+    reference_driving_style(instance, &ref, 0, CO_TIME, CO_SPEED, CO_POSITION);
+    reference_driving_style(instance, &ref, - instance->train.max_braking, MB_TIME, MB_SPEED, MB_POSITION);
+
+    for(size_t i = 0; i < instance->num_segments; i++) {
+        TrackResistance track = track_resistance(&instance->segments[i]);
+
+        for(size_t j = 0; j < ref.speeds_n; j++) {
+            ref.cruising_energy[i * ref.speeds_n + j] = - resistance_on_track(&instance->train, &track, j * SPEED_STEP);
+        }
+    }
+
+    return ref;
+}
+
+static void free_reference_tables(ReferenceTables* ref) {
+    for(size_t t = 0; t < REFERENCE_TABLES; t++) { free(ref->cells[t]); }
+    free(ref->cruising_energy);
+}
+
+static float reference_cell(const ReferenceTables* ref, int table, size_t segment, size_t speed, size_t distance) {
+    return ref->cells[table][segment * ref->speeds_n * ref->lengths_n + speed * ref->lengths_n + distance];
+}
+
+/*
+ * Frozen copy of run_on_segment (segment_evaluation.c), on the reference tables.
+ */
+static SegmentRun reference_run(const Instance* instance, const ReferenceTables* ref, const EvaluationInput* input) {
+    const Segment* seg = &instance->segments[input->segment_id];
+    size_t distance_steps = (size_t) (seg->length / DISTANCE_STEP);
+    size_t s = input->segment_id;
+    SegmentRun run;
+
+    run.start_speeds[MAX_ACCELERATION] = input->e_speed;
+    run.start_positions[MAX_ACCELERATION] = 0.0f;
+    run.start_times[MAX_ACCELERATION] = input->e_time;
+    run.accelerations[MAX_ACCELERATION] = instance->train.max_acceleration;
+
+    size_t ma_speed = (size_t) (input->e_speed / SPEED_STEP);
+
+    if(ma_speed >= ref->speeds_n || reference_cell(ref, MA_SPEED, s, ma_speed, input->x1) < 0) { goto invalid; }
+
+    float ma_end_speed = reference_cell(ref, MA_SPEED, s, ma_speed, input->x1);
+    float ma_end_pos = reference_cell(ref, MA_POSITION, s, ma_speed, input->x1);
+    float ma_end_time = input->e_time + reference_cell(ref, MA_TIME, s, ma_speed, input->x1);
+
+    run.end_speeds[MAX_ACCELERATION] = run.start_speeds[CRUISING] = ma_end_speed;
+    run.end_positions[MAX_ACCELERATION] = run.start_positions[CRUISING] = ma_end_pos;
+    run.end_times[MAX_ACCELERATION] = run.start_times[CRUISING] = ma_end_time;
+    run.energies[MAX_ACCELERATION] = instance->train.max_acceleration * ma_end_pos;
+
+    size_t cr_speed = (size_t) (ma_end_speed / SPEED_STEP);
+    size_t cr_distance = input->x2 - input->x1;
+
+    if(cr_speed >= ref->speeds_n) { goto invalid; }
+
+    float cr_energy_per_metre = ref->cruising_energy[s * ref->speeds_n + cr_speed];
+    float cr_end_speed = SPEED_STEP * cr_speed;
+    float cr_end_pos = ma_end_pos;
+    float cr_end_time = ma_end_time;
+
+    run.accelerations[CRUISING] = cr_energy_per_metre;
+
+    if(cr_distance > 0 && cr_speed > 0) {
+        cr_end_pos += DISTANCE_STEP * cr_distance;
+        cr_end_time += (DISTANCE_STEP * cr_distance) / (SPEED_STEP * cr_speed);
+    }
+
+    run.end_speeds[CRUISING] = run.start_speeds[COASTING] = cr_end_speed;
+    run.end_positions[CRUISING] = run.start_positions[COASTING] = cr_end_pos;
+    run.end_times[CRUISING] = run.start_times[COASTING] = cr_end_time;
+    run.energies[CRUISING] = (cr_energy_per_metre > 0) ? cr_energy_per_metre * (cr_end_pos - ma_end_pos) : 0;
+
+    size_t co_speed = (size_t) (cr_end_speed / SPEED_STEP);
+    size_t co_distance = input->x3 - input->x2;
+
+    run.accelerations[COASTING] = 0;
+    run.energies[COASTING] = 0;
+
+    if(co_speed >= ref->speeds_n || reference_cell(ref, CO_SPEED, s, co_speed, co_distance) < 0) { goto invalid; }
+
+    float co_end_speed = reference_cell(ref, CO_SPEED, s, co_speed, co_distance);
+    float co_end_pos = cr_end_pos + reference_cell(ref, CO_POSITION, s, co_speed, co_distance);
+    float co_end_time = cr_end_time + reference_cell(ref, CO_TIME, s, co_speed, co_distance);
+
+    run.end_speeds[COASTING] = run.start_speeds[MAX_BRAKING] = co_end_speed;
+    run.end_positions[COASTING] = run.start_positions[MAX_BRAKING] = co_end_pos;
+    run.end_times[COASTING] = run.start_times[MAX_BRAKING] = co_end_time;
+
+    size_t mb_speed = (size_t) (co_end_speed / SPEED_STEP);
+    size_t mb_distance = distance_steps - input->x3;
+
+    run.accelerations[MAX_BRAKING] = -instance->train.max_braking;
+    run.energies[MAX_BRAKING] = 0;
+
+    if(mb_speed >= ref->speeds_n || reference_cell(ref, MB_SPEED, s, mb_speed, mb_distance) < 0) { goto invalid; }
+
+    run.end_speeds[MAX_BRAKING] = reference_cell(ref, MB_SPEED, s, mb_speed, mb_distance);
+    run.end_positions[MAX_BRAKING] = co_end_pos + reference_cell(ref, MB_POSITION, s, mb_speed, mb_distance);
+    run.end_times[MAX_BRAKING] = co_end_time + reference_cell(ref, MB_TIME, s, mb_speed, mb_distance);
+
+    return run;
+
+invalid:
+    for(size_t p = 0; p < DRIVING_PHASES; p++) {
+        run.start_positions[p] = run.end_positions[p] = run.start_times[p] = run.end_times[p] = -1.0f;
+        run.start_speeds[p] = run.end_speeds[p] = run.accelerations[p] = run.energies[p] = -1.0f;
+    }
+
+    return run;
+}
+
+/*
+ * Frozen copy of cost_of_run (segment_evaluation.c).
+ */
+static float reference_cost(const Instance* instance, const EvaluationInput* input, const SegmentRun* run) {
+    if(run->end_times[MAX_BRAKING] < 0) { return INVALID_RUN_PENALTY; }
+
+    const Segment* seg = &instance->segments[input->segment_id];
+    float cost = 0;
+
+    cost += run->energies[MAX_ACCELERATION];
+    cost += run->energies[CRUISING];
+
+    if(run->end_speeds[CRUISING] > seg->speed_limit) {
+        cost += SPEED_EXCESS_PENALTY * (run->end_speeds[CRUISING] - seg->speed_limit);
+    }
+
+    if(input->segment_id + 1 < instance->num_segments) {
+        const Segment* next = &instance->segments[input->segment_id + 1];
+
+        if(run->end_speeds[MAX_BRAKING] > next->speed_limit) {
+            cost += SPEED_EXCESS_PENALTY * (run->end_speeds[MAX_BRAKING] - next->speed_limit);
+        }
+    }
+
+    float reachable_length = (size_t) (seg->length / DISTANCE_STEP) * DISTANCE_STEP;
+
+    if(reachable_length - run->end_positions[MAX_BRAKING] > DISTANCE_EPS) {
+        cost += SHORT_RUN_PENALTY * (reachable_length - run->end_positions[MAX_BRAKING]);
+    }
+
+    if(seg->has_arrival_time) {
+        cost += RUN_TIME_PENALTY * fabsf(run->end_times[MAX_BRAKING] - seg->arrival_time);
+    }
+
+    return cost;
+}
+
+/*
+ * Tells whether two values agree: unavailable cells (negative) only agree with each other.
+ */
+static bool agree(const DifferentialOptions* options, double reference, double value) {
+    if(isnan(reference) || isnan(value)) { return false; }
+    if(reference == value) { return true; }
+    if((reference == -1.0) != (value == -1.0)) { return false; }
+
+    return fabs(value - reference) <= options->abs_tolerance + options->rel_tolerance * fabs(reference);
+}
+
+/*
+ * Counts a comparison, and tells whether it is the first divergence, whose location the
+ * caller then describes.
+ */
+static bool first_divergence(const DifferentialOptions* options, Divergence* d, double reference, double value) {
+    d->compared++;
+
+    if(reference >= 0 && value >= 0 && fabs(value - reference) > d->max_difference) {
+        d->max_difference = fabs(value - reference);
+    }
+
+    if(agree(options, reference, value)) { return false; }
+
+    return ++d->diverging == 1;
+}
+
+static const char* run_field_name(size_t field) {
+    static const char* const arrays[] = {"start_positions", "end_positions", "start_times", "end_times", "start_speeds", "end_speeds", "accelerations", "energies"};
+    static const char* const phases[DRIVING_PHASES] = {"[MAX_ACCELERATION]", "[CRUISING]", "[COASTING]", "[MAX_BRAKING]"};
+    static __thread char name[64];
+
+    snprintf(name, sizeof(name), "%s%s", arrays[field / DRIVING_PHASES], phases[field % DRIVING_PHASES]);
+
+    return name;
+}
+
+static float table_value(const Lookup* l, int table, size_t segment, size_t speed, size_t distance) {
+    switch(table) {
+        case MA_TIME: return get_max_acceleration_time(l, segment, speed, distance);
+        case MA_SPEED: return get_max_acceleration_speed(l, segment, speed, distance);
+        case MA_POSITION: return get_max_acceleration_position(l, segment, speed, distance);
+        case CO_TIME: return get_coasting_time(l, segment, speed, distance);
+        case CO_SPEED: return get_coasting_speed(l, segment, speed, distance);
+        case CO_POSITION: return get_coasting_position(l, segment, speed, distance);
+        case MB_TIME: return get_max_braking_time(l, segment, speed, distance);
+        case MB_SPEED: return get_max_braking_speed(l, segment, speed, distance);
+        default: return get_max_braking_position(l, segment, speed, distance);
+    }
+}
+
+/*
+ * Compares every cell of the tables with the reference. Coarse tables are compared on the
+ * cells they keep, which must be those of the full tables.
+ */
+static Divergence compare_tables(const DifferentialOptions* options, const Instance* instance, const ReferenceTables* ref, const Lookup* l) {
+    Divergence d = {.compared = 0, .diverging = 0, .max_difference = 0, .first = ""};
+    size_t stride = l->distance_stride;
+
+    // The last cell of a coarse row can lie past the end of the segment, where the reference has none
+
+    if(l->speeds_n != ref->speeds_n || (l->lengths_n - 1) * stride < ref->lengths_n - 1) {
+        d.diverging = 1;
+        snprintf(d.first, sizeof(d.first), "dimensions %zu x %zu (stride %zu), expected %zu x %zu",
+            l->speeds_n, l->lengths_n, stride, ref->speeds_n, ref->lengths_n);
+        return d;
+    }
+
+    for(int t = 0; t < REFERENCE_TABLES; t++) {
+        for(size_t i = 0; i < instance->num_segments; i++) {
+            for(size_t j = 0; j < ref->speeds_n; j++) {
+                for(size_t k = 0; k < ref->lengths_n && (stride == 1 || k <= get_distance_steps(&instance->segments[i])); k += stride) {
+                    float expected = reference_cell(ref, t, i, j, k);
+                    float value = table_value(l, t, i, j, k);
+
+                    if(first_divergence(options, &d, expected, value)) {
+                        snprintf(d.first, sizeof(d.first), "%s at (segment %zu, speed %zu, distance %zu): %.9g, expected %.9g",
+                            table_names[t], i, j, k, value, expected);
+                    }
+                }
+            }
+        }
+    }
+
+    for(size_t i = 0; i < instance->num_segments; i++) {
+        for(size_t j = 0; j < ref->speeds_n; j++) {
+            float expected = ref->cruising_energy[i * ref->speeds_n + j];
+            float value = get_cruising_energy_per_metre(l, i, j);
+
+            if(first_divergence(options, &d, expected, value)) {
+                snprintf(d.first, sizeof(d.first), "cruising_energy at (segment %zu, speed %zu): %.9g, expected %.9g", i, j, value, expected);
+            }
+        }
+    }
+
+    return d;
+}
+
+/*
+ * Compares the reach tables with a linear scan of the reference speed rows. Distance
+ * indices must be identical, whatever the tolerance.
+ */
+static Divergence compare_reach(const Instance* instance, const ReferenceTables* ref, const Lookup* l) {
+    Divergence d = {.compared = 0, .diverging = 0, .max_difference = 0, .first = ""};
+
+    for(size_t i = 0; i < instance->num_segments; i++) {
+        for(size_t j = 0; j < ref->speeds_n; j++) {
+            for(size_t h = 0; h < ref->speeds_n; h++) {
+                size_t expected[2] = {UNREACHED_DISTANCE, UNREACHED_DISTANCE};
+                size_t value[2] = {get_max_acceleration_reach(l, i, j, h), get_max_braking_reach(l, i, j, h)};
+
+                for(size_t k = ref->lengths_n; k-- > 0;) {
+                    float accelerating = reference_cell(ref, MA_SPEED, i, j, k);
+                    float braking = reference_cell(ref, MB_SPEED, i, j, k);
+
+                    if(accelerating >= 0 && accelerating >= h * SPEED_STEP) { expected[0] = k; }
+                    if(braking >= 0 && braking <= h * SPEED_STEP) { expected[1] = k; }
+                }
+
+                for(size_t style = 0; style < 2; style++) {
+                    d.compared++;
+
+                    if(value[style] != expected[style] && ++d.diverging == 1) {
+                        snprintf(d.first, sizeof(d.first), "%s at (segment %zu, speed %zu, target speed %zu): %zu, expected %zu",
+                            style == 0 ? "acceleration_reach" : "braking_reach", i, j, h, value[style], expected[style]);
+                    }
+                }
+            }
+        }
+    }
+
+    return d;
+}
+
+/*
+ * Draws an input of the segment: the entry speed is sometimes above the speed limit, and the
+ * switching points anywhere on the segment.
+ */
+static EvaluationInput random_input(const Instance* instance, size_t segment, unsigned int* seed) {
+    const Segment* seg = &instance->segments[segment];
+    size_t steps = get_distance_steps(seg);
+    size_t x[3];
+
+    for(size_t p = 0; p < 3; p++) { x[p] = (size_t) rand_r(seed) % (steps + 1); }
+
+    // Sorting network of three values
+    if(x[0] > x[1]) { size_t tmp = x[0]; x[0] = x[1]; x[1] = tmp; }
+    if(x[1] > x[2]) { size_t tmp = x[1]; x[1] = x[2]; x[2] = tmp; }
+    if(x[0] > x[1]) { size_t tmp = x[0]; x[0] = x[1]; x[1] = tmp; }
+
+    return (EvaluationInput) {
+        .segment_id = segment,
+        .x1 = x[0],
+        .x2 = x[1],
+        .x3 = x[2],
+        .e_speed = (seg->speed_limit + 2 * SPEED_STEP) * (float) rand_r(seed) / (float) RAND_MAX,
+        .e_time = 1000.0f * (float) rand_r(seed) / (float) RAND_MAX
+    };
+}
+
+/*
+ * Compares run_on_segment and cost_of_run, on the given tables, with the reference.
+ */
+static Divergence compare_evaluations(const DifferentialOptions* options, const Instance* instance, const ReferenceTables* ref, const Lookup* l, unsigned int seed) {
+    Divergence d = {.compared = 0, .diverging = 0, .max_difference = 0, .first = ""};
+
+    for(size_t i = 0; i < instance->num_segments; i++) {
+        for(size_t e = 0; e < options->evaluations; e++) {
+            EvaluationInput input = random_input(instance, i, &seed);
+            SegmentRun expected = reference_run(instance, ref, &input);
+            SegmentRun run = run_on_segment(instance, l, &input);
+            const float* a = (const float*) &expected;
+            const float* b = (const float*) &run;
+            float expected_cost = reference_cost(instance, &input, &expected);
+            float cost = cost_of_run(instance, &input, &run);
+
+            // The fields of a run are all floats, compared in their order, then the cost
+            for(size_t f = 0; f <= sizeof(run) / sizeof(float); f++) {
+                bool is_cost = (f == sizeof(run) / sizeof(float));
+                float x = is_cost ? expected_cost : a[f];
+                float y = is_cost ? cost : b[f];
+
+                if(first_divergence(options, &d, x, y)) {
+                    snprintf(d.first, sizeof(d.first), "run on segment %zu from %.4f m/s (speed %zu), x = %zu, %zu, %zu: %s %.9g, expected %.9g",
+                        i, input.e_speed, get_speed_index(input.e_speed), input.x1, input.x2, input.x3,
+                        is_cost ? "cost" : run_field_name(f), y, x);
+                }
+            }
+        }
+    }
+
+    return d;
+}
+
+/*
+ * Compares evaluate_population with evaluate_individual on random individuals.
+ */
+static Divergence compare_population(const DifferentialOptions* options, const Instance* instance, const Lookup* l, unsigned int seed) {
+    Divergence d = {.compared = 0, .diverging = 0, .max_difference = 0, .first = ""};
+    Individual individuals[POPULATION_SIZE], copies[POPULATION_SIZE];
+    Individual* batch[POPULATION_SIZE];
+    TegaError error = no_error();
+
+    for(size_t p = 0; p < POPULATION_SIZE; p++) {
+        individuals[p] = new_individual(instance, &error);
+        copies[p] = new_individual(instance, &error);
+
+        if(error.status != TEGA_OK) {
+            fprintf(stderr, "%s\n", error.message);
+            exit(EXIT_FAILURE);
+        }
+
+        randomise_individual(instance, l, &individuals[p], &seed);
+        copy_individual(&copies[p], &individuals[p]);
+        evaluate_individual(instance, l, &copies[p]);
+        batch[p] = &individuals[p];
+
+        // Whatever evaluate_population does not write diverges
+        for(size_t i = 0; i < instance->num_segments; i++) {
+            individuals[p].entry_speeds[i + 1] = individuals[p].entry_times[i + 1] = individuals[p].costs[i] = NAN;
+        }
+
+        individuals[p].cost = NAN;
+    }
+
+    evaluate_population(instance, l, batch, NULL, POPULATION_SIZE);
+
+    for(size_t p = 0; p < POPULATION_SIZE; p++) {
+        for(size_t i = 0; i <= instance->num_segments; i++) {
+            bool first = first_divergence(options, &d, copies[p].entry_speeds[i], individuals[p].entry_speeds[i]);
+            first |= first_divergence(options, &d, copies[p].entry_times[i], individuals[p].entry_times[i]);
+
+            if(i < instance->num_segments) {
+                first |= first_divergence(options, &d, copies[p].costs[i], individuals[p].costs[i]);
+            }
+
+            if(first) {
+                snprintf(d.first, sizeof(d.first), "individual %zu, segment %zu: entry speed %.9g, time %.9g, expected %.9g, %.9g",
+                    p, i, individuals[p].entry_speeds[i], individuals[p].entry_times[i], copies[p].entry_speeds[i], copies[p].entry_times[i]);
+            }
+        }
+
+        if(first_divergence(options, &d, copies[p].cost, individuals[p].cost)) {
+            snprintf(d.first, sizeof(d.first), "individual %zu: cost %.9g, expected %.9g", p, individuals[p].cost, copies[p].cost);
+        }
+
+        free_individual(&individuals[p]);
+        free_individual(&copies[p]);
+    }
+
+    return d;
+}
+
+static bool report(const char* check, const Divergence* d) {
+    if(d->diverging == 0) {
+        printf("  %-34s ok       %10zu values, max difference %.3g\n", check, d->compared, d->max_difference);
+    } else {
+        printf("  %-34s DIVERGES %10zu of %zu values, max difference %.3g\n", check, d->diverging, d->compared, d->max_difference);
+        printf("  %-34s first:   %s\n", "", d->first);
+    }
+
+    return d->diverging == 0;
+}
+
+/*
+ * Checks every alternative with the reference on an instance.
+ */
+static bool check_instance(const DifferentialOptions* options, const Instance* instance, unsigned int seed) {
+    TegaError error = no_error();
+    ReferenceTables ref = build_reference_tables(instance);
+    bool ok = true;
+
+    Lookup full = generate_lookup_tables(instance, &error);
+    if(error.status != TEGA_OK || !add_reach_tables(instance, &full, &error)) { fprintf(stderr, "%s\n", error.message); exit(EXIT_FAILURE); }
+
+    Divergence d = compare_tables(options, instance, &ref, &full);
+    ok = report("tables", &d) && ok;
+    d = compare_evaluations(options, instance, &ref, &full, seed);
+    ok = report("run_on_segment, cost_of_run", &d) && ok;
+    d = compare_population(options, instance, &full, seed);
+    ok = report("evaluate_population", &d) && ok;
+    d = compare_reach(instance, &ref, &full);
+    ok = report("reach tables", &d) && ok;
+
+    free_lookup_tables(&full);
+
+    TrackResistance* tracks = malloc(instance->num_segments * sizeof(*tracks));
+    if(tracks == NULL) { fprintf(stderr, "Could not allocate memory for the track resistance\n"); exit(EXIT_FAILURE); }
+    for(size_t i = 0; i < instance->num_segments; i++) { tracks[i] = track_resistance(&instance->segments[i]); }
+
+    Lookup on_track = generate_lookup_tables_on_track(instance, tracks, &error);
+    if(error.status != TEGA_OK) { fprintf(stderr, "%s\n", error.message); exit(EXIT_FAILURE); }
+
+    d = compare_tables(options, instance, &ref, &on_track);
+    ok = report("tables on shared track", &d) && ok;
+
+    free_lookup_tables(&on_track);
+    free(tracks);
+
+    PackedModel model;
+    if(!pack_model(instance, false, &model, &error) || !add_reach_tables(&model.instance, &model.lookup, &error)) { fprintf(stderr, "%s\n", error.message); exit(EXIT_FAILURE); }
+
+    d = compare_tables(options, instance, &ref, &model.lookup);
+    ok = report("tables of the packed model", &d) && ok;
+    d = compare_reach(instance, &ref, &model.lookup);
+    ok = report("reach tables of the packed model", &d) && ok;
+    d = compare_evaluations(options, &model.instance, &ref, &model.lookup, seed);
+    ok = report("run_on_segment on the packed model", &d) && ok;
+
+    free_packed_model(&model);
+
+    Lookup coarse = generate_coarse_lookup_tables(instance, options->distance_stride, &error);
+    if(error.status != TEGA_OK) { fprintf(stderr, "%s\n", error.message); exit(EXIT_FAILURE); }
+
+    char name[64];
+    snprintf(name, sizeof(name), "coarse tables (stride %zu)", options->distance_stride);
+    d = compare_tables(options, instance, &ref, &coarse);
+    ok = report(name, &d) && ok;
+
+    free_lookup_tables(&coarse);
+    free_reference_tables(&ref);
+
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    DifferentialOptions options = parse_options(argc, argv);
+    size_t instances = (options.instance_file != NULL) ? 1 : options.instances;
+    size_t failed = 0;
+
+    for(size_t n = 0; n < instances; n++) {
+        GeneratorParams generator = default_generator_params(options.segments, options.seed + (unsigned int) n);
+        TegaError error = no_error();
+        Instance instance = (options.instance_file != NULL) ? read_instance_streaming(options.instance_file, &error) : generate_instance(&generator, &error);
+
+        if(error.status != TEGA_OK) {
+            fprintf(stderr, "%s\n", error.message);
+            exit(EXIT_FAILURE);
+        }
+
+        if(options.instance_file != NULL) {
+            printf("Instance %s (%zu segments)\n", options.instance_file, instance.num_segments);
+        } else {
+            printf("Instance %zu (seed %u, %zu segments)\n", n, options.seed + (unsigned int) n, instance.num_segments);
+        }
+
+        if(!check_instance(&options, &instance, options.seed + (unsigned int) n)) { failed++; }
+
+        free_instance(&instance);
+    }
+
+    printf("%zu of %zu instances agree with the reference\n", instances - failed, instances);
+
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
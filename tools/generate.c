@@ -0,0 +1,110 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/instance.h"
+#include "../src/generator.h"
+
+static void usage(const char* program) {
+    fprintf(stderr,
+        "Usage: %s [options] instance.json\n"
+        "  --segments N            Number of segments, stations included\n"
+        "  --seed N                Seed of the random number generator\n"
+        "  --train T               Train type: tgv, sncf, ice, db\n"
+        "  --length MIN:MAX        Segment length [m]\n"
+        "  --slope MIN:MAX         Slope [rad]\n"
+        "  --curve MIN:MAX         Curve radius [m]\n"
+        "  --straight P            Probability that a segment is straight\n"
+        "  --speed MIN:MAX         Speed limit [m/s]\n"
+        "  --speed-change P        Probability that the speed limit changes between segments\n"
+        "  --spacing MIN:MAX       Segments between two stations\n"
+        "  --stop MIN:MAX          Stop time at intermediate stations [s]\n"
+        "  --schedule-fraction F   Fraction of the speed limit assumed by the timetable\n",
+        program);
+    exit(EXIT_FAILURE);
+}
+
+static GeneratorRange parse_range(const char* program, const char* str) {
+    GeneratorRange range;
+
+    if(sscanf(str, "%f:%f", &range.min, &range.max) != 2 || range.min > range.max) {
+        fprintf(stderr, "Invalid range: %s\n", str);
+        usage(program);
+    }
+
+    return range;
+}
+
+static TrainType parse_train_type(const char* program, const char* str) {
+    if(strcmp(str, "tgv") == 0) { return SNCF_TGV; }
+    if(strcmp(str, "sncf") == 0) { return SNCF_NORMAL; }
+    if(strcmp(str, "ice") == 0) { return DB_ICE; }
+    if(strcmp(str, "db") == 0) { return DB_NORMAL; }
+
+    fprintf(stderr, "Invalid train type: %s\n", str);
+    usage(program);
+    return SNCF_TGV;
+}
+
+int main(int argc, char** argv) {
+    GeneratorParams params = default_generator_params(1000, 1u);
+    const char* output = NULL;
+
+    for(int i = 1; i < argc; i++) {
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if(argv[i][0] != '-') {
+            output = argv[i];
+            continue;
+        } else if(value == NULL) {
+            usage(argv[0]);
+        } else if(strcmp(argv[i], "--segments") == 0) {
+            params.num_segments = (size_t) strtoul(value, NULL, 10);
+        } else if(strcmp(argv[i], "--seed") == 0) {
+            params.seed = (unsigned int) strtoul(value, NULL, 10);
+        } else if(strcmp(argv[i], "--train") == 0) {
+            params.train_type = parse_train_type(argv[0], value);
+        } else if(strcmp(argv[i], "--length") == 0) {
+            params.segment_length = parse_range(argv[0], value);
+        } else if(strcmp(argv[i], "--slope") == 0) {
+            params.slope = parse_range(argv[0], value);
+        } else if(strcmp(argv[i], "--curve") == 0) {
+            params.curve = parse_range(argv[0], value);
+        } else if(strcmp(argv[i], "--straight") == 0) {
+            params.straight_probability = strtof(value, NULL);
+        } else if(strcmp(argv[i], "--speed") == 0) {
+            params.speed_limit = parse_range(argv[0], value);
+        } else if(strcmp(argv[i], "--speed-change") == 0) {
+            params.speed_limit_change_probability = strtof(value, NULL);
+        } else if(strcmp(argv[i], "--spacing") == 0) {
+            params.station_spacing = parse_range(argv[0], value);
+        } else if(strcmp(argv[i], "--stop") == 0) {
+            params.stop_time = parse_range(argv[0], value);
+        } else if(strcmp(argv[i], "--schedule-fraction") == 0) {
+            params.schedule_speed_fraction = strtof(value, NULL);
+        } else {
+            usage(argv[0]);
+        }
+
+        i++;
+    }
+
+    if(output == NULL || params.num_segments < 2 || params.schedule_speed_fraction <= 0 || params.segment_length.min <= 0) {
+        usage(argv[0]);
+    }
+
+    TegaError error = no_error();
+    Instance instance = generate_instance(&params, &error);
+    bool ok = (error.status == TEGA_OK) && write_instance(&instance, output, &error);
+
+    if(!ok) {
+        fprintf(stderr, "%s\n", error.message);
+    }
+
+    free_instance(&instance);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,409 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../src/instance.h"
+#include "../src/generator.h"
+#include "../src/preprocessing.h"
+#include "../src/lookup.h"
+#include "../src/segment_evaluation.h"
+#include "../src/trace.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+// Hardware counters read during a sequential replay, when the kernel allows it
+#define PERF_COUNTERS 3
+
+/**
+ * Command line options.
+ */
+typedef struct ReplayOptions {
+    const char*     trace_file;         // Trace to replay
+    const char*     instance_file;      // If NULL, use a generated instance
+    size_t          segments;           // Segments of the generated instance
+    unsigned int    seed;               // Seed of the generated instance
+    bool            preprocess;         // Preprocess the instance as the solver does
+    size_t          distance_stride;    // Replay on coarse tables with this stride, if more than 1
+    size_t          repetitions;        // Replays of the whole trace
+    bool            parallel;           // Replay the blocks of the trace on all threads
+    bool            with_cost;          // Also compute the cost of each run
+    bool            json_output;        // A json object, rather than a report
+} ReplayOptions;
+
+/**
+ * Access pattern of a trace, in the order it was recorded by each thread.
+ */
+typedef struct TraceLocality {
+    size_t  distinct_segments;      // Segments evaluated at least once
+    size_t  distinct_rows;          // (segment, entry speed) rows of the tables entered at least once
+    double  same_segment;           // Fraction of evaluations on the segment of the previous one
+    double  mean_jump;              // Mean distance between the segments of consecutive evaluations
+} TraceLocality;
+
+/**
+ * Outcome of the replays.
+ */
+typedef struct ReplayResult {
+    double      best_time;                      // Fastest replay [s]
+    double      mean_time;                      // Mean replay time [s]
+    size_t      valid_runs;                     // Runs inside the tables, in one replay
+    double      checksum;                       // Sum of the end times (and costs) of one replay
+    bool        has_counters;                   // Whether counters were read
+    uint64_t    counters[PERF_COUNTERS];        // Totals over all replays
+} ReplayResult;
+
+static const char* const counter_names[PERF_COUNTERS] = {"cache_references", "cache_misses", "l1d_read_misses"};
+
+static ReplayOptions parse_options(int argc, char** argv) {
+    ReplayOptions options = {
+        .trace_file = NULL,
+        .instance_file = NULL,
+        .segments = 200,
+        .seed = 1u,
+        .preprocess = false,
+        .distance_stride = 1,
+        .repetitions = 5,
+        .parallel = false,
+        .with_cost = false,
+        .json_output = false
+    };
+
+    for(int i = 1; i < argc; i++) {
+        bool has_value = (i + 1 < argc);
+
+        if(strcmp(argv[i], "--trace") == 0 && has_value) {
+            options.trace_file = argv[++i];
+        } else if(strcmp(argv[i], "--instance") == 0 && has_value) {
+            options.instance_file = argv[++i];
+        } else if(strcmp(argv[i], "--segments") == 0 && has_value) {
+            options.segments = (size_t) strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--seed") == 0 && has_value) {
+            options.seed = (unsigned int) strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--preprocess") == 0) {
+            options.preprocess = true;
+        } else if(strcmp(argv[i], "--stride") == 0 && has_value) {
+            options.distance_stride = (size_t) strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--repeat") == 0 && has_value) {
+            options.repetitions = (size_t) strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--parallel") == 0) {
+            options.parallel = true;
+        } else if(strcmp(argv[i], "--cost") == 0) {
+            options.with_cost = true;
+        } else if(strcmp(argv[i], "--json") == 0) {
+            options.json_output = true;
+        } else {
+            options.trace_file = NULL;
+            break;
+        }
+    }
+
+    if(options.trace_file == NULL) {
+        fprintf(stderr, "Usage: %s --trace file.trace [--instance file.json | --segments N --seed N] [--preprocess] [--stride N] "
+                        "[--repeat N] [--parallel] [--cost] [--json]\n", argv[0]);
+        fprintf(stderr, "Replays the segment evaluations recorded with tega --evaluation-trace, on the instance they were recorded on\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if(options.distance_stride == 0 || options.repetitions == 0) {
+        fprintf(stderr, "The stride and the number of repetitions must be positive\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return options;
+}
+
+static double seconds_since(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (double) (now.tv_sec - start->tv_sec) + 1e-9 * (double) (now.tv_nsec - start->tv_nsec);
+}
+
+/*
+ * Only the table rows where runs start are counted: the other rows a run reads depend on
+ * the speeds it reaches.
+ */
+static TraceLocality trace_locality(const EvaluationTrace* trace, const Lookup* lt, size_t num_segments) {
+    TraceLocality locality = {.distinct_segments = 0, .distinct_rows = 0, .same_segment = 0, .mean_jump = 0};
+    bool* segments = calloc(num_segments, sizeof(*segments));
+    bool* rows = calloc(num_segments * lt->speeds_n, sizeof(*rows));
+    size_t same = 0, pairs = 0;
+    double jumps = 0;
+
+    if(segments == NULL || rows == NULL) {
+        fprintf(stderr, "Could not allocate memory to analyse the trace\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for(size_t b = 0; b < trace->blocks_n; b++) {
+        for(size_t i = trace->block_starts[b]; i < trace->block_starts[b + 1]; i++) {
+            const EvaluationInput* input = &trace->inputs[i];
+            size_t speed = get_speed_index(input->e_speed);
+
+            if(!segments[input->segment_id]) { segments[input->segment_id] = true; locality.distinct_segments++; }
+
+            if(speed < lt->speeds_n && !rows[input->segment_id * lt->speeds_n + speed]) {
+                rows[input->segment_id * lt->speeds_n + speed] = true;
+                locality.distinct_rows++;
+            }
+
+            if(i > trace->block_starts[b]) {
+                size_t previous = trace->inputs[i - 1].segment_id;
+
+                pairs++;
+                if(previous == input->segment_id) { same++; }
+                jumps += (double) (previous > input->segment_id ? previous - input->segment_id : input->segment_id - previous);
+            }
+        }
+    }
+
+    if(pairs > 0) {
+        locality.same_segment = (double) same / (double) pairs;
+        locality.mean_jump = jumps / (double) pairs;
+    }
+
+    free(segments);
+    free(rows);
+
+    return locality;
+}
+
+#ifdef __linux__
+static int open_counter(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+/*
+ * Opens the hardware counters of the calling thread, or returns false if any is not available
+ * (e.g. without a PMU, or with perf_event_paranoid too high).
+ */
+static bool open_counters(int* fds) {
+#ifdef __linux__
+    fds[0] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES);
+    fds[1] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    fds[2] = open_counter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+
+    bool ok = true;
+
+    for(size_t c = 0; c < PERF_COUNTERS; c++) {
+        if(fds[c] < 0) { ok = false; }
+    }
+
+    if(!ok) {
+        for(size_t c = 0; c < PERF_COUNTERS; c++) {
+            if(fds[c] >= 0) { close(fds[c]); }
+        }
+    }
+
+    return ok;
+#else
+    (void) fds;
+    return false;
+#endif
+}
+
+static void toggle_counters(const int* fds, bool enable) {
+#ifdef __linux__
+    for(size_t c = 0; c < PERF_COUNTERS; c++) {
+        ioctl(fds[c], enable ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE, 0);
+    }
+#else
+    (void) fds;
+    (void) enable;
+#endif
+}
+
+static void close_counters(const int* fds, uint64_t* totals) {
+#ifdef __linux__
+    for(size_t c = 0; c < PERF_COUNTERS; c++) {
+        uint64_t value = 0;
+
+        if(read(fds[c], &value, sizeof(value)) == (ssize_t) sizeof(value)) { totals[c] = value; }
+        close(fds[c]);
+    }
+#else
+    (void) fds;
+    (void) totals;
+#endif
+}
+
+/*
+ * Runs the evaluations of a block in their order, adding their end times (and costs) to the
+ * checksum, so that none of them can be left out.
+ */
+static size_t replay_block(const Instance* instance, const Lookup* lt, const EvaluationInput* inputs, size_t n, bool with_cost, double* checksum) {
+    size_t valid = 0;
+    double sum = 0;
+
+    for(size_t i = 0; i < n; i++) {
+        SegmentRun run = run_on_segment(instance, lt, &inputs[i]);
+
+        if(is_valid_run(&run)) {
+            valid++;
+            sum += run.end_times[DRIVING_PHASES - 1];
+        }
+
+        if(with_cost) { sum += cost_of_run(instance, &inputs[i], &run); }
+    }
+
+    *checksum += sum;
+
+    return valid;
+}
+
+static ReplayResult replay_trace(const Instance* instance, const Lookup* lt, const EvaluationTrace* trace, const ReplayOptions* options) {
+    ReplayResult result = {.best_time = 0, .mean_time = 0, .valid_runs = 0, .checksum = 0, .has_counters = false, .counters = {0, 0, 0}};
+    int fds[PERF_COUNTERS];
+
+    // Counters only follow the calling thread
+    result.has_counters = !options->parallel && open_counters(fds);
+
+    for(size_t r = 0; r < options->repetitions; r++) {
+        size_t valid = 0;
+        double checksum = 0;
+        struct timespec start;
+
+        if(result.has_counters) { toggle_counters(fds, true); }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        if(options->parallel) {
+            // Each block keeps its order, as when it was recorded
+            #pragma omp parallel for schedule(dynamic) reduction(+:valid, checksum)
+            for(size_t b = 0; b < trace->blocks_n; b++) {
+                size_t first = trace->block_starts[b];
+                valid += replay_block(instance, lt, &trace->inputs[first], trace->block_starts[b + 1] - first, options->with_cost, &checksum);
+            }
+        } else {
+            valid = replay_block(instance, lt, trace->inputs, trace->inputs_n, options->with_cost, &checksum);
+        }
+
+        double elapsed = seconds_since(&start);
+        if(result.has_counters) { toggle_counters(fds, false); }
+
+        if(r == 0 || elapsed < result.best_time) { result.best_time = elapsed; }
+        result.mean_time += elapsed / (double) options->repetitions;
+        result.valid_runs = valid;
+        result.checksum = checksum;
+    }
+
+    if(result.has_counters) { close_counters(fds, result.counters); }
+
+    return result;
+}
+
+/*
+ * Gives the instance a trace was recorded on: the one the solver evaluated, after any
+ * preprocessing.
+ */
+static Instance load_instance(const ReplayOptions* options, TegaError* error) {
+    GeneratorParams generator = default_generator_params(options->segments, options->seed);
+    Instance original = (options->instance_file != NULL) ? read_instance_streaming(options->instance_file, error) : generate_instance(&generator, error);
+
+    if(error->status != TEGA_OK || !options->preprocess) { return original; }
+
+    PreprocessingParams preprocessing = default_preprocessing_params();
+    RouteMapping mapping;
+    Instance instance = preprocess_instance(&original, &preprocessing, &mapping, error);
+
+    if(error->status == TEGA_OK) { free_route_mapping(&mapping); }
+    free_instance(&original);
+
+    return instance;
+}
+
+int main(int argc, char** argv) {
+    ReplayOptions options = parse_options(argc, argv);
+    TegaError error = no_error();
+    Instance instance = load_instance(&options, &error);
+    EvaluationTrace trace = {.inputs = NULL};
+    Lookup lt = {.cruising_energy = NULL};
+
+    if(error.status == TEGA_OK) { trace = read_evaluation_trace(options.trace_file, &instance, &error); }
+
+    if(error.status == TEGA_OK) {
+        lt = (options.distance_stride > 1) ? generate_coarse_lookup_tables(&instance, options.distance_stride, &error) : generate_lookup_tables(&instance, &error);
+    }
+
+    if(error.status != TEGA_OK) {
+        fprintf(stderr, "%s\n", error.message);
+        exit(EXIT_FAILURE);
+    }
+
+    if(trace.inputs_n == 0) {
+        fprintf(stderr, "The trace is empty\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int threads = 1;
+#ifdef _OPENMP
+    if(options.parallel) { threads = omp_get_max_threads(); }
+#endif
+
+    TraceLocality locality = trace_locality(&trace, &lt, instance.num_segments);
+    ReplayResult result = replay_trace(&instance, &lt, &trace, &options);
+    double evaluations = (double) trace.inputs_n;
+
+    if(options.json_output) {
+        printf("{\"evaluations\": %zu, \"blocks\": %zu, \"recorded_threads\": %zu, \"replay_threads\": %d, \"distance_stride\": %zu, "
+               "\"repetitions\": %zu, \"best_ns_per_evaluation\": %.2f, \"mean_ns_per_evaluation\": %.2f, \"evaluations_per_second\": %.0f, "
+               "\"valid_runs\": %zu, \"checksum\": %.6e, \"distinct_segments\": %zu, \"distinct_rows\": %zu, \"same_segment\": %.4f, \"mean_jump\": %.2f",
+            trace.inputs_n, trace.blocks_n, trace.threads, threads, options.distance_stride, options.repetitions,
+            1e9 * result.best_time / evaluations, 1e9 * result.mean_time / evaluations, evaluations / result.best_time,
+            result.valid_runs, result.checksum, locality.distinct_segments, locality.distinct_rows, locality.same_segment, locality.mean_jump);
+
+        for(size_t c = 0; result.has_counters && c < PERF_COUNTERS; c++) {
+            printf(", \"%s_per_evaluation\": %.3f", counter_names[c], (double) result.counters[c] / (evaluations * (double) options.repetitions));
+        }
+
+        printf("}\n");
+    } else {
+        printf("=== EVALUATION TRACE REPLAY (%zu evaluations in %zu blocks from %zu threads, on %d threads, stride %zu) ===\n",
+            trace.inputs_n, trace.blocks_n, trace.threads, threads, options.distance_stride);
+        printf("Throughput:      %.2f ns per evaluation (best of %zu), %.2f ns mean, %.2f M evaluations/s\n",
+            1e9 * result.best_time / evaluations, options.repetitions, 1e9 * result.mean_time / evaluations, 1e-6 * evaluations / result.best_time);
+        printf("Runs:            %zu valid (%.2f%%), checksum %.6e\n",
+            result.valid_runs, 100.0 * (double) result.valid_runs / evaluations, result.checksum);
+        printf("Locality:        %zu/%zu segments, %zu table rows entered, %.2f%% on the previous segment, mean jump %.2f segments\n",
+            locality.distinct_segments, instance.num_segments, locality.distinct_rows, 100 * locality.same_segment, locality.mean_jump);
+
+        if(result.has_counters) {
+            printf("Cache:           ");
+            for(size_t c = 0; c < PERF_COUNTERS; c++) {
+                printf("%s%.3f %s", (c == 0 ? "" : ", "), (double) result.counters[c] / (evaluations * (double) options.repetitions), counter_names[c]);
+            }
+            printf(" per evaluation\n");
+        } else {
+            printf("Cache:           hardware counters not available%s\n", options.parallel ? " with --parallel" : "");
+        }
+    }
+
+    free_lookup_tables(&lt);
+    free_evaluation_trace(&trace);
+    free_instance(&instance);
+
+    return 0;
+}
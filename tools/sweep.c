@@ -0,0 +1,199 @@
+//
+// Created by alberto on 18/10/26.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/instance.h"
+#include "../src/generator.h"
+#include "../src/genetic.h"
+#include "../src/sweep.h"
+
+// Maximum number of trains in a sweep
+#define MAX_VARIANTS 64
+
+// Without --variant, the route's own train is swept over these fractions of its mass
+#define DEFAULT_MASS_FACTORS {0.8f, 0.9f, 1.0f, 1.1f, 1.2f}
+
+/**
+ * Command line options.
+ */
+typedef struct SweepOptions {
+    const char*     instance_file;              // If NULL, use a generated route
+    size_t          segments;                   // Segments of the generated route
+    unsigned int    seed;                       // Seed of the generated route and of the algorithm
+    size_t          generations;                // Generations of the genetic algorithm for each train
+    size_t          population;                 // Individuals of the genetic algorithm
+    double          time_limit;                 // Time limit of the genetic algorithm for each train [s]
+    const char*     variants[MAX_VARIANTS];     // Train specifications, see parse_variant
+    size_t          variants_n;
+    bool            json_output;                // One json object per train
+} SweepOptions;
+
+/*
+ * Reads a train specification, "key=value,key=value,...", with keys mass [kg], mass_per_axle
+ * [kg], coaches, length [m], acceleration and braking [m/s^2]. Missing values are those of the
+ * base train, except the mass per axle, which follows the mass if only that is given.
+ */
+static Train parse_variant(const char* spec, const Train* base) {
+    char buffer[256];
+    float mass = base->mass, mass_per_axle = -1, length = base->length;
+    float acceleration = base->max_acceleration, braking = base->max_braking;
+    unsigned long coaches = base->num_coaches;
+
+    snprintf(buffer, sizeof(buffer), "%s", spec);
+
+    char* saveptr = NULL;
+
+    for(char* item = strtok_r(buffer, ",", &saveptr); item != NULL; item = strtok_r(NULL, ",", &saveptr)) {
+        char* value = strchr(item, '=');
+
+        if(value == NULL) {
+            fprintf(stderr, "Invalid train specification: %s\n", spec);
+            exit(EXIT_FAILURE);
+        }
+
+        *value++ = '\0';
+
+        if(strcmp(item, "mass") == 0) {
+            mass = strtof(value, NULL);
+        } else if(strcmp(item, "mass_per_axle") == 0) {
+            mass_per_axle = strtof(value, NULL);
+        } else if(strcmp(item, "coaches") == 0) {
+            coaches = strtoul(value, NULL, 10);
+        } else if(strcmp(item, "length") == 0) {
+            length = strtof(value, NULL);
+        } else if(strcmp(item, "acceleration") == 0) {
+            acceleration = strtof(value, NULL);
+        } else if(strcmp(item, "braking") == 0) {
+            braking = strtof(value, NULL);
+        } else {
+            fprintf(stderr, "Unknown key in train specification: %s\n", item);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if(mass_per_axle < 0) { mass_per_axle = base->mass_per_axle * mass / base->mass; }
+
+    return (Train) {
+        .type = base->type,
+        .num_coaches = coaches,
+        .mass = mass,
+        .mass_per_axle = mass_per_axle,
+        .max_acceleration = acceleration,
+        .max_braking = braking,
+        .length = length
+    };
+}
+
+static SweepOptions parse_options(int argc, char** argv) {
+    SweepOptions options = {
+        .instance_file = NULL,
+        .segments = 200,
+        .seed = 1u,
+        .generations = 100,
+        .population = 100,
+        .time_limit = 0,
+        .variants_n = 0,
+        .json_output = false
+    };
+
+    for(int i = 1; i < argc; i++) {
+        bool has_value = (i + 1 < argc);
+
+        if(strcmp(argv[i], "--instance") == 0 && has_value) {
+            options.instance_file = argv[++i];
+        } else if(strcmp(argv[i], "--segments") == 0 && has_value) {
+            options.segments = (size_t) strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--seed") == 0 && has_value) {
+            options.seed = (unsigned int) strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--generations") == 0 && has_value) {
+            options.generations = (size_t) strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--population") == 0 && has_value) {
+            options.population = (size_t) strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--time-limit") == 0 && has_value) {
+            options.time_limit = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--variant") == 0 && has_value && options.variants_n < MAX_VARIANTS) {
+            options.variants[options.variants_n++] = argv[++i];
+        } else if(strcmp(argv[i], "--json") == 0) {
+            options.json_output = true;
+        } else {
+            fprintf(stderr, "Usage: %s [--instance file.json | --segments N] [--seed N] [--generations N] [--population N] [--time-limit s] "
+                            "[--variant mass=kg,mass_per_axle=kg,coaches=N,length=m,acceleration=m/s2,braking=m/s2]... [--json]\n", argv[0]);
+            fprintf(stderr, "Up to %d variants of the route's train; without any, its mass is swept from 80%% to 120%%\n", MAX_VARIANTS);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if(options.segments < 2 || options.population == 0) {
+        fprintf(stderr, "There must be at least 2 segments and 1 individual\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return options;
+}
+
+int main(int argc, char** argv) {
+    SweepOptions options = parse_options(argc, argv);
+    GeneratorParams generator = default_generator_params(options.segments, options.seed);
+    TegaError error = no_error();
+    Instance route = (options.instance_file != NULL) ? read_instance_streaming(options.instance_file, &error) : generate_instance(&generator, &error);
+
+    if(error.status != TEGA_OK) {
+        fprintf(stderr, "%s\n", error.message);
+        exit(EXIT_FAILURE);
+    }
+
+    Train trains[MAX_VARIANTS];
+    size_t trains_n = 0;
+
+    if(options.variants_n == 0) {
+        float factors[] = DEFAULT_MASS_FACTORS;
+
+        for(size_t f = 0; f < sizeof(factors) / sizeof(*factors); f++) {
+            char spec[64];
+            snprintf(spec, sizeof(spec), "mass=%.1f", route.train.mass * factors[f]);
+            Train train = parse_variant(spec, &route.train);
+            memcpy(&trains[trains_n++], &train, sizeof(train));
+        }
+    }
+
+    for(size_t v = 0; v < options.variants_n; v++) {
+        Train train = parse_variant(options.variants[v], &route.train);
+        memcpy(&trains[trains_n++], &train, sizeof(train));
+    }
+
+    GeneticParams params = default_genetic_params();
+    params.num_generations = options.generations;
+    params.population_size = options.population;
+    params.time_limit = options.time_limit;
+    params.seed = options.seed;
+
+    SweepResult result = run_train_sweep(&route, trains, trains_n, &params, &error);
+
+    if(error.status != TEGA_OK) {
+        fprintf(stderr, "%s\n", error.message);
+        exit(EXIT_FAILURE);
+    }
+
+    if(options.json_output) {
+        for(size_t t = 0; t < result.entries_n; t++) {
+            const SweepEntry* e = &result.entries[t];
+
+            printf("{\"train\": %zu, \"type\": \"%s\", \"num_coaches\": %lu, \"mass\": %.1f, \"mass_per_axle\": %.1f, \"length\": %.1f, "
+                   "\"max_acceleration\": %.3f, \"max_braking\": %.3f, \"feasible\": %s, \"energy_j_per_kg\": %.3f, \"energy_kwh\": %.3f, "
+                   "\"running_time\": %.3f, \"arrival_deviation\": %.3f, \"violation\": %.3f, \"table_time\": %.6f, \"solve_time\": %.6f}\n",
+                t, train_type_name(trains[t].type), (unsigned long) trains[t].num_coaches, trains[t].mass, trains[t].mass_per_axle, trains[t].length,
+                trains[t].max_acceleration, trains[t].max_braking, e->feasible ? "true" : "false", e->objectives.energy, e->energy_kwh,
+                e->running_time, e->objectives.deviation, e->objectives.violation, e->table_time, e->solve_time);
+        }
+    } else {
+        print_sweep_report(&result, trains);
+    }
+
+    free_sweep_result(&result);
+    free_instance(&route);
+
+    return 0;
+}